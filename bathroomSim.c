@@ -0,0 +1,196 @@
+/* simulation of the unisex bathroom on a worker pool with a virtual clock
+
+   usage: gcc -O2 -c bathroomSim.c, then link bathroomSim.o with groupLock.o, taskPool.o, the program and -lpthread
+*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bathroomSim.h"
+#include "taskPool.h"
+
+/* One simulated person, waiter first so a granted waiter is the person */
+struct SimPerson {
+  struct GroupWaiter waiter;
+  int group;
+  bool inside;
+  long arrived;          /* tick of the last arrival */
+  long waited;           /* ticks the current visit waited to enter */
+  uint64_t random;
+};
+
+/* The events of one tick, persons whose next event falls on it */
+struct Bucket {
+  pthread_mutex_t lock;
+  long *persons;
+  long count;
+  long capacity;
+};
+
+/* The simulation being run, one at a time */
+static struct Simulation {
+  struct GroupLock *lock;
+  const struct SimConfig *config;
+  struct SimPerson *persons;
+  struct Bucket *wheel;
+  long wheelMask;        /* the wheel has a power of two buckets, more than the longest delay in ticks */
+  long now;              /* current tick */
+  struct SimStats *workerStats;
+  atomic_int occupancy[MAXGROUPS];
+  atomic_long violations;
+} sim;
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/* Ticks of a uniform delay in [low, high) seconds, at least one */
+static long randomTicks(struct SimPerson *person, double low, double high) {
+  person->random ^= person->random << 13; /* xorshift */
+  person->random ^= person->random >> 7;
+  person->random ^= person->random << 17;
+  double delay = low + (high - low) * (person->random >> 11) * 0x1.0p-53;
+  long ticks = (long) ceil(delay / sim.config->tick);
+  return ticks < 1 ? 1 : ticks;
+}
+
+/* Files the next event of person id at tick, any worker may call it for any tick but the current one */
+static void schedule(long id, long tick) {
+  struct Bucket *bucket = &sim.wheel[tick & sim.wheelMask];
+  pthread_mutex_lock(&bucket->lock);
+  if (bucket->count == bucket->capacity) {
+    long capacity = bucket->capacity < 64 ? 64 : 2 * bucket->capacity;
+    long *persons = realloc(bucket->persons, capacity * sizeof(long));
+    if (persons == NULL) abort(); /* nothing sensible to do halfway through a tick */
+    bucket->persons = persons;
+    bucket->capacity = capacity;
+  }
+  bucket->persons[bucket->count++] = id;
+  pthread_mutex_unlock(&bucket->lock);
+}
+
+/* The person is inside, by its own arrival or admitted by someone leaving */
+static void entered(struct SimPerson *person) {
+  int inside = atomic_fetch_add(&sim.occupancy[person->group], 1) + 1;
+  for (int g = 0; g < sim.lock->groups; g++) {
+    if (g != person->group && atomic_load(&sim.occupancy[g]) != 0) atomic_fetch_add(&sim.violations, 1);
+  }
+  if (sim.lock->capacity > 0 && inside > sim.lock->capacity) atomic_fetch_add(&sim.violations, 1);
+  person->inside = true;
+  person->waited = sim.now - person->arrived;
+  schedule(person - sim.persons, sim.now + randomTicks(person, sim.config->minInside, sim.config->maxInside));
+}
+
+static void granted(struct GroupWaiter *waiter) {
+  entered((struct SimPerson *) waiter);
+}
+
+/* Runs the events of persons [low, high) of the current tick's bucket, splitting large ranges for other workers */
+static void tickTask(struct TaskWorker *worker, void *context, long low, long high) {
+  const long *ids = context;
+  struct SimStats *stats = &sim.workerStats[worker->id];
+  while (high - low > SIMGRAIN) {
+    long middle = low + (high - low) / 2;
+    taskSpawn(worker, tickTask, context, middle, high);
+    high = middle;
+  }
+  for (long i = low; i < high; i++) {
+    struct SimPerson *person = &sim.persons[ids[i]];
+    if (!person->inside) { /* arrives, either goes in or is queued until a leave admits it */
+      person->arrived = sim.now;
+      if (groupEnterAsync(sim.lock, person->group, &person->waiter)) entered(person);
+    } else { /* leaves and comes back later */
+      int group = person->group;
+      double waited = person->waited * sim.config->tick;
+      person->inside = false;
+      atomic_fetch_sub(&sim.occupancy[group], 1);
+      stats->visits[group]++;
+      stats->waitSeconds[group] += waited;
+      if (waited > stats->longestWait[group]) stats->longestWait[group] = waited;
+      schedule(ids[i], sim.now + randomTicks(person, sim.config->minOutside, sim.config->maxOutside));
+      groupLeave(sim.lock, group); /* may admit queued persons, their events are filed from here */
+    }
+  }
+}
+
+void simDefaults(struct SimConfig *config, long persons, double seconds) {
+  *config = (struct SimConfig) { persons, seconds, SIMTICK, 1, false, 1, 1, 4, 1, 4 };
+}
+
+bool bathroomSimulate(struct GroupLock *lock, const struct SimConfig *config, struct SimStats *stats) {
+  struct TaskPool pool;
+  double longest = config->maxOutside > config->maxInside ? config->maxOutside : config->maxInside;
+  long wheelSize = 2;
+  while (wheelSize <= (long) ceil(longest / config->tick) + 1) wheelSize *= 2;
+
+  memset(stats, 0, sizeof(*stats));
+  memset(&sim, 0, sizeof(sim));
+  sim.lock = lock;
+  sim.config = config;
+  sim.wheelMask = wheelSize - 1;
+  sim.persons = calloc(config->persons > 0 ? config->persons : 1, sizeof(struct SimPerson));
+  sim.wheel = calloc(wheelSize, sizeof(struct Bucket));
+  if (sim.persons == NULL || sim.wheel == NULL || !taskPoolInit(&pool, config->workers)) {
+    free(sim.persons);
+    free(sim.wheel);
+    return false;
+  }
+  sim.workerStats = calloc(pool.numWorkers, sizeof(struct SimStats));
+  if (sim.workerStats == NULL) {
+    taskPoolDestroy(&pool);
+    free(sim.persons);
+    free(sim.wheel);
+    return false;
+  }
+  for (long b = 0; b < wheelSize; b++) pthread_mutex_init(&sim.wheel[b].lock, NULL);
+  for (long i = 0; i < config->persons; i++) { /* everybody starts outside and arrives within one outside time */
+    struct SimPerson *person = &sim.persons[i];
+    person->waiter.granted = granted;
+    person->group = i % lock->groups;
+    person->random = (config->seed + i + 1) * 0x9e3779b97f4a7c15ULL | 1;
+    schedule(i, randomTicks(person, 0, config->maxOutside) - 1);
+  }
+
+  long endTick = (long) (config->seconds / config->tick);
+  double start = seconds();
+  for (sim.now = 0; sim.now < endTick; sim.now++) {
+    struct Bucket *bucket = &sim.wheel[sim.now & sim.wheelMask];
+    long count = bucket->count; /* nobody files into the current tick, every delay is a tick or more */
+    if (count == 0) continue;
+    if (config->realtime) { /* wait for the tick to come on the real clock */
+      double wait = start + sim.now * config->tick - seconds();
+      if (wait > 0) {
+        struct timespec length = { (time_t) wait, (long) ((wait - (time_t) wait) * 1e9) };
+        nanosleep(&length, NULL);
+      }
+    }
+    taskPoolRun(&pool, tickTask, bucket->persons, 0, count);
+    bucket->count = 0;
+    stats->events += count;
+    stats->ticks++;
+  }
+  stats->wallSeconds = seconds() - start;
+  taskPoolDestroy(&pool);
+
+  for (int w = 0; w < pool.numWorkers; w++) {
+    for (int g = 0; g < MAXGROUPS; g++) {
+      stats->visits[g] += sim.workerStats[w].visits[g];
+      stats->waitSeconds[g] += sim.workerStats[w].waitSeconds[g];
+      if (sim.workerStats[w].longestWait[g] > stats->longestWait[g]) stats->longestWait[g] = sim.workerStats[w].longestWait[g];
+    }
+  }
+  stats->violations = atomic_load(&sim.violations);
+  for (long b = 0; b < wheelSize; b++) {
+    pthread_mutex_destroy(&sim.wheel[b].lock);
+    free(sim.wheel[b].persons);
+  }
+  free(sim.wheel);
+  free(sim.persons);
+  free(sim.workerStats);
+  return true;
+}
@@ -0,0 +1,54 @@
+/* simulation of the unisex bathroom with many more persons than threads
+
+   features: persons are records, not threads. Each has one pending event (arrive or leave) filed in a timing wheel
+             of buckets, one per tick of the virtual clock. The main thread advances the clock to the next tick with
+             events and the workers of a taskPool.c pool run that tick's events in parallel against the real group lock
+             (groupLock.c) through groupEnterAsync, so contention and the lock's fairness are real but nobody blocks:
+             a person that has to wait is handed back by the groupLeave that admits it. Every delay is at least one
+             tick, so the events of a tick never depend on each other and ticks can run one after the other.
+             The virtual clock runs as fast as the events allow, a simulated hour with 100000 persons takes seconds.
+             realtime paces every tick against the monotonic clock instead, so the run takes as long as it simulates.
+
+   usage: compile bathroomSim.c together with the program, with groupLock.c and taskPool.c
+*/
+#ifndef BATHROOMSIM_H
+#define BATHROOMSIM_H
+
+#include <stdbool.h>
+#include "groupLock.h"
+
+#define SIMTICK 0.01     /* default seconds per tick of the virtual clock */
+#define SIMGRAIN 256     /* events of a tick run by one task */
+#define SIMSTARVED 0.25  /* a mean wait over this share of the simulated time grows with it, the waits are unbounded */
+#define SIMCHECKED 60    /* shortest simulated seconds whose mean waits are checked against SIMSTARVED */
+
+struct SimConfig {
+  long persons;          /* in all, spread round robin over the groups of the lock */
+  double seconds;        /* simulated time */
+  double tick;
+  int workers;
+  bool realtime;
+  unsigned long long seed;
+  double minOutside, maxOutside;  /* seconds between visits, uniform */
+  double minInside, maxInside;    /* seconds of a visit, uniform */
+};
+
+struct SimStats {
+  long events;
+  long ticks;            /* ticks that had events */
+  long visits[MAXGROUPS];
+  double waitSeconds[MAXGROUPS];  /* virtual seconds from arriving to entering, total and longest */
+  double longestWait[MAXGROUPS];
+  long violations;       /* entries while another group was inside or the capacity was full */
+  double wallSeconds;
+};
+
+/* Fills a config with persons, seconds and the defaults: SIMTICK, one worker, visits of 1 to 4 seconds 1 to 4
+   seconds apart as in unisex-bathroom.c */
+void simDefaults(struct SimConfig *config, long persons, double seconds);
+
+/* Runs the simulation on lock, which must be initialized and empty. Persons still inside or queued at the end stay
+   in the lock, initialize it again before reusing it. Returns false if memory or threads ran out */
+bool bathroomSimulate(struct GroupLock *lock, const struct SimConfig *config, struct SimStats *stats);
+
+#endif
@@ -0,0 +1,250 @@
+/* benchmark driver for all the programs, linked with their cores (benchCore.h)
+
+   features: sweeps every combination of --programs, --dists, --sizes and --threads. Each point runs --warmup untimed
+             runs and then --repeats timed ones, each on input generated fresh from the same seed, and reports the
+             median, minimum and standard deviation of the times. The speedup is the median of the first thread count
+             over the median of this one, the parallel efficiency the speedup per thread added (threads over the first
+             thread count), both from the threads the core really used: the matrix sums are capped at their MAXWORKERS,
+             the spawning quicksort reports the threads it created and the bathroom rounds down to an even number.
+             Every run is checked twice: by the core itself (sorted keys, the sum against a sequential loop, the bathroom
+             never shared) and against the other variants of the same problem, the sums must all give the same total and
+             the sorts the same keys for a given distribution, size and seed. Failures are reported on stderr and make
+             the exit status 1.
+             --format csv (default) prints a line per point, --format json an array with an object per point.
+             Times come from clock_gettime(CLOCK_MONOTONIC) or omp_get_wtime inside the cores.
+
+   programs: matrixSum, matrixSum-openmp, quicksort-spawn, quicksort-pool, quicksort-openmp, bathroom, bathroom-semaphore
+
+   usage under Linux:
+     gcc -O2 -fopenmp -DNO_MAIN -o bench bench.c matrixSum.c matrixSum-openmp.c quicksort.c quicksort-openmp.c \
+         unisex-bathroom.c groupLock.c bathroomSim.c eventLog.c latencyHistogram.c rowReduce.c matrix.c matrixFile.c \
+         matrixIndex.c typedReduce.c stats.c taskPool.c parallelPartition.c introsort.c radixSort.c externalSort.c \
+         parallelSort.c generator.c perfCounters.c -lpthread -lm
+     ./bench [--programs p1,p2,...] [--sizes n1,n2,...] [--threads t1,t2,...] [--dists d1,d2,...] [--repeats n]
+             [--warmup n] [--seed n] [--format csv|json]
+     adding -DTRACE and trace.c records the timeline of every run (trace.h) into TRACEFILE
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "benchCore.h"
+
+#define SIZE 1000000   /* default size */
+#define REPEATS 5      /* default timed runs per point */
+#define WARMUP 1       /* default untimed runs per point */
+#define MAXLIST 32     /* most values any list option takes */
+
+/* A program of the sweep, programs of the same family solve the same problem and must agree on the checksum */
+struct Program {
+  const char *name;
+  const char *family;
+  bool (*core)(struct BenchRun *run);
+};
+
+static const struct Program programs[] = {
+  { "matrixSum", "sum", matrixSumCore },
+  { "matrixSum-openmp", "sum", matrixSumOpenmpCore },
+  { "quicksort-spawn", "sort", quicksortSpawnCore },
+  { "quicksort-pool", "sort", quicksortPoolCore },
+  { "quicksort-openmp", "sort", quicksortOpenmpCore },
+  { "bathroom", "bathroom", bathroomCore },
+  { "bathroom-semaphore", "bathroom", bathroomSemaphoreCore },
+};
+#define NUMPROGRAMS ((int) (sizeof(programs) / sizeof(programs[0])))
+
+/* The checksum a family agreed on for one distribution, size and seed */
+struct Reference {
+  const char *family;
+  enum Distribution distribution;
+  long size;
+  long long checksum;
+};
+
+/* Reads a comma separated list of positive numbers, returns how many or -1 if one is invalid */
+static int parseLongs(const char *text, long values[]) {
+  int count = 0;
+  for (const char *next = text; count < MAXLIST && *next != '\0'; next += *next == ',') {
+    char *end;
+    values[count] = strtol(next, &end, 0);
+    if (end == next || values[count] < 1) return -1;
+    count++;
+    next = end;
+  }
+  return count;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+  int option;
+  static struct option options[] = {
+    { "programs", required_argument, NULL, 'p' },
+    { "sizes", required_argument, NULL, 'n' },
+    { "threads", required_argument, NULL, 't' },
+    { "dists", required_argument, NULL, 'd' },
+    { "repeats", required_argument, NULL, 'r' },
+    { "warmup", required_argument, NULL, 'w' },
+    { "seed", required_argument, NULL, 'S' },
+    { "format", required_argument, NULL, 'f' },
+    { NULL, 0, NULL, 0 }
+  };
+  long sizes[MAXLIST] = { SIZE }, threads[MAXLIST];
+  int numSizes = 1, numThreads = 0, numPrograms = NUMPROGRAMS, numDists = 1;
+  int selected[NUMPROGRAMS];
+  enum Distribution dists[MAXLIST] = { DIST_UNIFORM };
+  int repeats = REPEATS, warmup = WARMUP;
+  unsigned long long seed = time(NULL); /* Random seed unless --seed is given, every point uses the same one */
+  bool json = false;
+  char *list, *name;
+  int numCores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  for (int k = 0; k < NUMPROGRAMS; k++) selected[k] = k;
+  for (long t = 1; numThreads < MAXLIST; t = t * 2 < numCores ? t * 2 : numCores) { /* 1, 2, 4, ... up to the cores */
+    threads[numThreads++] = t;
+    if (t >= numCores) break;
+  }
+
+  /* read command line options */
+  while ((option = getopt_long(argc, argv, "p:n:t:d:r:w:S:f:", options, NULL)) != -1) {
+    switch (option) {
+    case 'p':
+      numPrograms = 0;
+      list = strdup(optarg);
+      for (name = strtok(list, ","); name != NULL && numPrograms < NUMPROGRAMS; name = strtok(NULL, ",")) {
+        int k = 0;
+        while (k < NUMPROGRAMS && strcmp(programs[k].name, name) != 0) k++;
+        if (k == NUMPROGRAMS) {
+          printf("Unknown program %s\n", name);
+          return 1;
+        }
+        selected[numPrograms++] = k;
+      }
+      free(list);
+      break;
+    case 'n':
+    case 't':
+      if ((option == 'n' ? (numSizes = parseLongs(optarg, sizes)) : (numThreads = parseLongs(optarg, threads))) < 1) {
+        printf("Invalid list %s, expected positive numbers separated by commas\n", optarg);
+        return 1;
+      }
+      break;
+    case 'd':
+      numDists = 0;
+      list = strdup(optarg);
+      for (name = strtok(list, ","); name != NULL && numDists < MAXLIST; name = strtok(NULL, ",")) {
+        if (!parseDistribution(name, &dists[numDists++])) {
+          printf("Unknown distribution %s, expected uniform, sorted, reverse, few or zipf\n", name);
+          return 1;
+        }
+      }
+      free(list);
+      break;
+    case 'r': repeats = atoi(optarg); break;
+    case 'w': warmup = atoi(optarg); break;
+    case 'S': seed = strtoull(optarg, NULL, 0); break;
+    case 'f':
+      if (strcmp(optarg, "json") != 0 && strcmp(optarg, "csv") != 0) {
+        printf("Unknown format %s, expected csv or json\n", optarg);
+        return 1;
+      }
+      json = strcmp(optarg, "json") == 0;
+      break;
+    default: return 1;
+    }
+  }
+  if (repeats < 1) repeats = 1;
+  if (warmup < 0) warmup = 0;
+
+  double *times = malloc(repeats * sizeof(double));
+  struct Reference *references = malloc(numDists * numSizes * NUMPROGRAMS * sizeof(struct Reference));
+  int numReferences = 0, points = 0;
+  bool failed = false;
+
+  if (json) {
+    printf("[\n");
+  } else {
+    printf("program,distribution,size,threads,used,median,min,stddev,speedup,efficiency,checksum,correct\n");
+  }
+  for (int d = 0; d < numDists; d++) {
+    for (int s = 0; s < numSizes; s++) {
+      for (int p = 0; p < numPrograms; p++) {
+        const struct Program *program = &programs[selected[p]];
+        double baseMedian = 0;
+        int baseThreads = 1;
+        for (int t = 0; t < numThreads; t++) {
+          struct BenchRun run;
+          bool correct = true;
+          long long checksum = 0;
+          for (int trial = -warmup; trial < repeats; trial++) {
+            run = (struct BenchRun) { sizes[s], threads[t], dists[d], seed, 0, 0, false };
+            if (!program->core(&run)) {
+              fprintf(stderr, "%s could not run %ld elements with %ld threads\n", program->name, sizes[s], threads[t]);
+              return 1;
+            }
+            if (trial < 0) continue; /* warmup, only the cache and the page tables are kept */
+            times[trial] = run.seconds;
+            correct = correct && run.correct;
+            if (trial > 0 && run.checksum != checksum) correct = false; /* a variant must not vary between trials */
+            checksum = run.checksum;
+          }
+
+          /* the first program of the family to get here sets the checksum the others must match */
+          int r = 0;
+          while (r < numReferences && !(strcmp(references[r].family, program->family) == 0 &&
+                                        references[r].distribution == dists[d] && references[r].size == sizes[s])) r++;
+          if (r == numReferences) {
+            references[numReferences++] = (struct Reference) { program->family, dists[d], sizes[s], checksum };
+          } else if (references[r].checksum != checksum && strcmp(program->family, "bathroom") != 0) {
+            fprintf(stderr, "%s gives checksum %lld for %s %ld, other %s programs gave %lld\n", program->name, checksum,
+                    distributionName(dists[d]), sizes[s], program->family, references[r].checksum);
+            correct = false;
+          }
+          if (!correct) {
+            fprintf(stderr, "%s failed its check (%s, %ld elements, %ld threads)\n", program->name, distributionName(dists[d]),
+                    sizes[s], threads[t]);
+            failed = true;
+          }
+
+          double mean = 0, variance = 0;
+          for (int i = 0; i < repeats; i++) mean += times[i] / repeats;
+          for (int i = 0; i < repeats; i++) variance += (times[i] - mean) * (times[i] - mean) / repeats;
+          qsort(times, repeats, sizeof(double), compareDoubles);
+          double median = repeats % 2 ? times[repeats / 2] : (times[repeats / 2 - 1] + times[repeats / 2]) / 2;
+          if (t == 0) {
+            baseMedian = median;
+            baseThreads = run.threads;
+          }
+          double speedup = median > 0 ? baseMedian / median : 0;
+          double efficiency = speedup * baseThreads / run.threads;
+
+          if (json) {
+            printf("%s  {\"program\": \"%s\", \"distribution\": \"%s\", \"size\": %ld, \"threads\": %ld, \"used\": %d, "
+                   "\"median\": %g, \"min\": %g, \"stddev\": %g, \"speedup\": %g, \"efficiency\": %g, \"checksum\": %lld, "
+                   "\"correct\": %s}", points > 0 ? ",\n" : "", program->name, distributionName(dists[d]), sizes[s],
+                   threads[t], run.threads, median, times[0], sqrt(variance), speedup, efficiency, checksum,
+                   correct ? "true" : "false");
+          } else {
+            printf("%s,%s,%ld,%ld,%d,%g,%g,%g,%g,%g,%lld,%s\n", program->name, distributionName(dists[d]), sizes[s],
+                   threads[t], run.threads, median, times[0], sqrt(variance), speedup, efficiency, checksum,
+                   correct ? "yes" : "no");
+          }
+          fflush(stdout);
+          points++;
+        }
+      }
+    }
+  }
+  if (json) printf("\n]\n");
+
+  free(times);
+  free(references);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+/* one timed run of a program, the interface between the programs and the benchmark driver bench.c
+
+   features: every program defines its core as a function filling a BenchRun: it builds the input from the seed and the
+             distribution (not timed), runs the parallel part with the given threads on the monotonic clock, then checks
+             its own answer. checksum lets the driver compare variants of the same problem: the matrix sums report the
+             total, the sorts a hash of the sorted keys, the bathroom the visits made. Compiling a program with -DNO_MAIN
+             leaves its main out so all of them can be linked into the driver.
+
+   usage: include in the programs and in bench.c
+*/
+#ifndef BENCHCORE_H
+#define BENCHCORE_H
+
+#include <stdbool.h>
+#include "generator.h"
+
+struct BenchRun {
+  long size;                       /* elements: matrix elements, keys to sort or bathroom visits */
+  int threads;                     /* asked for, lowered by the core to the most the program supports */
+  enum Distribution distribution;
+  unsigned long long seed;
+  double seconds;                  /* time of the parallel part */
+  long long checksum;              /* must agree between variants of the same problem */
+  bool correct;                    /* the core's own check of its answer */
+};
+
+/* Each returns false only if the run could not be set up (memory, threads) */
+bool matrixSumCore(struct BenchRun *run);        /* matrixSum.c, pool with the bag of tasks */
+bool matrixSumOpenmpCore(struct BenchRun *run);  /* matrixSum-openmp.c */
+bool quicksortSpawnCore(struct BenchRun *run);   /* quicksort.c, a thread per large partition */
+bool quicksortPoolCore(struct BenchRun *run);    /* quicksort.c, work-stealing pool */
+bool quicksortOpenmpCore(struct BenchRun *run);  /* quicksort-openmp.c */
+bool bathroomCore(struct BenchRun *run);         /* unisex-bathroom.c, threads people making size visits without sleeping */
+bool bathroomSemaphoreCore(struct BenchRun *run);  /* the same with the original semaphores instead of the group lock */
+
+/* Hash of count ints in order, equal arrays give equal hashes */
+static inline long long hashInts(const int *keys, long count) {
+  unsigned long long hash = 14695981039346656037ull;
+  for (long i = 0; i < count; i++) hash = (hash ^ (unsigned int) keys[i]) * 1099511628211ull;
+  return (long long) hash;
+}
+
+#endif
@@ -0,0 +1,111 @@
+/* prints a binary event log written by eventLog.c
+
+   features: every event becomes a line with the microseconds since the first event of the file, the thread, the
+             group, the event and the occupancy. --stats prints the histograms of the waits (wait to enter of the
+             same thread) and of the occupancy at entry per group instead, as unisex-bathroom.c does at shutdown,
+             so a log taken with --log can be analysed later or compared with another one.
+
+   usage under Linux:
+     gcc -O2 -o eventLog-decode eventLog-decode.c latencyHistogram.c -lm
+     ./eventLog-decode [--stats] file
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include "eventLog.h"
+#include "latencyHistogram.h"
+#include "groupLock.h"
+
+#define READBATCH 4096 /* events read at once */
+
+int main(int argc, char *argv[]) {
+  int option;
+  static struct option options[] = {
+    { "stats", no_argument, NULL, 's' },
+    { NULL, 0, NULL, 0 }
+  };
+  static const char *names[] = { "wait", "enter", "leave" };
+  bool stats = false;
+
+  /* read command line options, the remaining args are positional */
+  while ((option = getopt_long(argc, argv, "s", options, NULL)) != -1) {
+    switch (option) {
+    case 's': stats = true; break;
+    default: return 1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  if (argc < 2) {
+    printf("usage: eventLog-decode [--stats] file\n");
+    return 1;
+  }
+
+  FILE *file = fopen(argv[1], "rb");
+  struct LogHeader header;
+  if (file == NULL || fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, LOGMAGIC, 8) != 0) {
+    printf("%s is not an event log\n", argv[1]);
+    return 1;
+  }
+  if (header.version != LOGVERSION || header.eventSize != sizeof(struct LogEvent)) {
+    printf("%s has version %u with %u byte events, expected version %d with %zu\n", argv[1], header.version,
+           header.eventSize, LOGVERSION, sizeof(struct LogEvent));
+    return 1;
+  }
+
+  struct LogEvent *events = malloc(READBATCH * sizeof(struct LogEvent));
+  uint64_t *asked = calloc(MAXLOGRINGS, sizeof(uint64_t)); /* last wait of each thread, 0 if none is open */
+  struct LatencyHistogram *waits = malloc(MAXGROUPS * sizeof(struct LatencyHistogram));
+  struct LatencyHistogram *occupancy = malloc(MAXGROUPS * sizeof(struct LatencyHistogram));
+  for (int g = 0; g < MAXGROUPS; g++) {
+    latencyInit(&waits[g]);
+    latencyInit(&occupancy[g]);
+  }
+  uint64_t first = 0;
+  long total = 0, unmatched = 0;
+  int groups = 0;
+  size_t count;
+
+  while ((count = fread(events, sizeof(struct LogEvent), READBATCH, file)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      struct LogEvent *event = &events[i];
+      if (total++ == 0) first = event->nanos;
+      if (event->type > EVENT_LEAVE || event->group >= MAXGROUPS || event->thread >= MAXLOGRINGS) {
+        printf("Event %ld is corrupt\n", total);
+        return 1;
+      }
+      if (event->group >= groups) groups = event->group + 1;
+      if (!stats) {
+        printf("%12.3f %5u %3u %-5s %d\n", (double) (int64_t) (event->nanos - first) / 1e3, event->thread, event->group,
+               names[event->type], event->value);
+      } else if (event->type == EVENT_WAIT) {
+        asked[event->thread] = event->nanos;
+      } else if (event->type == EVENT_ENTER) {
+        if (asked[event->thread] != 0) {
+          latencyAdd(&waits[event->group], event->nanos - asked[event->thread]);
+        } else {
+          unmatched++; /* its wait was dropped */
+        }
+        asked[event->thread] = 0;
+        latencyAdd(&occupancy[event->group], event->value);
+      }
+    }
+  }
+  fclose(file);
+
+  if (stats) {
+    printf("%ld events, %ld entries without their wait\n", total, unmatched);
+    for (int g = 0; g < groups; g++) {
+      printf("  group %d\n", g);
+      latencyPrint(&waits[g], "    wait", 1e3, " us");
+      latencyPrint(&occupancy[g], "    occupancy", 1, "");
+    }
+  }
+  free(events);
+  free(asked);
+  free(waits);
+  free(occupancy);
+  return 0;
+}
@@ -0,0 +1,88 @@
+/* asynchronous binary event log
+
+   usage: gcc -O2 -c eventLog.c, then link eventLog.o with the program and -lpthread
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "eventLog.h"
+
+/* Writes what ring holds now, returns the events written */
+static long drain(struct EventLog *log, struct EventRing *ring) {
+  unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  long count = head - tail;
+  while (tail != head) { /* at most two pieces, before and after the wrap */
+    unsigned long start = tail & (LOGRING - 1), length = LOGRING - start < head - tail ? LOGRING - start : head - tail;
+    fwrite(&ring->events[start], sizeof(struct LogEvent), length, log->file);
+    tail += length;
+  }
+  atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  return count;
+}
+
+static void *logWriter(void *arg) {
+  struct EventLog *log = arg;
+  while (true) {
+    bool stopping = atomic_load(&log->stop); /* read first, so the drain below sees every event logged before stop */
+    long drained = 0;
+    int rings = atomic_load(&log->numRings);
+    for (int r = 0; r < rings; r++) {
+      drained += drain(log, log->rings[r]);
+    }
+    log->written += drained;
+    if (stopping) break;
+    if (drained == 0) {
+      struct timespec interval = { 0, LOGINTERVAL };
+      nanosleep(&interval, NULL);
+    }
+  }
+  return NULL;
+}
+
+bool eventLogOpen(struct EventLog *log, const char *path) {
+  struct LogHeader header = { LOGMAGIC, LOGVERSION, sizeof(struct LogEvent) };
+  memset(log, 0, sizeof(*log));
+  pthread_mutex_init(&log->registerLock, NULL);
+  log->file = fopen(path, "wb");
+  if (log->file == NULL) return false;
+  fwrite(&header, sizeof(header), 1, log->file);
+  if (pthread_create(&log->writer, NULL, logWriter, log) != 0) {
+    fclose(log->file);
+    return false;
+  }
+  return true;
+}
+
+struct EventRing *eventLogRing(struct EventLog *log) {
+  struct EventRing *ring = aligned_alloc(64, sizeof(struct EventRing));
+  if (ring == NULL) return NULL;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->dropped = 0;
+  pthread_mutex_lock(&log->registerLock);
+  int index = atomic_load(&log->numRings);
+  if (index < MAXLOGRINGS) {
+    ring->thread = index;
+    log->rings[index] = ring;
+    atomic_store(&log->numRings, index + 1); /* only now may the writer read the slot */
+  }
+  pthread_mutex_unlock(&log->registerLock);
+  if (index >= MAXLOGRINGS) {
+    free(ring);
+    return NULL;
+  }
+  return ring;
+}
+
+long eventLogClose(struct EventLog *log) {
+  long dropped = 0;
+  atomic_store(&log->stop, true);
+  pthread_join(log->writer, NULL);
+  fclose(log->file);
+  for (int r = 0; r < atomic_load(&log->numRings); r++) {
+    dropped += log->rings[r]->dropped;
+    free(log->rings[r]);
+  }
+  pthread_mutex_destroy(&log->registerLock);
+  return dropped;
+}
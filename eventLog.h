@@ -0,0 +1,93 @@
+/* asynchronous binary event log
+
+   features: every thread appends fixed size events (type, group, value, thread, monotonic nanoseconds) to a ring
+             of its own, one producer and one consumer, so logging is a clock read and a few stores and never takes
+             a lock or blocks. A writer thread drains all rings every LOGINTERVAL into a buffered file. A full ring
+             drops the event and counts it, the logged thread is never slowed down by the disk.
+             The file is a LogHeader followed by the events of each drain, ordered per thread and interleaved
+             between threads. eventLog-decode.c prints it and rebuilds the histograms from it.
+
+   usage: compile eventLog.c together with the program and link with -lpthread
+*/
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOGRING 8192          /* events per thread ring, a power of two */
+#define MAXLOGRINGS 4096      /* most threads of one log */
+#define LOGINTERVAL 1000000   /* nanoseconds the writer sleeps when the rings are empty */
+#define LOGMAGIC "EVENTLOG"
+#define LOGVERSION 1
+
+enum LogEventType { EVENT_WAIT, EVENT_ENTER, EVENT_LEAVE };
+
+/* value is the occupancy of the group for EVENT_ENTER and EVENT_LEAVE */
+struct LogEvent {
+  uint64_t nanos;
+  uint32_t thread;
+  uint16_t type;
+  uint16_t group;
+  int32_t value;
+  uint32_t unused;
+};
+
+struct LogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t eventSize;
+};
+
+/* The ring of one thread */
+struct EventRing {
+  _Alignas(64) atomic_ulong head;  /* written by the thread */
+  _Alignas(64) atomic_ulong tail;  /* written by the writer */
+  long dropped;
+  uint32_t thread;
+  struct LogEvent events[LOGRING];
+};
+
+struct EventLog {
+  FILE *file;
+  pthread_t writer;
+  atomic_bool stop;
+  pthread_mutex_t registerLock;    /* taken only to add a ring */
+  atomic_int numRings;
+  struct EventRing *rings[MAXLOGRINGS];
+  long written;
+};
+
+/* Opens path for writing and starts the writer, false if either fails */
+bool eventLogOpen(struct EventLog *log, const char *path);
+
+/* A ring for the calling thread, NULL once MAXLOGRINGS are taken */
+struct EventRing *eventLogRing(struct EventLog *log);
+
+/* Stops the writer after the rings are drained and closes the file, returns the events dropped. Every thread
+   logging must be done */
+long eventLogClose(struct EventLog *log);
+
+static inline uint64_t logNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/* Appends an event, safe for the owner thread of the ring only. A NULL ring logs nothing */
+static inline void logEvent(struct EventRing *ring, enum LogEventType type, int group, int value, uint64_t nanos) {
+  if (ring == NULL) return;
+  unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOGRING) {
+    ring->dropped++;
+    return;
+  }
+  ring->events[head & (LOGRING - 1)] = (struct LogEvent) { nanos, ring->thread, (uint16_t) type, (uint16_t) group, value, 0 };
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,315 @@
+/* external sort of binary int files larger than memory
+
+   The merge uses a tree of losers (Knuth, TAOCP vol. 3, 5.4.1): every internal node keeps the run that lost the
+   match played there, so replacing the winner only replays the matches on its own path to the root.
+
+   usage: gcc -O2 -c externalSort.c, then link externalSort.o with parallelSort.o, introsort.o, taskPool.o and -lpthread
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "externalSort.h"
+#include "parallelSort.h"
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+static bool readFully(int fd, void *data, size_t bytes, off_t offset) {
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t n = pread(fd, (char *) data + done, bytes - done, offset + done);
+    if (n <= 0) return false;
+    done += n;
+  }
+  return true;
+}
+
+static bool writeFully(int fd, const void *data, size_t bytes, off_t offset) {
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t n = pwrite(fd, (const char *) data + done, bytes - done, offset + done);
+    if (n <= 0) return false;
+    done += n;
+  }
+  return true;
+}
+
+/* A write running on its own thread, the buffer must not be touched until finishWrite returns */
+struct AsyncWrite {
+  pthread_t thread;
+  bool busy;
+  bool ok;
+  int fd;
+  const void *data;
+  size_t bytes;
+  off_t offset;
+};
+
+static void *writer(void *arg) {
+  struct AsyncWrite *write = arg;
+  write->ok = writeFully(write->fd, write->data, write->bytes, write->offset);
+  return NULL;
+}
+
+/* Waits for the write in flight if any, returns false if it failed */
+static bool finishWrite(struct AsyncWrite *write) {
+  if (!write->busy) return true;
+  pthread_join(write->thread, NULL);
+  write->busy = false;
+  return write->ok;
+}
+
+/* Starts writing bytes of data at offset, writes synchronously if no thread can be created */
+static bool startWrite(struct AsyncWrite *write, int fd, const void *data, size_t bytes, off_t offset) {
+  if (!finishWrite(write)) return false;
+  write->fd = fd;
+  write->data = data;
+  write->bytes = bytes;
+  write->offset = offset;
+  if (pthread_create(&write->thread, NULL, writer, write) == 0) {
+    write->busy = true;
+    return true;
+  }
+  writer(write);
+  return write->ok;
+}
+
+/* Sorts the input in runs of runInts keys into fd, the next run is read and sorted while the last one is written */
+static bool writeRuns(int input, int fd, long long total, long long runInts, int threads, struct ExternalSortStats *stats) {
+  struct AsyncWrite write = { .busy = false };
+  int *buffers[2];
+  bool ok = true;
+  buffers[0] = malloc(runInts * sizeof(int));
+  buffers[1] = stats->runs > 1 ? malloc(runInts * sizeof(int)) : NULL;
+  if (buffers[0] == NULL || (stats->runs > 1 && buffers[1] == NULL)) {
+    printf("Could not allocate two runs of %lld keys\n", runInts);
+    free(buffers[0]);
+    free(buffers[1]);
+    return false;
+  }
+  for (int r = 0; ok && r < stats->runs; r++) {
+    int *keys = buffers[r % 2];
+    long long first = r * runInts, count = total - first < runInts ? total - first : runInts;
+    if (!readFully(input, keys, count * sizeof(int), first * sizeof(int))) {
+      printf("Could not read run %d of the input\n", r);
+      ok = false;
+      break;
+    }
+    double start = seconds();
+    ok = parallelSortInts(keys, count, threads);
+    stats->sortSeconds += seconds() - start;
+    if (!ok) printf("Could not allocate the sorting threads\n");
+    else if (!startWrite(&write, fd, keys, count * sizeof(int), first * sizeof(int))) { /* also waits for run r - 1 */
+      printf("Could not write the runs\n");
+      ok = false;
+    }
+  }
+  if (!finishWrite(&write) && ok) {
+    printf("Could not write the runs\n");
+    ok = false;
+  }
+  free(buffers[0]);
+  free(buffers[1]);
+  return ok;
+}
+
+/* Window of one run during the merge */
+struct MergeRun {
+  int *keys;
+  size_t count;       /* keys in the window */
+  size_t position;    /* next key to take, the run is exhausted when it reaches count */
+  long long next;     /* first key of the run not read yet */
+  long long end;      /* end of the run */
+};
+
+struct Merge {
+  struct MergeRun *runs;
+  int *tree;          /* tree[0] is the winner, tree[1..k - 1] the losers of the internal nodes, leaves are k..2k - 1 */
+  int k;
+  int fd;
+  size_t capacity;    /* keys per window */
+};
+
+/* Reads the next window of run r and asks the kernel to start reading the one after it */
+static bool refill(struct Merge *merge, int r) {
+  struct MergeRun *run = &merge->runs[r];
+  long long left = run->end - run->next;
+  run->count = left < (long long) merge->capacity ? (size_t) left : merge->capacity;
+  run->position = 0;
+  if (!readFully(merge->fd, run->keys, run->count * sizeof(int), run->next * sizeof(int))) return false;
+  run->next += run->count;
+  left -= run->count;
+#ifdef POSIX_FADV_WILLNEED
+  if (left > 0) {
+    posix_fadvise(merge->fd, run->next * sizeof(int), (left < (long long) merge->capacity ? (size_t) left : merge->capacity) * sizeof(int),
+                  POSIX_FADV_WILLNEED);
+  }
+#endif
+  return true;
+}
+
+/* True if run a goes before run b, exhausted runs lose to everything and ties go to the lower run */
+static inline bool beats(const struct Merge *merge, int a, int b) {
+  const struct MergeRun *x = &merge->runs[a], *y = &merge->runs[b];
+  if (x->position == x->count) return false;
+  if (y->position == y->count) return true;
+  int keyA = x->keys[x->position], keyB = y->keys[y->position];
+  return keyA < keyB || (keyA == keyB && a < b);
+}
+
+/* Plays the matches below node, stores the losers and returns the winner */
+static int buildTree(struct Merge *merge, int node) {
+  if (node >= merge->k) return node - merge->k;
+  int left = buildTree(merge, 2 * node), right = buildTree(merge, 2 * node + 1);
+  if (beats(merge, left, right)) {
+    merge->tree[node] = right;
+    return left;
+  }
+  merge->tree[node] = left;
+  return right;
+}
+
+/* Run r has a new head, replays its path to the root */
+static inline void replay(struct Merge *merge, int r) {
+  for (int node = (r + merge->k) / 2; node > 0; node /= 2) {
+    if (beats(merge, merge->tree[node], r)) {
+      int loser = r;
+      r = merge->tree[node];
+      merge->tree[node] = loser;
+    }
+  }
+  merge->tree[0] = r;
+}
+
+/* Merges the runs of fd into output through two output buffers of the window size, one filled while the other is written */
+static bool mergeRuns(int fd, int output, long long total, long long runInts, long long memoryBytes, struct ExternalSortStats *stats) {
+  struct Merge merge;
+  struct AsyncWrite write = { .busy = false };
+  int *outputs[2];
+  size_t filled = 0;
+  long long written = 0;
+  int current = 0;
+  bool ok = true;
+  merge.k = stats->runs;
+  merge.fd = fd;
+  merge.capacity = memoryBytes / (merge.k + 2) / sizeof(int);
+  if (merge.capacity < MINMERGEBUFFER / sizeof(int)) merge.capacity = MINMERGEBUFFER / sizeof(int);
+  stats->mergeBuffer = merge.capacity * sizeof(int);
+  merge.runs = calloc(merge.k, sizeof(struct MergeRun));
+  merge.tree = malloc(merge.k * sizeof(int));
+  outputs[0] = malloc(merge.capacity * sizeof(int));
+  outputs[1] = malloc(merge.capacity * sizeof(int));
+  ok = merge.runs != NULL && merge.tree != NULL && outputs[0] != NULL && outputs[1] != NULL;
+  for (int r = 0; ok && r < merge.k; r++) {
+    merge.runs[r].keys = malloc(merge.capacity * sizeof(int));
+    merge.runs[r].next = r * runInts;
+    merge.runs[r].end = (r + 1) * runInts < total ? (r + 1) * runInts : total;
+    ok = merge.runs[r].keys != NULL;
+  }
+  if (!ok) printf("Could not allocate %d merge buffers of %ld bytes\n", merge.k + 2, stats->mergeBuffer);
+
+  for (int r = 0; ok && r < merge.k; r++) ok = refill(&merge, r);
+  if (ok) merge.tree[0] = buildTree(&merge, 1);
+  for (long long done = 0; ok && done < total; done++) {
+    int r = merge.tree[0];
+    struct MergeRun *run = &merge.runs[r];
+    outputs[current][filled++] = run->keys[run->position++];
+    if (run->position == run->count && run->next < run->end && !refill(&merge, r)) {
+      printf("Could not read run %d\n", r);
+      ok = false;
+    }
+    if (ok && (filled == merge.capacity || done == total - 1)) {
+      if (!startWrite(&write, output, outputs[current], filled * sizeof(int), written * sizeof(int))) {
+        printf("Could not write the output\n");
+        ok = false;
+      }
+      written += filled;
+      filled = 0;
+      current = 1 - current;
+    }
+    replay(&merge, r);
+  }
+  if (!finishWrite(&write) && ok) {
+    printf("Could not write the output\n");
+    ok = false;
+  }
+
+  for (int r = 0; merge.runs != NULL && r < merge.k; r++) free(merge.runs[r].keys);
+  free(merge.runs);
+  free(merge.tree);
+  free(outputs[0]);
+  free(outputs[1]);
+  return ok;
+}
+
+bool externalSort(const char *input, const char *output, long long memoryBytes, int threads, struct ExternalSortStats *stats) {
+  struct stat info;
+  long long total, runInts = memoryBytes / 2 / sizeof(int);
+  int in, out, runs = -1;
+  char *runPath = NULL;
+  bool ok;
+  memset(stats, 0, sizeof(*stats));
+  if (runInts < 1) runInts = 1;
+
+  in = open(input, O_RDONLY);
+  if (in < 0) {
+    perror(input);
+    return false;
+  }
+  if (fstat(in, &info) != 0 || info.st_size % sizeof(int) != 0) {
+    printf("%s does not hold a whole number of ints\n", input);
+    close(in);
+    return false;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    perror(output);
+    close(in);
+    return false;
+  }
+  stats->bytes = info.st_size;
+  total = info.st_size / sizeof(int);
+  stats->runs = (total + runInts - 1) / runInts;
+
+  double start = seconds();
+  if (stats->runs <= 1) { /* fits in memory, the single run is the output */
+    ok = writeRuns(in, out, total, runInts, threads, stats);
+    stats->runSeconds = seconds() - start;
+  } else {
+    runPath = malloc(strlen(output) + sizeof(".runs"));
+    if (runPath != NULL) {
+      sprintf(runPath, "%s.runs", output);
+      runs = open(runPath, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    }
+    if (runs < 0) {
+      perror(runPath != NULL ? runPath : output);
+      ok = false;
+    } else {
+      ok = writeRuns(in, runs, total, runInts, threads, stats);
+      stats->runSeconds = seconds() - start;
+      start = seconds();
+      ok = ok && mergeRuns(runs, out, total, runInts, memoryBytes, stats);
+      stats->mergeSeconds = seconds() - start;
+      close(runs);
+      unlink(runPath);
+    }
+    free(runPath);
+  }
+  close(in);
+  if (close(out) != 0) ok = false;
+  return ok;
+}
@@ -0,0 +1,37 @@
+/* external sort of binary int files larger than memory
+
+   format: the input is a plain file of native 32 bit ints, the output has the same keys in ascending order.
+
+   features: the run phase reads memoryBytes / 2 of keys at a time, sorts them with all threads (parallelSort.c) and
+             hands the sorted run to a writer thread, so the next run is read and sorted while the last one is written.
+             The runs go to one temporary file next to the output, which is removed at the end.
+             The merge phase gives every run a large read buffer refilled with sequential preads, after each refill the
+             kernel is told the next block will be needed (POSIX_FADV_WILLNEED) so it is read ahead while the merge runs.
+             A loser tree picks the smallest head in log2 runs comparisons, the output is double buffered and written by
+             a writer thread as well. A file that fits in one run is sorted and written without a merge.
+             Both phases report their time, so bytes/sec can be printed per phase.
+
+   usage: compile externalSort.c, parallelSort.c, introsort.c and taskPool.c together with the program, link with -lpthread
+*/
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <stdbool.h>
+
+#define MINMERGEBUFFER (1 << 20) /* smallest read buffer of a run in bytes, a merge of many runs may exceed the budget by this */
+
+/* What the sort did and how long each phase took */
+struct ExternalSortStats {
+  long long bytes;      /* size of the input */
+  int runs;             /* sorted runs written by the run phase */
+  double runSeconds;    /* reading, sorting and writing the runs */
+  double sortSeconds;   /* part of runSeconds spent sorting, overlapped with the writes */
+  double mergeSeconds;  /* merging the runs into the output */
+  long mergeBuffer;     /* bytes of read buffer per run during the merge */
+};
+
+/* Sorts the ints of input into output using about memoryBytes of buffers and threads threads for the in-memory sorts.
+   Prints the reason and returns false if a file cannot be read or written or memory is short */
+bool externalSort(const char *input, const char *output, long long memoryBytes, int threads, struct ExternalSortStats *stats);
+
+#endif
@@ -0,0 +1,235 @@
+/* parallel, deterministic generation of test data
+
+   usage: gcc -O2 -c generator.c, then link generator.o with the program and -lpthread -lm
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "generator.h"
+
+/* xoshiro256** by Blackman and Vigna */
+static inline uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t next(uint64_t s[4]) {
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+/* Advances the state by 2^128 steps, equivalent to that many calls to next */
+static void jump(uint64_t s[4]) {
+  static const uint64_t JUMP[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+  uint64_t t[4] = { 0, 0, 0, 0 };
+  for (int i = 0; i < 4; i++) {
+    for (int b = 0; b < 64; b++) {
+      if (JUMP[i] & ((uint64_t) 1 << b)) {
+        t[0] ^= s[0];
+        t[1] ^= s[1];
+        t[2] ^= s[2];
+        t[3] ^= s[3];
+      }
+      next(s);
+    }
+  }
+  memcpy(s, t, sizeof(t));
+}
+
+/* splitmix64, spreads a small seed over the whole xoshiro state */
+static uint64_t splitmix(uint64_t *x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+/* Uniform integer in [0, range) from the high bits, avoids a division per element */
+static inline int below(uint64_t s[4], int range) {
+  return (int) (((next(s) >> 32) * (uint64_t) range) >> 32);
+}
+
+/* Uniform double in [0, 1) */
+static inline double uniform01(uint64_t s[4]) {
+  return (next(s) >> 11) * 0x1.0p-53;
+}
+
+/* Rejection-inversion Zipf sampling (Hormann and Derflinger), constant expected time for any range */
+static double helper1(double x) { /* log1p(x) / x with the limit at 0 */
+  return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+static double helper2(double x) { /* expm1(x) / x with the limit at 0 */
+  return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+}
+
+static double hIntegral(double x, double s) {
+  double logX = log(x);
+  return helper2((1 - s) * logX) * logX;
+}
+
+static double h(double x, double s) {
+  return exp(-s * log(x));
+}
+
+static double hIntegralInverse(double x, double s) {
+  double t = x * (1 - s);
+  if (t < -1) t = -1; /* Rounding can push t below the domain of log1p */
+  return exp(helper1(t) * x);
+}
+
+static int zipf(uint64_t state[4], const struct Generator *generator) {
+  double s = generator->zipfExponent;
+  while (true) {
+    double u = generator->hIntegralElements + uniform01(state) * (generator->hIntegralX1 - generator->hIntegralElements);
+    double x = hIntegralInverse(u, s);
+    long k = (long) (x + 0.5);
+    if (k < 1) k = 1;
+    else if (k > generator->range) k = generator->range;
+    if (k - x <= generator->sCoefficient || u >= hIntegral(k + 0.5, s) - h(k, s)) {
+      return (int) (k - 1);
+    }
+  }
+}
+
+void generatorInit(struct Generator *generator, enum Distribution distribution, int range, uint64_t seed) {
+  double s = 1.0;
+  generator->distribution = distribution;
+  generator->range = range > 0 ? range : 1;
+  generator->seed = seed;
+  generator->zipfExponent = s;
+  generator->hIntegralX1 = hIntegral(1.5, s) - 1;
+  generator->hIntegralElements = hIntegral(generator->range + 0.5, s);
+  generator->sCoefficient = 2 - hIntegralInverse(hIntegral(2.5, s) - h(2, s), s);
+}
+
+static const char *distributionNames[] = { "uniform", "sorted", "reverse", "few", "zipf" };
+
+bool parseDistribution(const char *text, enum Distribution *distribution) {
+  for (int d = 0; d < (int) (sizeof(distributionNames) / sizeof(distributionNames[0])); d++) {
+    if (strcmp(text, distributionNames[d]) == 0) {
+      *distribution = (enum Distribution) d;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *distributionName(enum Distribution distribution) {
+  return distributionNames[distribution];
+}
+
+long generatorBlocks(long count) {
+  return (count + GENBLOCK - 1) / GENBLOCK;
+}
+
+void generateBlocks(const struct Generator *generator, int *data, long rows, long cols, long stride, long firstBlock, long endBlock) {
+  generateBlocksTyped(generator, data, ELEMENT_INT32, rows, cols, stride, firstBlock, endBlock);
+}
+
+void generateBlocksTyped(const struct Generator *generator, void *data, enum ElementType type, long rows, long cols, long stride,
+                         long firstBlock, long endBlock) {
+  long count = rows * cols;
+  long first = firstBlock * GENBLOCK;
+  long end = endBlock * GENBLOCK < count ? endBlock * GENBLOCK : count;
+  uint64_t base[4], state[4] = { 0, 0, 0, 0 }, x = generator->seed;
+  long row, col;
+  if (first >= end) return;
+
+  for (int i = 0; i < 4; i++) {
+    base[i] = splitmix(&x);
+  }
+  for (long b = 0; b < firstBlock; b++) { /* Block b starts b jumps after the seed */
+    jump(base);
+  }
+
+  row = first / cols;
+  col = first % cols;
+  for (long k = first; k < end; k++) {
+    if (k % GENBLOCK == 0) { /* Entering a new block, its generator is the base state which then jumps ahead for the next block */
+      memcpy(state, base, sizeof(state));
+      jump(base);
+    }
+    int value;
+    switch (generator->distribution) {
+    case DIST_SORTED:
+      value = (int) (k * generator->range / count);
+      break;
+    case DIST_REVERSE:
+      value = (int) ((count - 1 - k) * generator->range / count);
+      break;
+    case DIST_FEW:
+      value = below(state, FEWUNIQUE) * (generator->range / FEWUNIQUE > 0 ? generator->range / FEWUNIQUE : 1);
+      break;
+    case DIST_ZIPF:
+      value = zipf(state, generator);
+      break;
+    default:
+      value = below(state, generator->range);
+      break;
+    }
+    long position = row * stride + col;
+    switch (type) { /* Same type for the whole call so the branch is always predicted */
+    case ELEMENT_INT8: ((int8_t *) data)[position] = value; break;
+    case ELEMENT_UINT16: ((uint16_t *) data)[position] = value; break;
+    case ELEMENT_INT64: ((int64_t *) data)[position] = value; break;
+    case ELEMENT_FLOAT: ((float *) data)[position] = value; break;
+    case ELEMENT_DOUBLE: ((double *) data)[position] = value; break;
+    default: ((int32_t *) data)[position] = value; break;
+    }
+    if (++col == cols) {
+      col = 0;
+      row++;
+    }
+  }
+}
+
+/* Arguments for one generating thread */
+struct GeneratorTask {
+  const struct Generator *generator;
+  void *data;
+  enum ElementType type;
+  long rows, cols, stride;
+  long firstBlock, endBlock;
+};
+
+static void *generatorWorker(void *arg) {
+  struct GeneratorTask *task = arg;
+  generateBlocksTyped(task->generator, task->data, task->type, task->rows, task->cols, task->stride, task->firstBlock, task->endBlock);
+  return NULL;
+}
+
+static void generateParallel(const struct Generator *generator, void *data, enum ElementType type, long rows, long cols, long stride, int numThreads) {
+  long blocks = generatorBlocks(rows * cols);
+  if (numThreads < 1) numThreads = 1;
+  if (numThreads > blocks) numThreads = blocks > 0 ? blocks : 1;
+  pthread_t threads[numThreads];
+  struct GeneratorTask tasks[numThreads];
+  for (int t = 0; t < numThreads; t++) { /* Contiguous ranges of blocks, the same split as a static schedule */
+    tasks[t] = (struct GeneratorTask) { generator, data, type, rows, cols, stride, blocks * t / numThreads, blocks * (t + 1) / numThreads };
+    if (t > 0) pthread_create(&threads[t], NULL, generatorWorker, &tasks[t]);
+  }
+  generatorWorker(&tasks[0]); /* The calling thread takes the first range */
+  for (int t = 1; t < numThreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+}
+
+void generateInts(const struct Generator *generator, int *data, long count, int numThreads) {
+  generateParallel(generator, data, ELEMENT_INT32, 1, count, count, numThreads);
+}
+
+void generateMatrix(const struct Generator *generator, struct Matrix *matrix, int numThreads) {
+  generateParallel(generator, matrix->data, ELEMENT_INT32, matrix->rows, matrix->cols, matrix->stride, numThreads);
+}
+
+void generateMatrixTyped(const struct Generator *generator, struct Matrix *matrix, enum ElementType type, int numThreads) {
+  generateParallel(generator, matrix->data, type, matrix->rows, matrix->cols, matrix->stride, numThreads);
+}
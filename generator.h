@@ -0,0 +1,66 @@
+/* parallel, deterministic generation of test data
+
+   features: xoshiro256** generators, one per block of GENBLOCK elements. Block b starts from the seed jumped b times
+             (2^128 steps per jump), so the data only depends on the seed and never on the number of threads.
+             Each thread fills a contiguous range of blocks so the pages are first touched by the thread that owns them.
+
+   distributions:
+     uniform - independent values in [0, range)
+     sorted  - non-decreasing values spread evenly over [0, range)
+     reverse - the sorted sequence backwards
+     few     - uniform over only FEWUNIQUE distinct values
+     zipf    - value k-1 with probability proportional to 1/k^s, so small values are very common
+
+   usage: compile generator.c together with the program, link with -lpthread and -lm
+*/
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "matrix.h"
+#include "typedReduce.h"
+
+#define GENBLOCK 65536 /* elements per generator block */
+#define FEWUNIQUE 16   /* number of distinct values in the few distribution */
+
+enum Distribution { DIST_UNIFORM, DIST_SORTED, DIST_REVERSE, DIST_FEW, DIST_ZIPF };
+
+struct Generator {
+  enum Distribution distribution;
+  int range;          /* values are in [0, range) */
+  uint64_t seed;
+  double zipfExponent;
+  /* precomputed constants for the rejection-inversion Zipf sampler, filled in by generatorInit */
+  double hIntegralX1, hIntegralElements, sCoefficient;
+};
+
+/* Sets up a generator, the seed 0 is valid */
+void generatorInit(struct Generator *generator, enum Distribution distribution, int range, uint64_t seed);
+
+/* Reads a distribution name, returns false if it is unknown */
+bool parseDistribution(const char *text, enum Distribution *distribution);
+
+const char *distributionName(enum Distribution distribution);
+
+/* Number of blocks needed for count elements */
+long generatorBlocks(long count);
+
+/* Fills blocks [firstBlock, endBlock) of a rows x cols layout with the given row stride, the building block for the
+   functions below and for OpenMP programs that want each thread to generate its own part */
+void generateBlocks(const struct Generator *generator, int *data, long rows, long cols, long stride, long firstBlock, long endBlock);
+
+/* Same as generateBlocks for elements of any type, the values are converted to the type when stored */
+void generateBlocksTyped(const struct Generator *generator, void *data, enum ElementType type, long rows, long cols, long stride,
+                         long firstBlock, long endBlock);
+
+/* Fills count ints using numThreads pthreads */
+void generateInts(const struct Generator *generator, int *data, long count, int numThreads);
+
+/* Fills every row of matrix using numThreads pthreads, the values are the same as generateInts over rows * cols */
+void generateMatrix(const struct Generator *generator, struct Matrix *matrix, int numThreads);
+
+/* Same as generateMatrix for a matrix allocated with matrixAllocTyped for the type */
+void generateMatrixTyped(const struct Generator *generator, struct Matrix *matrix, enum ElementType type, int numThreads);
+
+#endif
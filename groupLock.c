@@ -0,0 +1,193 @@
+/* group mutual exclusion with phase fair batches
+
+   usage: gcc -O2 -c groupLock.c, then link groupLock.o with the program
+*/
+#include <string.h>
+#include <unistd.h>
+#include "groupLock.h"
+#include "trace.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static void futexWait(atomic_uint *word, unsigned int value) {
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futexWake(atomic_uint *word, int count) {
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+#else
+#include <pthread.h>
+
+/* Without futexes every word shares one condition variable. A waker changes the word before it takes futexLock,
+   so a waiter that saw the old value under futexLock is already waiting when the broadcast comes. Every caller
+   rechecks its word, so waking all sleepers instead of count only costs time */
+static pthread_mutex_t futexLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t futexChanged = PTHREAD_COND_INITIALIZER;
+
+static void futexWait(atomic_uint *word, unsigned int value) {
+  pthread_mutex_lock(&futexLock);
+  while (atomic_load(word) == value) pthread_cond_wait(&futexChanged, &futexLock);
+  pthread_mutex_unlock(&futexLock);
+}
+
+static void futexWake(atomic_uint *word, int count) {
+  (void) word;
+  (void) count;
+  pthread_mutex_lock(&futexLock);
+  pthread_cond_broadcast(&futexChanged);
+  pthread_mutex_unlock(&futexLock);
+}
+#endif
+
+/* Futex mutex of Drepper, "Futexes Are Tricky", spinning a little first since the sections are short */
+static void stateLock(struct GroupLock *lock) {
+  unsigned int state = 0;
+  for (int k = 0; k < GROUPSPINS; k++) {
+    state = 0;
+    if (atomic_compare_exchange_weak_explicit(&lock->mutex, &state, 1, memory_order_acquire, memory_order_relaxed)) return;
+    if (state == 2) break; /* others already sleep, join them */
+  }
+  if (state != 2) state = atomic_exchange_explicit(&lock->mutex, 2, memory_order_acquire);
+  while (state != 0) {
+    futexWait(&lock->mutex, 2);
+    state = atomic_exchange_explicit(&lock->mutex, 2, memory_order_acquire);
+  }
+}
+
+static void stateUnlock(struct GroupLock *lock) {
+  if (atomic_exchange_explicit(&lock->mutex, 0, memory_order_release) == 2) futexWake(&lock->mutex, 1);
+}
+
+/* True if some group other than group has sleepers */
+static bool othersWaiting(const struct GroupLock *lock, int group) {
+  for (int g = 0; g < lock->groups; g++) {
+    if (g != group && lock->waiting[g] > 0) return true;
+  }
+  return false;
+}
+
+/* How many more the phase of the current group may admit */
+static int phaseRoom(const struct GroupLock *lock) {
+  int room = lock->waiting[lock->current] + 1; /* more than anyone can ask for */
+  if (lock->capacity > 0 && lock->capacity - lock->inside < room) room = lock->capacity - lock->inside;
+  int limit = lock->opened + lock->batch - lock->admitted; /* batch applies to those that came after the opening */
+  if (othersWaiting(lock, lock->current) && limit < room) room = limit;
+  return room;
+}
+
+/* Hands as many entries as the phase has room for to the waiters of the current group, called with the state
+   locked. Sleepers are woken, the queued waiters admitted are returned for the caller to notify after unlocking */
+static struct GroupWaiter *grant(struct GroupLock *lock) {
+  int group = lock->current, count = phaseRoom(lock);
+  struct GroupWaiter *admitted = lock->queueHead[group], *last = NULL;
+  if (count > lock->waiting[group]) count = lock->waiting[group];
+  if (count <= 0) return NULL;
+  lock->waiting[group] -= count;
+  lock->inside += count;
+  lock->admitted += count;
+  while (count > 0 && lock->queueHead[group] != NULL) {
+    last = lock->queueHead[group];
+    lock->queueHead[group] = last->next;
+    count--;
+  }
+  if (last != NULL) last->next = NULL; else admitted = NULL;
+  if (count > 0) {
+    lock->granted[group] += count;
+    atomic_fetch_add_explicit(&lock->gate[group], 1, memory_order_release);
+    futexWake(&lock->gate[group], count);
+  }
+  return admitted;
+}
+
+/* Calls granted for every waiter of a list returned by grant */
+static void notify(struct GroupWaiter *waiter) {
+  while (waiter != NULL) {
+    struct GroupWaiter *next = waiter->next; /* granted may reuse the waiter */
+    waiter->granted(waiter);
+    waiter = next;
+  }
+}
+
+bool groupLockInit(struct GroupLock *lock, int groups, int capacity, int batch) {
+  if (groups < 1 || groups > MAXGROUPS) return false;
+  memset(lock, 0, sizeof(*lock));
+  lock->groups = groups;
+  lock->capacity = capacity > 0 ? capacity : 0;
+  lock->batch = batch > 0 ? batch : GROUPBATCH;
+  lock->current = -1;
+  return true;
+}
+
+/* Enters at once if the phase allows it, called with the state locked */
+static bool enterNow(struct GroupLock *lock, int group) {
+  lock->entries[group]++;
+  if (lock->current < 0) { /* empty, a new phase starts with this one */
+    lock->current = group;
+    lock->admitted = lock->opened = 0;
+    lock->phases++;
+  }
+  if (lock->current == group && lock->waiting[group] == 0 && phaseRoom(lock) > 0) {
+    lock->inside++;
+    lock->admitted++;
+    return true;
+  }
+  lock->waiting[group]++; /* leaving the entry to whoever grants it */
+  return false;
+}
+
+void groupEnter(struct GroupLock *lock, int group) {
+  stateLock(lock);
+  if (enterNow(lock, group)) {
+    stateUnlock(lock);
+    return;
+  }
+  while (lock->granted[group] == 0) {
+    unsigned int gate = atomic_load_explicit(&lock->gate[group], memory_order_acquire);
+    stateUnlock(lock);
+    futexWait(&lock->gate[group], gate); /* returns at once if a grant bumped the gate in between */
+    stateLock(lock);
+  }
+  lock->granted[group]--;
+  stateUnlock(lock);
+}
+
+bool groupEnterAsync(struct GroupLock *lock, int group, struct GroupWaiter *waiter) {
+  stateLock(lock);
+  bool inside = enterNow(lock, group);
+  if (!inside) {
+    waiter->next = NULL;
+    if (lock->queueHead[group] == NULL) lock->queueHead[group] = waiter; else lock->queueTail[group]->next = waiter;
+    lock->queueTail[group] = waiter;
+  }
+  stateUnlock(lock);
+  return inside;
+}
+
+void groupLeave(struct GroupLock *lock, int group) {
+  struct GroupWaiter *admitted = NULL;
+  stateLock(lock);
+  lock->inside--;
+  if (lock->inside > 0) {
+    admitted = grant(lock); /* a place freed under the capacity */
+  } else { /* the last one out opens the next phase for the next waiting group in round robin order */
+    lock->current = -1;
+    for (int k = 1; k <= lock->groups; k++) {
+      int next = (group + k) % lock->groups;
+      if (lock->waiting[next] > 0) {
+        lock->current = next;
+        lock->admitted = 0;
+        lock->opened = lock->waiting[next]; /* the opening grant is not limited by batch */
+        lock->phases++;
+        TRACE_MARK("phase", next);
+        admitted = grant(lock);
+        lock->opened = lock->admitted; /* those it left out for the capacity count against batch like later arrivals */
+        break;
+      }
+    }
+  }
+  stateUnlock(lock);
+  notify(admitted);
+}
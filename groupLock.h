@@ -0,0 +1,64 @@
+/* group mutual exclusion: any number of threads of one group may hold the lock together, never two groups at once
+
+   features: N groups (up to MAXGROUPS), phase fair: the lock passes from group to group in round robin order, and a
+             phase admits every waiter of its group at once as one batch (as many as the capacity allows). Members of
+             the group inside keep entering without waiting as long as no other group waits. Once one does, the phase
+             admits at most batch entries besides the ones it opened with and then closes, so a waiting group is
+             bypassed by at most the waiters queued before it plus (groups - 1) * batch entries.
+             capacity > 0 also limits how many may be inside at once (stalls), the rest of the group waits for a free place.
+             The state is guarded by a futex mutex held for a few instructions only. Waiters sleep on a futex word of
+             their group that is bumped when entries are granted to it, so a phase change wakes one group only.
+             groupEnterAsync never blocks: a waiter that cannot enter is queued and its granted function is called by
+             the groupLeave that admits it, so simulations can run many waiters on a few threads (bathroomSim.c).
+             Queued waiters of a group are admitted before its sleeping threads.
+             Elsewhere than Linux the futex calls fall back to a mutex and a condition variable shared by all words,
+             slower since every wake wakes every sleeper, but the protocol stays the same.
+
+   usage: compile groupLock.c together with the program, link with -lpthread
+*/
+#ifndef GROUPLOCK_H
+#define GROUPLOCK_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MAXGROUPS 16     /* most groups a lock has */
+#define GROUPBATCH 64    /* default entries a phase admits once another group waits */
+#define GROUPSPINS 100   /* rounds a thread spins on the state mutex before sleeping */
+
+/* A waiter of groupEnterAsync, usually the first member of a larger struct */
+struct GroupWaiter {
+  struct GroupWaiter *next;
+  void (*granted)(struct GroupWaiter *waiter); /* called once the waiter is inside, outside the lock's state mutex */
+};
+
+struct GroupLock {
+  atomic_uint mutex;                /* 0 free, 1 held, 2 held with sleepers */
+  int groups;
+  int capacity;                     /* most inside at once, 0 for no limit */
+  int batch;
+  int current;                      /* group inside or admitted, -1 when empty */
+  int inside;                       /* inside or granted entry */
+  int admitted;                     /* entries of the current phase */
+  int opened;                       /* entries of the grant that opened the phase, not counted against batch */
+  int waiting[MAXGROUPS];           /* sleeping on gate[group] or queued, without an entry */
+  struct GroupWaiter *queueHead[MAXGROUPS], *queueTail[MAXGROUPS]; /* waiters of groupEnterAsync in arrival order */
+  int granted[MAXGROUPS];           /* entries handed to sleepers that have not taken them yet */
+  atomic_uint gate[MAXGROUPS];      /* futex word per group, bumped whenever entries are granted to it */
+  long entries[MAXGROUPS];          /* statistics */
+  long phases;
+};
+
+/* Returns false if groups is not in [1, MAXGROUPS], batch < 1 takes GROUPBATCH */
+bool groupLockInit(struct GroupLock *lock, int groups, int capacity, int batch);
+
+/* Blocks until group may be inside */
+void groupEnter(struct GroupLock *lock, int group);
+
+/* Returns true if group is inside now, otherwise waiter->granted is called later by the thread admitting it */
+bool groupEnterAsync(struct GroupLock *lock, int group, struct GroupWaiter *waiter);
+
+/* Leaves and calls granted for the queued waiters this admits */
+void groupLeave(struct GroupLock *lock, int group);
+
+#endif
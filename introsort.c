@@ -0,0 +1,335 @@
+/* pivot choice, three way partition and the heapsort fallback shared by the quicksorts
+
+   usage: gcc -O2 -c introsort.c, then link introsort.o with the program
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include "introsort.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define INTROSORT_X86
+#include <immintrin.h>
+#endif
+
+static inline void swapInts(int *a, int *b) {
+  int t = *a;
+  *a = *b;
+  *b = t;
+}
+
+int introDepth(long n) {
+  int depth = 0;
+  while (n > 1) {
+    n >>= 1;
+    depth += 2;
+  }
+  return depth;
+}
+
+/* Index of the median of array[a], array[b] and array[c] */
+static long medianOf3(const int array[], long a, long b, long c) {
+  if (array[a] < array[b]) {
+    if (array[b] < array[c]) return b;
+    return array[a] < array[c] ? c : a;
+  }
+  if (array[a] < array[c]) return a;
+  return array[b] < array[c] ? c : b;
+}
+
+/* Pivot index as in choosePivot, *duplicates is set when two sampled elements are equal, a sign of many equal keys */
+static long samplePivot(const int array[], long low, long high, bool *duplicates) {
+  long n = high - low + 1, middle = low + n / 2;
+  if (n < NINTHERCUTOFF) {
+    *duplicates = array[low] == array[middle] || array[middle] == array[high] || array[low] == array[high];
+    return medianOf3(array, low, middle, high);
+  }
+  long step = n / 8;
+  long a = medianOf3(array, low, low + step, low + 2 * step);
+  long b = medianOf3(array, middle - step, middle, middle + step);
+  long c = medianOf3(array, high - 2 * step, high - step, high);
+  long pivot = medianOf3(array, a, b, c);
+  /* The medians are only a hint, comparing the pivot with its two nearest samples catches most runs of equal keys */
+  *duplicates = array[a] == array[b] || array[b] == array[c] || array[a] == array[c]
+                || array[pivot] == array[pivot == b ? b - step : b] || array[pivot] == array[pivot == b ? b + step : b];
+  return pivot;
+}
+
+long choosePivot(const int array[], long low, long high) {
+  bool duplicates;
+  return samplePivot(array, low, high, &duplicates);
+}
+
+/* Partitions array[low..high] with array[low] as the pivot into [low, m) < pivot and [m, high] >= pivot and returns m.
+   BlockQuicksort (Edelkamp and Weiss): the offsets of misplaced elements in a block from each end are recorded
+   without branches, then the recorded pairs are swapped, so a random comparison never costs a mispredicted branch */
+static long blockPartition(int array[], long low, long high) {
+  unsigned char offsetsLeft[PARTITIONBLOCK], offsetsRight[PARTITIONBLOCK];
+  int numLeft = 0, numRight = 0, startLeft = 0, startRight = 0;
+  int pivot = array[low];
+  long left = low + 1, right = high; /* everything before left is < pivot, everything after right is >= pivot */
+  while (right - left + 1 >= 2 * PARTITIONBLOCK) {
+    if (numLeft == 0) { /* elements >= pivot in the next left block belong on the right */
+      startLeft = 0;
+      for (int i = 0; i < PARTITIONBLOCK; i++) {
+        offsetsLeft[numLeft] = i;
+        numLeft += array[left + i] >= pivot;
+      }
+    }
+    if (numRight == 0) { /* elements < pivot in the next right block belong on the left */
+      startRight = 0;
+      for (int i = 0; i < PARTITIONBLOCK; i++) {
+        offsetsRight[numRight] = i;
+        numRight += array[right - i] < pivot;
+      }
+    }
+    int count = numLeft < numRight ? numLeft : numRight;
+    for (int i = 0; i < count; i++) {
+      swapInts(&array[left + offsetsLeft[startLeft + i]], &array[right - offsetsRight[startRight + i]]);
+    }
+    numLeft -= count;
+    numRight -= count;
+    startLeft += count;
+    startRight += count;
+    if (numLeft == 0) left += PARTITIONBLOCK;
+    if (numRight == 0) right -= PARTITIONBLOCK;
+  }
+  /* At most a few blocks are left, partially swapped blocks are still inside [left, right] so a plain scan finishes */
+  while (true) {
+    while (left <= right && array[left] < pivot) left++;
+    while (left <= right && array[right] >= pivot) right--;
+    if (left >= right) break;
+    swapInts(&array[left++], &array[right--]);
+  }
+  return left;
+}
+
+/* Bentley-McIlroy: a two way Hoare scan with array[low] as the pivot that parks the elements equal to the pivot
+   at both ends and swaps them to the middle at the end */
+static void fatPartition(int array[], long low, long high, long *lt, long *gt) {
+  int pivot = array[low];
+  long i = low, j = high + 1, p = low, q = high + 1;
+  while (true) {
+    while (array[++i] < pivot) if (i == high) break;
+    while (pivot < array[--j]) if (j == low) break;
+    if (i == j && array[i] == pivot) swapInts(&array[++p], &array[i]);
+    if (i >= j) break;
+    swapInts(&array[i], &array[j]);
+    if (array[i] == pivot) swapInts(&array[++p], &array[i]);
+    if (array[j] == pivot) swapInts(&array[--q], &array[j]);
+  }
+  i = j + 1;
+  for (long k = low; k <= p; k++) swapInts(&array[k], &array[j--]);
+  for (long k = high; k >= q; k--) swapInts(&array[k], &array[i++]);
+  *lt = j + 1;
+  *gt = i - 1;
+}
+
+void introPartition(int array[], long low, long high, long *lt, long *gt) {
+  bool duplicates;
+  swapInts(&array[low], &array[samplePivot(array, low, high, &duplicates)]);
+  if (duplicates) { /* equal keys are likely, gather them in the middle so they are done */
+    fatPartition(array, low, high, lt, gt);
+    return;
+  }
+  long middle = blockPartition(array, low, high) - 1;
+  swapInts(&array[low], &array[middle]);
+  *lt = *gt = middle;
+}
+
+/* Moves array[low + i] down the max-heap of n elements rooted at low until both children are smaller */
+static void siftDown(int array[], long low, long i, long n) {
+  int value = array[low + i];
+  long child;
+  while ((child = 2 * i + 1) < n) {
+    if (child + 1 < n && array[low + child + 1] > array[low + child]) child++;
+    if (array[low + child] <= value) break;
+    array[low + i] = array[low + child];
+    i = child;
+  }
+  array[low + i] = value;
+}
+
+void heapsortRange(int array[], long low, long high) {
+  long n = high - low + 1;
+  for (long i = n / 2 - 1; i >= 0; i--) {
+    siftDown(array, low, i, n);
+  }
+  for (long end = n - 1; end > 0; end--) {
+    swapInts(&array[low], &array[low + end]);
+    siftDown(array, low, 0, end);
+  }
+}
+
+/* Straight insertion sort of array[low..high], the leaf of the other kernels */
+static void insertionSort(int array[], long low, long high) {
+  for (long i = low + 1; i <= high; i++) {
+    int value = array[i];
+    long j = i - 1;
+    while (j >= low && array[j] > value) {
+      array[j + 1] = array[j];
+      j--;
+    }
+    array[j + 1] = value;
+  }
+}
+
+static bool alwaysSupported(void) {
+  return true;
+}
+
+#ifdef INTROSORT_X86
+/* One compare-exchange stage of a bitonic network on the 8 lanes of v: every lane is paired with partner,
+   the lanes set in takeMax keep the larger of the two */
+#define BITONICSTAGE(v, partner, takeMax) \
+  do { \
+    __m256i other = (partner); \
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, other), _mm256_max_epi32(v, other), takeMax); \
+  } while (0)
+
+/* Last three stages of the bitonic sort, sorts a bitonic sequence of 8 lanes ascending */
+__attribute__((target("avx2")))
+static inline __m256i bitonicMerge8(__m256i v) {
+  BITONICSTAGE(v, _mm256_permute2x128_si256(v, v, 1), 0xf0);
+  BITONICSTAGE(v, _mm256_shuffle_epi32(v, 0x4e), 0xcc);
+  BITONICSTAGE(v, _mm256_shuffle_epi32(v, 0xb1), 0xaa);
+  return v;
+}
+
+/* Sorts the 8 lanes of v ascending */
+__attribute__((target("avx2")))
+static inline __m256i bitonicSort8(__m256i v) {
+  BITONICSTAGE(v, _mm256_shuffle_epi32(v, 0xb1), 0x66);
+  BITONICSTAGE(v, _mm256_shuffle_epi32(v, 0x4e), 0x3c);
+  BITONICSTAGE(v, _mm256_shuffle_epi32(v, 0xb1), 0x5a);
+  return bitonicMerge8(v);
+}
+
+/* Sorts up to 16 ints with a bitonic network in two registers, the unused lanes are padded with INT_MAX.
+   Both halves are sorted, the upper half is reversed so together they are bitonic, then they are merged */
+__attribute__((target("avx2")))
+static void sortNetwork16(int array[], long low, long high) {
+  int buffer[16];
+  long n = high - low + 1;
+  for (int i = 0; i < 16; i++) buffer[i] = INT_MAX;
+  memcpy(buffer, array + low, n * sizeof(int));
+  __m256i a = bitonicSort8(_mm256_loadu_si256((const __m256i *) buffer));
+  __m256i b = bitonicSort8(_mm256_loadu_si256((const __m256i *) (buffer + 8)));
+  b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+  __m256i smaller = _mm256_min_epi32(a, b), larger = _mm256_max_epi32(a, b);
+  _mm256_storeu_si256((__m256i *) buffer, bitonicMerge8(smaller));
+  _mm256_storeu_si256((__m256i *) (buffer + 8), bitonicMerge8(larger));
+  memcpy(array + low, buffer, n * sizeof(int));
+}
+
+static void leafNetwork(int array[], long low, long high) {
+  if (high - low < 16) sortNetwork16(array, low, high);
+  else insertionSort(array, low, high);
+}
+
+static bool avx2Supported(void) {
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+/* Ordered from fastest to slowest, introsortInit picks the first supported entry */
+static const struct {
+  const char *name;
+  void (*sort)(int array[], long low, long high);
+  bool (*supported)(void);
+} leafKernels[] = {
+#ifdef INTROSORT_X86
+  { "network", leafNetwork, avx2Supported },
+#endif
+  { "insertion", insertionSort, alwaysSupported },
+};
+
+static void (*leafSort)(int array[], long low, long high) = insertionSort;
+static const char *leafName = "insertion";
+static int leafSize = LEAFSIZE;
+
+void introsortInit(void) {
+  const char *forced = getenv("SORTLEAF"), *size = getenv("SORTLEAFSIZE");
+  for (size_t k = 0; k < sizeof(leafKernels) / sizeof(leafKernels[0]); k++) {
+    if (!leafKernels[k].supported()) continue;
+    if (forced != NULL && strcmp(forced, leafKernels[k].name) != 0) continue;
+    leafSort = leafKernels[k].sort;
+    leafName = leafKernels[k].name;
+    break;
+  }
+  if (size != NULL && atoi(size) >= 1) leafSize = atoi(size);
+}
+
+const char *introsortName(void) {
+  return leafName;
+}
+
+int introsortLeafSize(void) {
+  return leafSize;
+}
+
+void sortLeaf(int array[], long low, long high) {
+  if (low < high) leafSort(array, low, high);
+}
+
+void introsort(int array[], long low, long high, int depth) {
+  long lt, gt;
+  while (high - low + 1 > leafSize) {
+    if (depth-- <= 0) {
+      heapsortRange(array, low, high);
+      return;
+    }
+    introPartition(array, low, high, &lt, &gt);
+    if (lt - low < high - gt) {
+      introsort(array, low, lt - 1, depth);
+      low = gt + 1;
+    } else {
+      introsort(array, gt + 1, high, depth);
+      high = lt - 1;
+    }
+  }
+  sortLeaf(array, low, high);
+}
+
+void introselect(int array[], long low, long high, long rank, int depth) {
+  introselectMany(array, low, high, &rank, 1, depth);
+}
+
+void introselectMany(int array[], long low, long high, const long ranks[], int count, int depth) {
+  long lt, gt;
+  while (count > 0 && high - low + 1 > leafSize) {
+    if (depth-- <= 0) {
+      heapsortRange(array, low, high);
+      return;
+    }
+    introPartition(array, low, high, &lt, &gt);
+    int left = 0, right;
+    while (left < count && ranks[left] < lt) left++;
+    for (right = left; right < count && ranks[right] <= gt; right++); /* the ranks in [lt, gt] hold the pivot, done */
+    introselectMany(array, low, lt - 1, ranks, left, depth);
+    ranks += right;
+    count -= right;
+    low = gt + 1;
+  }
+  if (count > 0) sortLeaf(array, low, high);
+}
+
+void introPartialSort(int array[], long low, long high, long last, int depth) {
+  long lt, gt;
+  while (high - low + 1 > leafSize) {
+    if (depth-- <= 0) {
+      heapsortRange(array, low, high);
+      return;
+    }
+    introPartition(array, low, high, &lt, &gt);
+    if (lt > last) { /* everything wanted is on the left */
+      high = lt - 1;
+      continue;
+    }
+    introsort(array, low, lt - 1, depth);
+    if (gt >= last) return;
+    low = gt + 1;
+  }
+  sortLeaf(array, low, high);
+}
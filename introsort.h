@@ -0,0 +1,60 @@
+/* pivot choice, three way partition and the heapsort fallback shared by the quicksorts
+
+   features: the pivot is the median of the first, middle and last element, or Tukey's ninther (median of three
+             medians of three) for ranges of NINTHERCUTOFF elements or more, so sorted and reversed input split evenly.
+             The partition is three way, elements equal to the pivot end up in the middle and are never looked at again,
+             so runs of equal keys cost linear time instead of quadratic.
+             Every sort gets a budget of introDepth(n) partitions along any path, a range that runs out of it
+             is heapsorted, which bounds the time by O(n log n) and the recursion depth by O(log n).
+             When the pivot sample shows no equal keys the partition is the branchless BlockQuicksort scheme,
+             otherwise Bentley-McIlroy. Ranges of up to LEAFSIZE elements (SORTLEAFSIZE=n overrides it) are finished by
+             an AVX2 bitonic network on 16 ints when the CPU has it, or by insertion sort (SORTLEAF=insertion forces it).
+             The same partition drives selection: introselect only follows the side holding the rank, introselectMany
+             the sides holding any of several ranks and introPartialSort sorts only the ranges that end up in the
+             first k, so they run in expected linear time (plus k log k for the partial sort), with the same depth budget.
+
+   usage: compile introsort.c together with the program, call introsortInit() once before sorting
+*/
+#ifndef INTROSORT_H
+#define INTROSORT_H
+
+#define NINTHERCUTOFF 128 /* smallest range that gets a ninther instead of a median of three */
+#define PARTITIONBLOCK 64 /* elements per block of the branchless partition, offsets fit in a byte */
+#define LEAFSIZE 16       /* default largest range sorted by the leaf kernel */
+
+/* Picks the leaf kernel for this CPU and reads SORTLEAF and SORTLEAFSIZE */
+void introsortInit(void);
+
+/* Name of the leaf kernel picked by introsortInit and the largest range it sorts */
+const char *introsortName(void);
+int introsortLeafSize(void);
+
+/* Sorts a small range array[low..high] with the leaf kernel */
+void sortLeaf(int array[], long low, long high);
+
+/* Depth budget for a range of n elements, 2 floor(log2 n) */
+int introDepth(long n);
+
+/* Index of the pivot chosen for array[low..high] */
+long choosePivot(const int array[], long low, long high);
+
+/* Partitions array[low..high] around the chosen pivot: [low, *lt) < pivot, [*lt, *gt] == pivot, (*gt, high] > pivot */
+void introPartition(int array[], long low, long high, long *lt, long *gt);
+
+/* Sorts array[low..high] in place with heapsort */
+void heapsortRange(int array[], long low, long high);
+
+/* Sorts array[low..high], heapsorting any range that has used up depth partitions. The smaller side is sorted
+   recursively and the larger one by the loop, so the stack never holds more than log2 n frames */
+void introsort(int array[], long low, long high, int depth);
+
+/* Moves the element of the given rank (an index in [low, high]) to array[rank], smaller ones before it and larger ones after */
+void introselect(int array[], long low, long high, long rank, int depth);
+
+/* introselect for count ranks in ascending order at once, ranges without a rank are never partitioned again */
+void introselectMany(int array[], long low, long high, const long ranks[], int count, int depth);
+
+/* Sorts array[low..last] so it holds the smallest last - low + 1 elements of array[low..high] in order, the rest is left unordered */
+void introPartialSort(int array[], long low, long high, long last, int depth);
+
+#endif
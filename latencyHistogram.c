@@ -0,0 +1,69 @@
+/* log-linear histogram of non-negative 64 bit values
+
+   usage: gcc -O2 -c latencyHistogram.c, then link latencyHistogram.o with the program and -lm
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "latencyHistogram.h"
+
+/* Bucket of a value: the exponent picks the power of two, the LATENCYSUBBITS bits below the top one the bucket in it */
+static int bucketOf(uint64_t value) {
+  if (value < LATENCYSUB) return (int) value;
+  int exponent = 63 - __builtin_clzll(value);
+  return (exponent - LATENCYSUBBITS + 1) * LATENCYSUB + (int) ((value >> (exponent - LATENCYSUBBITS)) & (LATENCYSUB - 1));
+}
+
+/* Smallest value of a bucket */
+static uint64_t bucketValue(int bucket) {
+  if (bucket < LATENCYSUB) return bucket;
+  int exponent = bucket / LATENCYSUB + LATENCYSUBBITS - 1;
+  return (uint64_t) (LATENCYSUB + bucket % LATENCYSUB) << (exponent - LATENCYSUBBITS);
+}
+
+void latencyInit(struct LatencyHistogram *histogram) {
+  memset(histogram, 0, sizeof(*histogram));
+  histogram->minimum = UINT64_MAX;
+}
+
+void latencyAdd(struct LatencyHistogram *histogram, uint64_t value) {
+  histogram->buckets[bucketOf(value)]++;
+  histogram->count++;
+  histogram->sum += value;
+  if (value < histogram->minimum) histogram->minimum = value;
+  if (value > histogram->maximum) histogram->maximum = value;
+}
+
+void latencyMerge(struct LatencyHistogram *into, const struct LatencyHistogram *from) {
+  for (int b = 0; b < LATENCYBUCKETS; b++) into->buckets[b] += from->buckets[b];
+  into->count += from->count;
+  into->sum += from->sum;
+  if (from->minimum < into->minimum) into->minimum = from->minimum;
+  if (from->maximum > into->maximum) into->maximum = from->maximum;
+}
+
+uint64_t latencyQuantile(const struct LatencyHistogram *histogram, double q) {
+  if (histogram->count == 0) return 0;
+  long long rank = (long long) ceil(q * histogram->count), seen = 0; /* nearest rank, as in stats.c */
+  if (rank < 1) rank = 1;
+  for (int b = 0; b < LATENCYBUCKETS; b++) {
+    seen += histogram->buckets[b];
+    if (seen >= rank) {
+      uint64_t value = bucketValue(b); /* the extremes are known exactly, the rest to the bucket */
+      return value < histogram->minimum ? histogram->minimum : value > histogram->maximum ? histogram->maximum : value;
+    }
+  }
+  return histogram->maximum;
+}
+
+void latencyPrint(const struct LatencyHistogram *histogram, const char *title, double scale, const char *unit) {
+  if (histogram->count == 0) {
+    printf("%s: no values\n", title);
+    return;
+  }
+  printf("%s: %lld values, mean %.3g%s, min %.3g%s, p50 %.3g%s, p90 %.3g%s, p99 %.3g%s, p99.9 %.3g%s, max %.3g%s\n", title,
+         histogram->count, histogram->sum / histogram->count / scale, unit, histogram->minimum / scale, unit,
+         latencyQuantile(histogram, 0.5) / scale, unit, latencyQuantile(histogram, 0.9) / scale, unit,
+         latencyQuantile(histogram, 0.99) / scale, unit, latencyQuantile(histogram, 0.999) / scale, unit,
+         histogram->maximum / scale, unit);
+}
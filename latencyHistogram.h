@@ -0,0 +1,39 @@
+/* log-linear histogram of non-negative 64 bit values, in the style of HdrHistogram
+
+   features: every power of two is split into LATENCYSUB equal buckets, so any value is kept to within 1/LATENCYSUB
+             of itself (3%) from 1 ns to centuries in a fixed 15 KB, and adding a value is a count and a shift.
+             Values below LATENCYSUB are exact. Each thread keeps its own and they are merged at the end.
+
+   usage: compile latencyHistogram.c together with the program, link with -lm
+*/
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stdint.h>
+
+#define LATENCYSUBBITS 5
+#define LATENCYSUB (1 << LATENCYSUBBITS)                        /* buckets per power of two */
+#define LATENCYBUCKETS ((64 - LATENCYSUBBITS + 1) * LATENCYSUB)
+
+struct LatencyHistogram {
+  long long count;
+  double sum;
+  uint64_t minimum;
+  uint64_t maximum;
+  long long buckets[LATENCYBUCKETS];
+};
+
+void latencyInit(struct LatencyHistogram *histogram);
+
+void latencyAdd(struct LatencyHistogram *histogram, uint64_t value);
+
+/* Adds the counts of from to into */
+void latencyMerge(struct LatencyHistogram *into, const struct LatencyHistogram *from);
+
+/* Smallest value with at least q of the values at or below it, to within the bucket width. 0 if empty */
+uint64_t latencyQuantile(const struct LatencyHistogram *histogram, double q);
+
+/* One line: count, mean, min, p50, p90, p99, p99.9 and max, every value divided by scale and followed by unit */
+void latencyPrint(const struct LatencyHistogram *histogram, const char *title, double scale, const char *unit);
+
+#endif
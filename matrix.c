@@ -0,0 +1,67 @@
+/* heap allocated matrix of ints with any number of rows and columns
+
+   usage: gcc -O2 -c matrix.c, then link matrix.o with the program
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "matrix.h"
+
+#define HUGEPAGE (2 * 1024 * 1024) /* size of a transparent huge page on x86-64 */
+
+bool matrixAlloc(struct Matrix *matrix, int rows, int cols, bool hugePages) {
+  return matrixAllocTyped(matrix, rows, cols, sizeof(int), hugePages);
+}
+
+bool matrixAllocTyped(struct Matrix *matrix, int rows, int cols, int elementSize, bool hugePages) {
+  long alignElements = MATRIXALIGN / elementSize;
+  matrix->rows = rows;
+  matrix->cols = cols;
+  matrix->elementSize = elementSize;
+  matrix->stride = (cols + alignElements - 1) / alignElements * alignElements;
+  matrix->bytes = (size_t) rows * matrix->stride * elementSize;
+  matrix->mapped = hugePages;
+  matrix->data = NULL;
+  if (rows <= 0 || cols <= 0) return false;
+
+  if (hugePages) {
+    /* Round up to whole huge pages so the kernel can back all of it, mmap memory is page aligned which covers MATRIXALIGN */
+    matrix->bytes = (matrix->bytes + HUGEPAGE - 1) / HUGEPAGE * HUGEPAGE;
+    void *memory = mmap(NULL, matrix->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return false;
+#ifdef MADV_HUGEPAGE
+    if (madvise(memory, matrix->bytes, MADV_HUGEPAGE) != 0) {
+      perror("madvise(MADV_HUGEPAGE)"); /* Only a hint, the matrix still works with normal pages */
+    }
+#endif
+    matrix->data = memory;
+  } else {
+    void *memory;
+    if (posix_memalign(&memory, MATRIXALIGN, matrix->bytes) != 0) return false;
+    matrix->data = memory;
+  }
+  return true;
+}
+
+void matrixFree(struct Matrix *matrix) {
+  if (matrix->data == NULL) return;
+  if (matrix->mapped) {
+    munmap(matrix->data, matrix->bytes);
+  } else {
+    free(matrix->data);
+  }
+  matrix->data = NULL;
+}
+
+bool parseDimensions(const char *text, int *rows, int *cols) {
+  char *end;
+  long r = strtol(text, &end, 10);
+  long c = r;
+  if (*end == 'x' || *end == 'X') {
+    c = strtol(end + 1, &end, 10);
+  }
+  if (*end != '\0' || r <= 0 || c <= 0 || r > 0x7fffffff || c > 0x7fffffff) return false;
+  *rows = (int) r;
+  *cols = (int) c;
+  return true;
+}
@@ -0,0 +1,48 @@
+/* heap allocated matrix of ints with any number of rows and columns
+
+   features: every row starts on a 64 byte boundary so vector loads of a row never split a cache line at the start.
+             The memory can optionally be mapped directly and marked for transparent huge pages to cut TLB misses.
+             The elements are ints unless the matrix is allocated with matrixAllocTyped, then rows are reached with matrixRowBytes.
+
+   usage: compile matrix.c together with the program
+*/
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MATRIXALIGN 64 /* alignment of every row in bytes */
+
+struct Matrix {
+  int *data;
+  int rows;
+  int cols;
+  int elementSize; /* bytes per element, sizeof(int) unless allocated with matrixAllocTyped */
+  long stride;  /* distance between the start of two rows in elements, cols rounded up to the alignment */
+  size_t bytes; /* size of the allocation */
+  bool mapped;  /* true if data came from mmap instead of posix_memalign */
+};
+
+/* Allocates an uninitialized rows x cols matrix, returns false if the memory could not be allocated */
+bool matrixAlloc(struct Matrix *matrix, int rows, int cols, bool hugePages);
+
+/* Same as matrixAlloc for elements of elementSize bytes, elementSize must divide MATRIXALIGN */
+bool matrixAllocTyped(struct Matrix *matrix, int rows, int cols, int elementSize, bool hugePages);
+
+void matrixFree(struct Matrix *matrix);
+
+/* Reads "N" as an N x N matrix or "RxC" as R rows and C columns, returns false if the text is not a valid size */
+bool parseDimensions(const char *text, int *rows, int *cols);
+
+/* Pointer to the first element of row i */
+static inline int *matrixRow(const struct Matrix *matrix, long i) {
+  return matrix->data + i * matrix->stride;
+}
+
+/* Pointer to the first element of row i for any element size */
+static inline void *matrixRowBytes(const struct Matrix *matrix, long i) {
+  return (char *) matrix->data + i * matrix->stride * matrix->elementSize;
+}
+
+#endif
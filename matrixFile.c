@@ -0,0 +1,113 @@
+/* binary matrix files for out-of-core reductions
+
+   usage: gcc -O2 -c matrixFile.c, then link matrixFile.o and matrix.o with the program
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrixFile.h"
+
+bool matrixFileOpen(struct MatrixFile *file, const char *path) {
+  struct MatrixFileHeader header;
+  struct stat info;
+  file->mapping = NULL;
+  file->mappingSize = 0;
+  file->fd = open(path, O_RDONLY);
+  if (file->fd < 0) {
+    perror(path);
+    return false;
+  }
+  if (pread(file->fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, MATRIXFILEMAGIC, sizeof(header.magic)) != 0
+      || header.elementSize != sizeof(int) || header.rows == 0 || header.cols == 0 || header.rows > 0x7fffffff || header.cols > 0x7fffffff) {
+    printf("%s is not a matrix file\n", path);
+    close(file->fd);
+    return false;
+  }
+  file->rows = header.rows;
+  file->cols = header.cols;
+  if (fstat(file->fd, &info) != 0 || (size_t) info.st_size < MATRIXFILEHEADER + (size_t) file->rows * file->cols * sizeof(int)) {
+    printf("%s is shorter than its header says\n", path);
+    close(file->fd);
+    return false;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL); /* Ask for aggressive read-ahead, only a hint */
+#endif
+  return true;
+}
+
+void matrixFileClose(struct MatrixFile *file) {
+  if (file->mapping != NULL) {
+    munmap(file->mapping, file->mappingSize);
+    file->mapping = NULL;
+  }
+  close(file->fd);
+}
+
+bool matrixFileMap(struct MatrixFile *file, struct Matrix *view) {
+  file->mappingSize = MATRIXFILEHEADER + (size_t) file->rows * file->cols * sizeof(int);
+  file->mapping = mmap(NULL, file->mappingSize, PROT_READ, MAP_SHARED, file->fd, 0);
+  if (file->mapping == MAP_FAILED) {
+    perror("mmap");
+    file->mapping = NULL;
+    return false;
+  }
+  madvise(file->mapping, file->mappingSize, MADV_SEQUENTIAL);
+  view->data = (int *) ((char *) file->mapping + MATRIXFILEHEADER);
+  view->rows = file->rows;
+  view->cols = file->cols;
+  view->elementSize = sizeof(int);
+  view->stride = file->cols;
+  view->bytes = file->mappingSize - MATRIXFILEHEADER;
+  view->mapped = true;
+  return true;
+}
+
+bool matrixFileReadRows(const struct MatrixFile *file, int firstRow, int count, struct Matrix *strip) {
+  size_t rowBytes = (size_t) file->cols * sizeof(int);
+  off_t offset = MATRIXFILEHEADER + (off_t) firstRow * rowBytes;
+  if (strip->stride == file->cols) { /* Rows are contiguous in the strip too, so the whole strip is one read */
+    size_t total = rowBytes * count, done = 0;
+    while (done < total) {
+      ssize_t n = pread(file->fd, (char *) strip->data + done, total - done, offset + done);
+      if (n <= 0) return false;
+      done += n;
+    }
+    return true;
+  }
+  for (int i = 0; i < count; i++) { /* Padded stride, read row by row */
+    size_t done = 0;
+    while (done < rowBytes) {
+      ssize_t n = pread(file->fd, (char *) matrixRow(strip, i) + done, rowBytes - done, offset + done);
+      if (n <= 0) return false;
+      done += n;
+    }
+    offset += rowBytes;
+  }
+  return true;
+}
+
+bool matrixFileWrite(const char *path, const struct Matrix *matrix) {
+  struct MatrixFileHeader header;
+  FILE *out = fopen(path, "wb");
+  if (out == NULL) {
+    perror(path);
+    return false;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MATRIXFILEMAGIC, sizeof(header.magic));
+  header.rows = matrix->rows;
+  header.cols = matrix->cols;
+  header.elementSize = sizeof(int);
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  for (long i = 0; ok && i < matrix->rows; i++) {
+    ok = fwrite(matrixRow(matrix, i), sizeof(int), matrix->cols, out) == (size_t) matrix->cols;
+  }
+  if (fclose(out) != 0) ok = false;
+  if (!ok) printf("Could not write %s\n", path);
+  return ok;
+}
@@ -0,0 +1,52 @@
+/* binary matrix files for out-of-core reductions
+
+   format: a 64 byte header followed by rows * cols 32 bit ints in row major order, native byte order.
+     offset 0  char magic[8]  "MATRIX1" followed by a zero byte
+     offset 8  uint32 rows
+     offset 12 uint32 cols
+     offset 16 uint32 elementSize, always 4
+     offset 20 reserved, zero up to byte 64
+
+   usage: compile matrixFile.c and matrix.c together with the program
+*/
+#ifndef MATRIXFILE_H
+#define MATRIXFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "matrix.h"
+
+#define MATRIXFILEMAGIC "MATRIX1"
+#define MATRIXFILEHEADER 64 /* size of the header in bytes, keeps the data 64 byte aligned in a mapping */
+
+struct MatrixFileHeader {
+  char magic[8];
+  uint32_t rows;
+  uint32_t cols;
+  uint32_t elementSize;
+  char reserved[MATRIXFILEHEADER - 20];
+};
+
+struct MatrixFile {
+  int fd;
+  int rows;
+  int cols;
+  void *mapping;      /* whole file when mapped with matrixFileMap, NULL otherwise */
+  size_t mappingSize;
+};
+
+/* Opens a file and checks the header, prints the reason and returns false on failure */
+bool matrixFileOpen(struct MatrixFile *file, const char *path);
+
+void matrixFileClose(struct MatrixFile *file);
+
+/* Maps the whole file read only and points view at the data, the view has stride cols and must not be freed with matrixFree */
+bool matrixFileMap(struct MatrixFile *file, struct Matrix *view);
+
+/* Reads count rows starting at firstRow into the first rows of strip with pread, so it is safe to call from several threads */
+bool matrixFileReadRows(const struct MatrixFile *file, int firstRow, int count, struct Matrix *strip);
+
+/* Writes matrix to path in the format above */
+bool matrixFileWrite(const char *path, const struct Matrix *matrix);
+
+#endif
@@ -0,0 +1,225 @@
+/* index over a resident matrix for fast rectangle queries
+
+   usage: gcc -O2 -c matrixIndex.c, then link matrixIndex.o with rowReduce.o, matrix.o and -lpthread
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "matrixIndex.h"
+#include "rowReduce.h"
+
+/* Arguments for one building thread, each thread takes the part [id * count / numThreads, (id + 1) * count / numThreads) */
+struct BuildTask {
+  struct MatrixIndex *index;
+  int id;
+  int numThreads;
+  void (*phase)(struct MatrixIndex *index, long first, long end);
+  long count;
+};
+
+static void *buildWorker(void *arg) {
+  struct BuildTask *task = arg;
+  task->phase(task->index, task->count * task->id / task->numThreads, task->count * (task->id + 1) / task->numThreads);
+  return NULL;
+}
+
+/* Runs phase over [0, count) split in contiguous parts, one per thread, and waits for all of them */
+static void runPhase(struct MatrixIndex *index, int numThreads, void (*phase)(struct MatrixIndex *, long, long), long count) {
+  pthread_t threads[numThreads];
+  struct BuildTask tasks[numThreads];
+  for (int t = 0; t < numThreads; t++) {
+    tasks[t] = (struct BuildTask) { index, t, numThreads, phase, count };
+    if (t > 0) pthread_create(&threads[t], NULL, buildWorker, &tasks[t]);
+  }
+  buildWorker(&tasks[0]);
+  for (int t = 1; t < numThreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+}
+
+static inline long long *tableEntry(const struct MatrixIndex *index, long i, long j) {
+  return index->table + i * index->tableStride + j;
+}
+
+static inline struct Result *treeNode(const struct MatrixIndex *index, long x, long y) {
+  return index->tree + x * 2 * index->blockCols + y;
+}
+
+/* Reduces the rectangle rows [row0, row1] x columns [col0, col1] by scanning it row by row with the row kernel */
+static void scanRect(const struct MatrixIndex *index, int row0, int row1, int col0, int col1, struct Result *result) {
+  struct RowReduction row;
+  struct Result part;
+  for (int i = row0; i <= row1; i++) {
+    reduceRow(matrixRow(index->matrix, i) + col0, col1 - col0 + 1, &row);
+    part.total = row.total;
+    part.minimum = row.minimum;
+    part.minRow = i;
+    part.minColumn = col0 + row.minColumn;
+    part.maximum = row.maximum;
+    part.maxRow = i;
+    part.maxColumn = col0 + row.maxColumn;
+    mergeResult(result, &part);
+  }
+}
+
+/* Recomputes leaf (bi, bj) of the segment tree from the block of the matrix */
+static void scanBlock(struct MatrixIndex *index, int bi, int bj) {
+  struct Result *leaf = treeNode(index, index->blockRows + bi, index->blockCols + bj);
+  int row1 = (bi + 1) * INDEXBLOCK < index->matrix->rows ? (bi + 1) * INDEXBLOCK - 1 : index->matrix->rows - 1;
+  int col1 = (bj + 1) * INDEXBLOCK < index->matrix->cols ? (bj + 1) * INDEXBLOCK - 1 : index->matrix->cols - 1;
+  resultInit(leaf);
+  scanRect(index, bi * INDEXBLOCK, row1, bj * INDEXBLOCK, col1, leaf);
+}
+
+static inline void combine(struct Result *node, const struct Result *a, const struct Result *b) {
+  resultInit(node);
+  mergeResult(node, a);
+  mergeResult(node, b);
+}
+
+/* Phase 1: Fenwick tree along each row, one part of the rows per thread. Each entry is added once to its parent */
+static void rowFenwick(struct MatrixIndex *index, long first, long end) {
+  long cols = index->matrix->cols;
+  for (long i = first; i < end; i++) {
+    const int *row = matrixRow(index->matrix, i);
+    long long *out = tableEntry(index, i + 1, 0);
+    out[0] = 0;
+    for (long j = 1; j <= cols; j++) {
+      out[j] = row[j - 1];
+    }
+    for (long j = 1; j <= cols; j++) {
+      if (j + (j & -j) <= cols) out[j + (j & -j)] += out[j];
+    }
+  }
+}
+
+/* Phase 2: the same down the columns, one part of the columns per thread so every row is read left to right */
+static void columnFenwick(struct MatrixIndex *index, long first, long end) {
+  long rows = index->matrix->rows;
+  for (long i = 1; i <= rows; i++) {
+    if (i + (i & -i) > rows) continue;
+    long long *from = tableEntry(index, i, 1), *parent = tableEntry(index, i + (i & -i), 1);
+    for (long j = first; j < end; j++) {
+      parent[j] += from[j];
+    }
+  }
+}
+
+/* Sum of the rows < i and columns < j */
+static long long tablePrefix(const struct MatrixIndex *index, long i, long j) {
+  long long sum = 0;
+  for (long x = i; x > 0; x -= x & -x) {
+    const long long *row = tableEntry(index, x, 0);
+    for (long y = j; y > 0; y -= y & -y) {
+      sum += row[y];
+    }
+  }
+  return sum;
+}
+
+/* Phase 3: leaves of the segment tree and the column levels of each leaf row, one part of the block rows per thread */
+static void blockLeaves(struct MatrixIndex *index, long first, long end) {
+  for (long bi = first; bi < end; bi++) {
+    long x = index->blockRows + bi;
+    for (int bj = 0; bj < index->blockCols; bj++) {
+      scanBlock(index, bi, bj);
+    }
+    for (long y = index->blockCols - 1; y >= 1; y--) {
+      combine(treeNode(index, x, y), treeNode(index, x, 2 * y), treeNode(index, x, 2 * y + 1));
+    }
+  }
+}
+
+bool indexBuild(struct MatrixIndex *index, struct Matrix *matrix, int numThreads) {
+  index->matrix = matrix;
+  index->tableStride = matrix->cols + 1;
+  index->blockRows = (matrix->rows + INDEXBLOCK - 1) / INDEXBLOCK;
+  index->blockCols = (matrix->cols + INDEXBLOCK - 1) / INDEXBLOCK;
+  index->table = malloc((size_t) (matrix->rows + 1) * index->tableStride * sizeof(long long));
+  index->tree = malloc((size_t) 4 * index->blockRows * index->blockCols * sizeof(struct Result));
+  if (index->table == NULL || index->tree == NULL) {
+    indexFree(index);
+    return false;
+  }
+  if (numThreads < 1) numThreads = 1;
+
+  memset(index->table, 0, index->tableStride * sizeof(long long)); /* Row 0 is not part of the tree */
+  runPhase(index, numThreads, rowFenwick, matrix->rows);
+  runPhase(index, numThreads, columnFenwick, matrix->cols);
+  runPhase(index, numThreads, blockLeaves, index->blockRows);
+  for (long x = index->blockRows - 1; x >= 1; x--) { /* The row levels are small, build them on the calling thread */
+    for (long y = 1; y < 2 * index->blockCols; y++) {
+      combine(treeNode(index, x, y), treeNode(index, 2 * x, y), treeNode(index, 2 * x + 1, y));
+    }
+  }
+  return true;
+}
+
+void indexFree(struct MatrixIndex *index) {
+  free(index->table);
+  free(index->tree);
+  index->table = NULL;
+  index->tree = NULL;
+}
+
+/* Merges the tree nodes covering block columns [y0, y1) of tree row x */
+static void queryTreeRow(const struct MatrixIndex *index, long x, long y0, long y1, struct Result *result) {
+  for (long l = y0 + index->blockCols, r = y1 + index->blockCols; l < r; l >>= 1, r >>= 1) {
+    if (l & 1) mergeResult(result, treeNode(index, x, l++));
+    if (r & 1) mergeResult(result, treeNode(index, x, --r));
+  }
+}
+
+/* Merges the tree nodes covering blocks [x0, x1) x [y0, y1) */
+static void queryTree(const struct MatrixIndex *index, long x0, long x1, long y0, long y1, struct Result *result) {
+  for (long l = x0 + index->blockRows, r = x1 + index->blockRows; l < r; l >>= 1, r >>= 1) {
+    if (l & 1) queryTreeRow(index, l++, y0, y1, result);
+    if (r & 1) queryTreeRow(index, --r, y0, y1, result);
+  }
+}
+
+struct Result indexQuery(const struct MatrixIndex *index, int row0, int col0, int row1, int col1) {
+  struct Result result;
+  int br0 = (row0 + INDEXBLOCK - 1) / INDEXBLOCK, br1 = (row1 + 1) / INDEXBLOCK; /* blocks fully inside, [br0, br1) */
+  int bc0 = (col0 + INDEXBLOCK - 1) / INDEXBLOCK, bc1 = (col1 + 1) / INDEXBLOCK;
+  resultInit(&result);
+
+  if (br0 < br1 && bc0 < bc1) {
+    queryTree(index, br0, br1, bc0, bc1, &result);
+    /* The border outside the full blocks: top and bottom strips over all columns, left and right strips beside the blocks */
+    if (row0 < br0 * INDEXBLOCK) scanRect(index, row0, br0 * INDEXBLOCK - 1, col0, col1, &result);
+    if (br1 * INDEXBLOCK <= row1) scanRect(index, br1 * INDEXBLOCK, row1, col0, col1, &result);
+    if (col0 < bc0 * INDEXBLOCK) scanRect(index, br0 * INDEXBLOCK, br1 * INDEXBLOCK - 1, col0, bc0 * INDEXBLOCK - 1, &result);
+    if (bc1 * INDEXBLOCK <= col1) scanRect(index, br0 * INDEXBLOCK, br1 * INDEXBLOCK - 1, bc1 * INDEXBLOCK, col1, &result);
+  } else {
+    scanRect(index, row0, row1, col0, col1, &result); /* Thinner than a block in one direction */
+  }
+
+  result.total = tablePrefix(index, row1 + 1, col1 + 1) - tablePrefix(index, row0, col1 + 1)
+               - tablePrefix(index, row1 + 1, col0) + tablePrefix(index, row0, col0);
+  return result;
+}
+
+void indexUpdate(struct MatrixIndex *index, int row, int col, int value) {
+  int *element = matrixRow(index->matrix, row) + col;
+  long long delta = (long long) value - *element;
+  *element = value;
+
+  for (long i = row + 1; i <= index->matrix->rows; i += i & -i) { /* The O(log^2) entries whose range holds the point */
+    long long *out = tableEntry(index, i, 0);
+    for (long j = col + 1; j <= index->matrix->cols; j += j & -j) {
+      out[j] += delta;
+    }
+  }
+
+  long x = index->blockRows + row / INDEXBLOCK, y = index->blockCols + col / INDEXBLOCK;
+  scanBlock(index, row / INDEXBLOCK, col / INDEXBLOCK);
+  for (long yy = y / 2; yy >= 1; yy /= 2) {
+    combine(treeNode(index, x, yy), treeNode(index, x, 2 * yy), treeNode(index, x, 2 * yy + 1));
+  }
+  for (long xx = x / 2; xx >= 1; xx /= 2) {
+    for (long yy = y; yy >= 1; yy /= 2) {
+      combine(treeNode(index, xx, yy), treeNode(index, 2 * xx, yy), treeNode(index, 2 * xx + 1, yy));
+    }
+  }
+}
@@ -0,0 +1,42 @@
+/* index over a resident matrix for fast rectangle queries
+
+   features: a 2D Fenwick tree with 64 bit entries answers the sum of any rectangle from four prefix sums of
+             O(log rows * log cols) lookups each, and is built in place in O(rows * cols) by the building threads.
+             The matrix is split into INDEXBLOCK x INDEXBLOCK blocks, a 2D segment tree over the per block min/max
+             answers the blocks fully inside a rectangle in O(log^2) and the partial blocks on the border are scanned
+             with the row kernel, so a query costs at most O(log^2 + INDEXBLOCK * (height + width)).
+             A point update adds the change to the O(log^2) Fenwick entries covering the point and rescans only the
+             block holding the point before walking up the segment tree.
+
+   usage: compile matrixIndex.c, rowReduce.c and matrix.c together with the program, call rowReduceInit() first
+*/
+#ifndef MATRIXINDEX_H
+#define MATRIXINDEX_H
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "result.h"
+
+#define INDEXBLOCK 32 /* side of a summary block */
+
+struct MatrixIndex {
+  struct Matrix *matrix;
+  long long *table;  /* (rows + 1) x (cols + 1) Fenwick tree, entry (i, j) is the sum of the rows [i - (i & -i), i) and columns [j - (j & -j), j) */
+  long tableStride;
+  int blockRows;     /* number of blocks down and across */
+  int blockCols;
+  struct Result *tree; /* 2D segment tree, (2 * blockRows) x (2 * blockCols) nodes, leaves at [blockRows, 2 * blockRows) x [blockCols, 2 * blockCols) */
+};
+
+/* Builds the index over matrix with numThreads pthreads, returns false if the memory could not be allocated */
+bool indexBuild(struct MatrixIndex *index, struct Matrix *matrix, int numThreads);
+
+void indexFree(struct MatrixIndex *index);
+
+/* Sum, min and max with positions of the rectangle with corners (row0, col0) and (row1, col1), inclusive */
+struct Result indexQuery(const struct MatrixIndex *index, int row0, int col0, int row1, int col1);
+
+/* Sets matrix element (row, col) to value and refreshes the index */
+void indexUpdate(struct MatrixIndex *index, int row, int col, int value);
+
+#endif
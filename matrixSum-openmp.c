@@ -1,117 +1,417 @@
 /* matrix summation using OpenMP
 
+   features: each row is reduced by the vectorized kernel in rowReduce.c, the total is kept in 64 bits.
+             The matrix is allocated on the heap with the requested rows and columns (matrix.c), --huge asks for transparent huge pages.
+             The matrix is generated in parallel by generator.c, --seed makes it reproducible for any number of workers
+             and --dist picks the distribution of the values.
+             --type stores the matrix as int8, uint16, int32 (default), int64, float or double and reduces it with the kernel
+             for that type (typedReduce.c).
+             --stats K also gathers the K largest and smallest values with their positions, the mean, the variance and a
+             histogram giving the exact median and 99th percentile (stats.c) in the same loop, each thread keeps its own
+             and they are merged in the critical section. --hist low:high sets the histogram domain and prints it.
+             The min and max with their positions are merged by a declared OpenMP reduction over struct Result (result.h),
+             or over struct TypedResult (typedReduce.h) for the other element types.
+             The loop uses schedule(runtime): --schedule static|dynamic|guided[,chunk] picks it, otherwise OMP_SCHEDULE does.
+             --tile columns splits every row into tiles of that many columns and collapses the row and tile loops, so a
+             matrix with fewer rows than threads (or very wide rows) still spreads over all of them.
+             The reported time covers the loop and the reductions.
+             --counters reads hardware counters (perfCounters.c): cycles, instructions, LLC, branch and dTLB misses of
+             the whole process for the generation, the loop with its declared reduction and the merge of the statistics,
+             and of every thread of the team in its own group for its tiles, printed with IPC and misses per thousand
+             instructions. Without counters it runs as usual.
+             matrixSumOpenmpCore runs the same loop for bench.c, which links this file compiled with -DNO_MAIN.
+
    usage with gcc (version 4.2 or higher required):
-     gcc -O -fopenmp -o matrixSum-openmp matrixSum-openmp.c 
-     ./matrixSum-openmp size numWorkers
+     gcc -O -fopenmp -o matrixSum-openmp matrixSum-openmp.c rowReduce.c matrix.c generator.c typedReduce.c stats.c perfCounters.c -lm
+     ./matrixSum-openmp [--huge] [--seed n] [--dist name] [--type name] [--stats K [--hist low:high]] [--schedule kind[,chunk]] [--tile columns] [--counters] size|rowsxcols numWorkers
 
 */
 
 #include <omp.h>
-#include <stdlib.h> /* To allow use of rand function */
-#include <time.h> /* Only to allow random seed on the rand function */
+#include <stdlib.h>
+#include <time.h> /* Only to allow a random default seed */
+#include <getopt.h>
+#include <string.h>
 
-double start_time, end_time;
+static double start_time, end_time;
 
 #include <stdio.h>
-#define MAXSIZE 10000  /* maximum matrix size */
+#include "rowReduce.h"
+#include "matrix.h"
+#include "generator.h"
+#include "typedReduce.h"
+#include "stats.h"
+#include "result.h"
+#include "benchCore.h"
+#include "perfCounters.h"
+#include <math.h>
+#define MAXSIZE 10000  /* default matrix size */
 #define MAXWORKERS 8   /* maximum number of workers */
 
-int numWorkers;
-int size; 
-int matrix[MAXSIZE][MAXSIZE];
-void *Worker(void *);
-
-/* struct to encapsulate the result, returns min value and its position, max value and its position */
-struct Result {
-  int minimum;
-  int minRow;
-  int minColumn;
-  int maximum;
-  int maxRow;
-  int maxColumn;
-};
+static int numWorkers;
+static int rows, cols;
+static struct Matrix matrix;
+static enum ElementType elementType = ELEMENT_INT32;
 
-int main(int argc, char *argv[]) {
-  int i, j, total=0;
+static bool counting;                       /* true with --counters once the counters of the process are open */
+static struct PerfCounters processCounters; /* opened by main before the team exists, so they count every thread */
+static struct PerfSample since, generation, compute, merge; /* start of the current phase and the phases, all threads */
+static struct PerfSample threadCounts[MAXWORKERS];          /* what each thread of the team counted in its own group */
+
+/* Each thread reduces into a private Result starting empty, the private results are then merged in any order,
+   mergeResult keeps the first position of equal values so the order does not change the answer */
+#pragma omp declare reduction(mergeResults : struct Result : mergeResult(&omp_out, &omp_in)) initializer(resultInit(&omp_priv))
+
+/* The same for the other element types, a combiner may only name omp_out and omp_in so these supply elementType */
+static void mergeTypedResults(struct TypedResult *out, const struct TypedResult *in) {
+  typedMergeResult(elementType, out, in);
+}
+
+static void initTypedResult(struct TypedResult *result) {
+  typedResultInit(elementType, result);
+}
+
+#pragma omp declare reduction(mergeTypedResults : struct TypedResult : mergeTypedResults(&omp_out, &omp_in)) \
+  initializer(initTypedResult(&omp_priv))
+
+/* Parses kind[,chunk] into an OpenMP schedule, a missing or zero chunk leaves the chunk to the runtime */
+bool parseSchedule(const char *text, omp_sched_t *kind, int *chunk) {
+  size_t length = strcspn(text, ",");
+  if (strncmp(text, "static", length) == 0 && length == 6) *kind = omp_sched_static;
+  else if (strncmp(text, "dynamic", length) == 0 && length == 7) *kind = omp_sched_dynamic;
+  else if (strncmp(text, "guided", length) == 0 && length == 6) *kind = omp_sched_guided;
+  else return false;
+  *chunk = text[length] == ',' ? atoi(text + length + 1) : 0;
+  return *chunk >= 0;
+}
+
+const char *scheduleName(omp_sched_t kind) {
+  switch (kind & ~omp_sched_monotonic) {
+  case omp_sched_static: return "static";
+  case omp_sched_dynamic: return "dynamic";
+  case omp_sched_guided: return "guided";
+  default: return "auto";
+  }
+}
+
+/* Opens a group for the calling thread of the team, its counts start at start */
+static void threadCountersOpen(struct PerfCounters *counters, struct PerfSample *start) {
+  if (perfOpen(counters, false)) perfRead(counters, start);
+}
+
+/* Adds what the calling thread counted since threadCountersOpen to its total and closes the group. Then one thread
+   ends the compute phase of the process once the whole team is past its loop, before anybody merges statistics */
+static void threadCountersClose(struct PerfCounters *counters, const struct PerfSample *start) {
+  if (counters->open) {
+    struct PerfSample sample;
+    perfRead(counters, &sample);
+    perfSubtract(&sample, start);
+    perfAdd(&threadCounts[omp_get_thread_num()], &sample);
+    perfClose(counters);
+  }
+  #pragma omp barrier
+  #pragma omp master
+  perfPhase(&processCounters, &since, &compute);
+  #pragma omp barrier
+}
+
+/* Reduces the int32 matrix with the whole team, one iteration per tile of tileWidth columns with the row and tile loops
+   collapsed. With globalStats every thread also gathers its own statistics and merges them into globalStats */
+struct Result reduceMatrix(int tileWidth, struct Stats *globalStats) {
   struct Result globalResult;
-  srand(time(NULL)); /* Added to get random seed so the matrix is not identical each time */
+  int tiles = (cols + tileWidth - 1) / tileWidth;
+  bool statsFailed = false;
+  resultInit(&globalResult);
 
-  /* read command line args if any */
-  size = (argc > 1)? atoi(argv[1]) : MAXSIZE;
-  numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
-  if (size > MAXSIZE) size = MAXSIZE;
-  if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
+  #pragma omp parallel
+  {
+    struct Stats localStats;
+    struct PerfCounters counters;
+    struct PerfSample start;
+    bool gathering = globalStats != NULL;
+    if (gathering && !statsInit(&localStats, globalStats->k, globalStats->histogramLow, globalStats->histogramHigh)) {
+      gathering = false;
+      #pragma omp atomic write
+      statsFailed = true;
+    }
 
-  omp_set_num_threads(numWorkers);
+    if (counting) threadCountersOpen(&counters, &start);
 
-  /* initialize the matrix */
-  for (i = 0; i < size; i++) {
-    //  printf("[ ");
-	  for (j = 0; j < size; j++) {
-      matrix[i][j] = rand()%99;
-      //	  printf(" %d", matrix[i][j]);
-	  }
-	  //	  printf(" ]\n");
-  }
-
-  /* Initialize the globalResult struct */
-  globalResult.minimum = matrix[0][0];
-  globalResult.minRow = 0;
-  globalResult.minColumn = 0;
-  globalResult.maximum = matrix[0][0];
-  globalResult.maxRow = 0;
-  globalResult.maxColumn = 0;
-  
-  start_time = omp_get_wtime();
+    /* one iteration per tile, rows and tiles are collapsed into a single iteration space */
+    #pragma omp for collapse(2) schedule(runtime) reduction(mergeResults : globalResult)
+    for (int r = 0; r < rows; r++){
+      for (int t = 0; t < tiles; t++){
+        int firstColumn = t * tileWidth;
+        int width = firstColumn + tileWidth <= cols ? tileWidth : cols - firstColumn;
+        const int *values = matrixRow(&matrix, r) + firstColumn;
+        struct RowReduction row;
+        reduceRow(values, width, &row);
+        if (gathering) statsAddRow(&localStats, values, width, r, firstColumn); /* the tile is still in cache */
+        struct Result part = { row.total, row.minimum, r, firstColumn + row.minColumn, row.maximum, r, firstColumn + row.maxColumn };
+        mergeResult(&globalResult, &part);
+      }
+    }
+    if (counting) threadCountersClose(&counters, &start); /* the same on every thread, so all reach its barriers */
+
+    if (gathering) {
+      #pragma omp critical /* the statistics own heap memory so they are merged here instead of in a declared reduction */
+      statsMerge(globalStats, &localStats);
+      statsFree(&localStats);
+    }
+  }
+  if (statsFailed) { /* the statistics would miss the rows of that thread */
+    printf("Could not allocate statistics for %d values and a histogram over [%d, %d)\n", globalStats->k,
+           globalStats->histogramLow, globalStats->histogramHigh);
+    exit(1);
+  }
+  return globalResult;
+}
+
+/* Reduces a matrix of elementType the same way with the kernel for the type */
+struct TypedResult reduceTypedMatrix(int tileWidth) {
+  struct TypedResult globalResult;
+  int tiles = (cols + tileWidth - 1) / tileWidth, size = elementSize(elementType);
+  TypedRowKernel kernel = typedRowKernel(elementType);
+  typedResultInit(elementType, &globalResult);
 
   #pragma omp parallel
   {
-    struct Result localResult; /* This will be a private variable in each thread */
-    localResult.minimum = matrix[0][0];
-    localResult.minRow = 0;
-    localResult.minColumn = 0;
-    localResult.maximum = matrix[0][0];
-    localResult.maxRow = 0;
-    localResult.maxColumn = 0;
-
-    #pragma omp for reduction (+:total) private(j) /* Moved parallel command to top omp statement to avoid nesting of parallel execution */
-    for (i = 0; i < size; i++){
-      for (j = 0; j < size; j++){
-        total += matrix[i][j];
-
-        if (matrix[i][j] < localResult.minimum){ /* Checks if current entry is smaller than min, if so it is recorded */
-          localResult.minimum = matrix[i][j];
-          localResult.minRow = i;
-          localResult.minColumn = j;
-        }
-        if (matrix[i][j] > localResult.maximum){ /* Check if current entry is larger than max, if so it is recorded */
-          localResult.maximum = matrix[i][j];
-          localResult.maxRow = i;
-          localResult.maxColumn = j;
-        }
+    struct PerfCounters counters;
+    struct PerfSample start;
+    if (counting) threadCountersOpen(&counters, &start);
+
+    #pragma omp for collapse(2) schedule(runtime) reduction(mergeTypedResults : globalResult)
+    for (int r = 0; r < rows; r++){
+      for (int t = 0; t < tiles; t++){
+        int firstColumn = t * tileWidth;
+        int width = firstColumn + tileWidth <= cols ? tileWidth : cols - firstColumn;
+        struct TypedReduction row;
+        kernel((const char *) matrixRowBytes(&matrix, r) + (long) firstColumn * size, width, &row);
+        typedMergeRow(elementType, &globalResult, &row, r, firstColumn);
       }
     }
+    if (counting) threadCountersClose(&counters, &start);
+  }
+  return globalResult;
+}
+
+/* One benchmark run (benchCore.h): a square int32 matrix of about run->size elements reduced with one tile per row
+   and the static schedule, timed like main. Checked against a plain sequential loop */
+bool matrixSumOpenmpCore(struct BenchRun *run) {
+  struct Generator generator;
+  struct Result globalResult, expected;
+  rows = cols = run->size > 1 ? (int) sqrt((double) run->size) : 1;
+  numWorkers = run->threads < 1 ? 1 : run->threads > MAXWORKERS ? MAXWORKERS : run->threads;
+  run->threads = numWorkers;
+  omp_set_num_threads(numWorkers);
+  omp_set_schedule(omp_sched_static, 0);
+  if (!matrixAlloc(&matrix, rows, cols, false)) return false;
+  generatorInit(&generator, run->distribution, 99, run->seed);
+  #pragma omp parallel
+  {
+    long blocks = generatorBlocks((long) rows * cols);
+    int id = omp_get_thread_num(), threads = omp_get_num_threads();
+    generateBlocks(&generator, matrix.data, rows, cols, matrix.stride, blocks * id / threads, blocks * (id + 1) / threads);
+  }
+  rowReduceInit();
+
+  start_time = omp_get_wtime();
+  globalResult = reduceMatrix(cols, NULL);
+  end_time = omp_get_wtime();
+
+  resultInit(&expected);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      struct Result element = { matrixRow(&matrix, i)[j], matrixRow(&matrix, i)[j], i, j, matrixRow(&matrix, i)[j], i, j };
+      mergeResult(&expected, &element);
+    }
+  }
+  run->seconds = end_time - start_time;
+  run->checksum = globalResult.total;
+  run->correct = memcmp(&globalResult, &expected, sizeof(struct Result)) == 0;
+  matrixFree(&matrix);
+  return true;
+}
+
+#ifndef NO_MAIN
+/* Prints the counts of the phases and of every thread of the team */
+static void printCounters(bool gatherStats) {
+  struct PerfSample threads;
+  char title[32];
+  printf("Counters per phase, all threads:\n");
+  perfPrint(&generation, "  generation");
+  perfPrint(&compute, "  reduction");
+  if (gatherStats) perfPrint(&merge, "  merge");
+  printf("Counters per thread of the team, its tiles:\n");
+  perfZero(&threads);
+  for (int t = 0; t < numWorkers; t++) {
+    snprintf(title, sizeof(title), "  thread %d", t);
+    perfPrint(&threadCounts[t], title);
+    perfAdd(&threads, &threadCounts[t]);
+  }
+  perfPrint(&threads, "  all threads");
+  perfClose(&processCounters);
+}
+
+int main(int argc, char *argv[]) {
+  struct Result globalResult;
+  bool hugePages = false;
+  static struct option options[] = {
+    { "huge", no_argument, NULL, 'H' },
+    { "seed", required_argument, NULL, 'S' },
+    { "dist", required_argument, NULL, 'd' },
+    { "type", required_argument, NULL, 't' },
+    { "stats", required_argument, NULL, 'k' },
+    { "hist", required_argument, NULL, 'g' },
+    { "schedule", required_argument, NULL, 's' },
+    { "tile", required_argument, NULL, 'T' },
+    { "counters", no_argument, NULL, 'c' },
+    { NULL, 0, NULL, 0 }
+  };
+  int option;
+  unsigned long long seed = time(NULL); /* Random seed so the matrix is not identical each time unless --seed is given */
+  enum Distribution distribution = DIST_UNIFORM;
+  struct Generator generator;
+  bool gatherStats = false, printHistogram = false;
+  int statsK = 0, histogramLow = HISTOGRAMLOW, histogramHigh = HISTOGRAMHIGH;
+  struct Stats globalStats;
+  omp_sched_t scheduleKind;
+  int scheduleChunk, tileWidth = 0, tiles;
 
-    end_time = omp_get_wtime(); /* Instructions said to only take time for parallel part, critical section is not parallel */
+  /* schedule(runtime) would default to dynamic,1 in libgomp, keep the static schedule of a plain omp for unless asked */
+  if (getenv("OMP_SCHEDULE") == NULL) omp_set_schedule(omp_sched_static, 0);
 
-    #pragma omp critical /* Critical sectio to ensure globalResult is updated correctly */
-    {
-      if (localResult.minimum < globalResult.minimum){
-        globalResult.minimum = localResult.minimum;
-        globalResult.minRow = localResult.minRow;
-        globalResult.minColumn = localResult.minColumn;
+  /* read command line options, the remaining args are positional */
+  while ((option = getopt_long(argc, argv, "HS:d:t:k:g:s:T:c", options, NULL)) != -1) {
+    switch (option) {
+    case 'H': hugePages = true; break;
+    case 'S': seed = strtoull(optarg, NULL, 0); break;
+    case 'd':
+      if (!parseDistribution(optarg, &distribution)) {
+        printf("Unknown distribution %s, expected uniform, sorted, reverse, few or zipf\n", optarg);
+        return 1;
       }
-      if (localResult.maximum > globalResult.maximum){
-        globalResult.maximum = localResult.maximum;
-        globalResult.maxRow = localResult.maxRow;
-        globalResult.maxColumn = localResult.maxColumn;
+      break;
+    case 't':
+      if (!parseElementType(optarg, &elementType)) {
+        printf("Unknown type %s, expected int8, uint16, int32, int64, float or double\n", optarg);
+        return 1;
       }
+      break;
+    case 'k':
+      gatherStats = true;
+      statsK = atoi(optarg);
+      break;
+    case 'g':
+      if (sscanf(optarg, "%d:%d", &histogramLow, &histogramHigh) != 2) {
+        printf("Invalid histogram domain %s, expected low:high\n", optarg);
+        return 1;
+      }
+      printHistogram = true;
+      break;
+    case 's':
+      if (!parseSchedule(optarg, &scheduleKind, &scheduleChunk)) {
+        printf("Unknown schedule %s, expected static, dynamic or guided with an optional ,chunk\n", optarg);
+        return 1;
+      }
+      omp_set_schedule(scheduleKind, scheduleChunk);
+      break;
+    case 'T': tileWidth = atoi(optarg); break;
+    case 'c': counting = true; break;
+    default: return 1;
     }
   }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  /* read command line args if any */
+  rows = cols = MAXSIZE;
+  if (argc > 1 && !parseDimensions(argv[1], &rows, &cols)) {
+    printf("Invalid matrix size %s, expected size or rowsxcols\n", argv[1]);
+    return 1;
+  }
+  numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
+  if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
+
+  omp_set_num_threads(numWorkers);
+  if (counting && !perfOpen(&processCounters, true)) {
+    printf("Hardware counters unavailable (%s), running without them\n", strerror(processCounters.error));
+    counting = false;
+  }
+  for (int t = 0; t < MAXWORKERS; t++) perfZero(&threadCounts[t]);
+  if (tileWidth <= 0 || tileWidth > cols) tileWidth = cols; /* no --tile means one tile per row */
+  tiles = (cols + tileWidth - 1) / tileWidth;
+  if (gatherStats && elementType != ELEMENT_INT32) {
+    printf("--stats needs --type int32\n");
+    return 1;
+  }
+  if (gatherStats && !statsInit(&globalStats, statsK, histogramLow, histogramHigh)) {
+    printf("Could not allocate statistics for %d values and a histogram over [%d, %d)\n", statsK, histogramLow, histogramHigh);
+    return 1;
+  }
+
+  if (!matrixAllocTyped(&matrix, rows, cols, elementSize(elementType), hugePages)) {
+    printf("Could not allocate a %dx%d matrix\n", rows, cols);
+    return 1;
+  }
+
+  /* initialize the matrix, each thread generates a contiguous range of blocks so its pages are first touched by that thread */
+  generatorInit(&generator, distribution, 99, seed);
+  if (counting) perfPhase(&processCounters, &since, NULL);
+  start_time = omp_get_wtime();
+  #pragma omp parallel
+  {
+    long blocks = generatorBlocks((long) rows * cols);
+    int id = omp_get_thread_num(), threads = omp_get_num_threads();
+    generateBlocksTyped(&generator, matrix.data, elementType, rows, cols, matrix.stride, blocks * id / threads, blocks * (id + 1) / threads);
+  }
+  end_time = omp_get_wtime();
+  if (counting) perfPhase(&processCounters, &since, &generation);
+  printf("The generation time is %g sec (seed %llu, %s, %s)\n", end_time - start_time, seed, distributionName(distribution),
+         elementTypeName(elementType));
+
+  rowReduceInit(); /* pick the row kernel for this CPU before the parallel region */
+
+  if (elementType != ELEMENT_INT32) { /* Same reduction with the kernel for the element type */
+    if (counting) perfPhase(&processCounters, &since, NULL);
+    start_time = omp_get_wtime();
+    struct TypedResult typedResult = reduceTypedMatrix(tileWidth);
+    end_time = omp_get_wtime();
+    omp_get_schedule(&scheduleKind, &scheduleChunk);
+
+    printf("The total is ");
+    printScalar(stdout, elementType, typedResult.total);
+    printf("\nThe minimum value is ");
+    printScalar(stdout, elementType, typedResult.minimum);
+    printf(", located at %d,%d\nThe maximum value is ", typedResult.minRow, typedResult.minColumn);
+    printScalar(stdout, elementType, typedResult.maximum);
+    printf(", located at %d,%d\n", typedResult.maxRow, typedResult.maxColumn);
+    printf("The execution time is %g sec (%s kernel)\n", end_time - start_time, elementTypeName(elementType));
+    printf("The schedule is %s,%d with %d tiles of %d columns per row\n", scheduleName(scheduleKind), scheduleChunk, tiles, tileWidth);
+    if (counting) printCounters(false);
+    matrixFree(&matrix);
+    return 0;
+  }
 
-  printf("the total is %d\n", total);
+  if (counting) perfPhase(&processCounters, &since, NULL);
+  start_time = omp_get_wtime();
+  globalResult = reduceMatrix(tileWidth, gatherStats ? &globalStats : NULL);
+  end_time = omp_get_wtime(); /* after the region, so the time covers the reductions */
+  if (counting) perfPhase(&processCounters, &since, &merge);
+  omp_get_schedule(&scheduleKind, &scheduleChunk);
+
+  printf("the total is %lld\n", globalResult.total);
     printf("The minimum value is %d, located at %d,%d\n", globalResult.minimum, globalResult.minRow, globalResult.minColumn);
     printf("The maximum value is %d, located at %d,%d\n", globalResult.maximum, globalResult.maxRow, globalResult.maxColumn);
-    printf("The execution time is %g sec\n", end_time - start_time);
+    printf("The execution time is %g sec (%s kernel)\n", end_time - start_time, rowReduceName());
+    printf("The schedule is %s,%d with %d tiles of %d columns per row\n", scheduleName(scheduleKind), scheduleChunk, tiles, tileWidth);
+    if (gatherStats) {
+      statsPrint(&globalStats, stdout, printHistogram);
+      statsFree(&globalStats);
+    }
+    if (counting) printCounters(gatherStats);
+
+  matrixFree(&matrix);
 
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -1,14 +1,47 @@
 /* matrix summation, min asnd max using pthreads
 
    features: uses a bag of tasks and pthread_join before calculating the global min, max and sum in main thread.
+             The bag of tasks can be claimed in three ways (policy argument):
+               mutex  - one row at a time under nextRowLock (the original version)
+               chunk  - a fixed number of rows per claim from an atomic counter
+               guided - an atomic counter handing out chunks that shrink as the bag empties
+             Each row is reduced by the vectorized kernel in rowReduce.c, the total is kept in 64 bits.
+             The matrix is allocated on the heap with the requested rows and columns (matrix.c), --huge asks for transparent huge pages.
+             --file reduces a binary matrix file (matrixFile.h) instead of a random matrix. The main thread reads strips of rows
+             with pread into two buffers while the workers reduce the other one, so the matrix never has to fit in memory.
+             --mmap maps the file instead and lets the kernel page it in. --save writes the random matrix to a file.
+             The random matrix is generated in parallel by generator.c, --seed makes it reproducible for any number of workers
+             and --dist picks the distribution of the values.
+             The workers form a pool that is created once and parks on a condition variable between jobs. With --queries the
+             pool answers a batch of queries (one per line, "-" reads stdin) over the resident matrix and reports latency percentiles:
+               sum                       - the whole matrix
+               rows firstRow lastRow     - all columns of the rows, inclusive
+               rect row0 col0 row1 col1  - the rectangle with the two corners, inclusive
+               set row col value         - changes one element
+             --index builds a Fenwick tree of sums and a block min/max segment tree (matrixIndex.c) before the queries and
+             answers them from it instead of the pool, set then refreshes only the affected parts of the index.
+             --type stores the generated matrix as int8, uint16, int32 (default), int64, float or double and reduces it with the
+             kernel for that type (typedReduce.c), files, the index and set need int32.
+             --stats K also gathers the K largest and smallest values with their positions, the mean, the variance and a
+             histogram giving the exact median and 99th percentile (stats.c) while each row is in cache after the kernel,
+             every worker keeps its own and main merges them. --hist low:high sets the histogram domain and prints it.
+             matrixSumCore times one reduction for the benchmark driver bench.c, -DNO_MAIN leaves main out to link it there.
+             Compiled with -DTRACE and trace.c the workers record a timeline (trace.h): a claim span for every trip to the
+             bag of tasks and a rows span for the rows it returned, main records its wait for the job and the joins.
+             --counters reads hardware counters (perfCounters.c): cycles, instructions, LLC, branch and dTLB misses of
+             the whole process for the generation, the reduction and the merge, and of every worker in its own group
+             for its jobs, printed with IPC and misses per thousand instructions. Without counters it runs as usual.
    
    usage under Windows:
-     gcc -o matrixSum matrixSum.c -lpthread
-     matrixSum size numWorkers
+     gcc -O2 -o matrixSum matrixSum.c rowReduce.c matrix.c matrixFile.c generator.c matrixIndex.c typedReduce.c stats.c perfCounters.c -lpthread -lm
+     matrixSum [--huge] [--save path] [--seed n] [--dist name] [--type name] [--stats K [--hist low:high]] [--queries path [--index]] [--counters] size|rowsxcols numWorkers [mutex|chunk|guided] [chunkSize]
+     matrixSum --file path [--mmap] [--strip rows] [--stats K [--hist low:high]] [--queries path [--index]] [--counters] numWorkers [mutex|chunk|guided] [chunkSize]
 
    usage under Linux:
-     gcc matrixSum.c -lpthread
-     a.out size numWorkers
+     gcc -O2 matrixSum.c rowReduce.c matrix.c matrixFile.c generator.c matrixIndex.c typedReduce.c stats.c perfCounters.c -lpthread -lm
+     a.out [--huge] [--save path] [--seed n] [--dist name] [--type name] [--stats K [--hist low:high]] [--queries path [--index]] [--counters] size|rowsxcols numWorkers [mutex|chunk|guided] [chunkSize]
+     a.out --file path [--mmap] [--strip rows] [--stats K [--hist low:high]] [--queries path [--index]] [--counters] numWorkers [mutex|chunk|guided] [chunkSize]
+     gcc -O2 -DTRACE matrixSum.c trace.c ... then TRACEFILE=matrixSum.json ./a.out 4000 4 writes the timeline
 
 */
 #ifndef _REENTRANT 
@@ -18,170 +51,774 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
 #include <time.h>
-#include <sys/time.h>
-#define MAXSIZE 10000  /* maximum matrix size */
+#include <math.h>
+#include "rowReduce.h"
+#include "matrix.h"
+#include "matrixFile.h"
+#include "generator.h"
+#include "result.h"
+#include "matrixIndex.h"
+#include "typedReduce.h"
+#include "stats.h"
+#include "benchCore.h"
+#include "trace.h"
+#include "perfCounters.h"
+#define MAXSIZE 10000  /* default matrix size */
 #define MAXWORKERS 10   /* maximum number of workers */
+#define CACHELINE 64    /* size of a cache line in bytes */
+#define DEFAULTCHUNK 16 /* default number of rows handed out per claim */
+#define NUMSTRIPS 2     /* strip buffers when streaming a file, one is read while the other is reduced */
+#define STRIPBYTES (64 * 1024 * 1024) /* default size of one strip buffer */
+#define MAXLINE 256     /* longest query line */
 
-pthread_mutex_t nextRowLock; /* Mutex to protect accessing the nextRow variable */
+/* the ways a worker can claim rows from the bag of tasks */
+enum Policy { POLICY_MUTEX, POLICY_CHUNK, POLICY_GUIDED };
+
+pthread_mutex_t nextRowLock = PTHREAD_MUTEX_INITIALIZER; /* Mutex to protect accessing the nextRow variable */
 int nextRow = 0; /* Global variable to keep track of next row to work on in the matrix, this is the bag of tasks */
+atomic_int nextChunk = 0; /* Lock free version of the bag of tasks used by the chunk and guided policies */
+enum Policy policy = POLICY_MUTEX;
+int chunkSize = DEFAULTCHUNK; /* Rows per claim for the chunk policy, smallest chunk for the guided policy */
 
-/* timer */
-double read_timer() {
-    static bool initialized = false;
-    static struct timeval start;
-    struct timeval end;
-    if( !initialized )
-    {
-        gettimeofday( &start, NULL );
-        initialized = true;
-    }
-    gettimeofday( &end, NULL );
-    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
-}
-
-/* struct to encapsulate the result, returns total sum, min value and its position, max value and its position */
-struct Result {
-  int total;
-  int minimum;
-  int minRow;
-  int minColumn;
-  int maximum;
-  int maxRow;
-  int maxColumn;
+/* A buffer holding rows [first, first + count) of the file while streaming */
+struct Strip {
+  struct Matrix buffer;
+  int first;
+  int count;
+  atomic_int loaded;  /* index of the strip in the buffer, -1 before the first read */
+  atomic_int pending; /* rows of the loaded strip that are not reduced yet, the buffer can be reused when it reaches 0 */
 };
 
-double start_time, end_time; /* start and end times */
-int size, numWorkers;  /* assume size is multiple of numWorkers */
-int matrix[MAXSIZE][MAXSIZE]; /* matrix */
+bool streaming = false; /* true when the rows come from strips of a file instead of the resident matrix */
+int stripRows;
+struct Strip strips[NUMSTRIPS];
+struct MatrixFile inputFile;
+pthread_mutex_t stripLock = PTHREAD_MUTEX_INITIALIZER; /* Protects the waits below, the strip state itself is atomic */
+pthread_cond_t stripLoaded = PTHREAD_COND_INITIALIZER, /* Signalled by the reader when a strip has been read */
+               stripFree = PTHREAD_COND_INITIALIZER;   /* Signalled by the worker that reduces the last row of a strip */
+
+/* One reduction handed to the pool, the rectangle [firstRow, endRow) x [firstColumn, endColumn) */
+struct Job {
+  int firstRow, endRow;
+  int firstColumn, endColumn;
+};
+
+struct Job job;           /* The current job, only changed by main while all workers are parked */
+int jobNumber = 0;        /* Incremented for every new job, workers compare it with the last job they did */
+int workersDone = 0;      /* Workers that have finished the current job */
+bool poolShutdown = false;
+pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER; /* Protects the four variables above */
+pthread_cond_t jobPosted = PTHREAD_COND_INITIALIZER, jobFinished = PTHREAD_COND_INITIALIZER;
+
+/* timer, monotonic so adjustments of the wall clock do not end up in the times */
+static double read_timer() {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return now.tv_sec + 1.0e-9 * now.tv_nsec;
+}
+
+/* Result padded to a full cache line so workers updating their own result do not invalidate each other's lines */
+struct PaddedResult {
+  union {
+    struct Result result;     /* used for int32 matrices */
+    struct TypedResult typed; /* used for the other element types */
+  };
+} __attribute__((aligned(CACHELINE)));
+
+static double start_time, end_time; /* start and end times */
+static int rows, cols, numWorkers;
+static struct Matrix matrix; /* matrix, allocated in main */
+struct PaddedResult results[MAXWORKERS]; /* one result per worker, merged by main when a job is finished */
+bool readOnly = false;   /* true when the matrix is a read only mapping of a file */
+bool useIndex = false;   /* true when queries are answered from index instead of the pool */
+struct MatrixIndex matrixIndex;
+enum ElementType elementType = ELEMENT_INT32;
+TypedRowKernel typedKernel; /* kernel for elementType when it is not int32 */
+
+/* Statistics padded like the results, the fields a worker updates per row would otherwise share lines with its neighbours */
+struct PaddedStats {
+  struct Stats stats;
+} __attribute__((aligned(CACHELINE)));
+
+bool gatherStats = false; /* true with --stats */
+struct PaddedStats workerStats[MAXWORKERS];
+
+bool counting = false;               /* true with --counters once the counters of the process are open */
+struct PerfCounters processCounters; /* opened by main before any other thread, so they count every thread */
+struct PerfSample workerCounts[MAXWORKERS]; /* what each worker counted over its jobs, in its own group */
 
 void *Worker(void *);
 
+/* Returns row i, when streaming it waits until the strip holding the row has been read. Rows are claimed in increasing order
+   so the strip a worker waits for is never held up by rows that the same worker has claimed */
+const int *getRow(int i) {
+  if (!streaming) return matrixRow(&matrix, i);
+  int index = i / stripRows;
+  struct Strip *strip = &strips[index % NUMSTRIPS];
+  if (atomic_load_explicit(&strip->loaded, memory_order_acquire) != index) {
+    pthread_mutex_lock(&stripLock);
+    while (atomic_load_explicit(&strip->loaded, memory_order_acquire) != index) {
+      pthread_cond_wait(&stripLoaded, &stripLock);
+    }
+    pthread_mutex_unlock(&stripLock);
+  }
+  return matrixRow(&strip->buffer, i - strip->first);
+}
+
+/* Marks row i as reduced, the worker finishing the last row of a strip tells the reader that the buffer is free */
+void rowDone(int i) {
+  if (!streaming) return;
+  struct Strip *strip = &strips[(i / stripRows) % NUMSTRIPS];
+  if (atomic_fetch_sub_explicit(&strip->pending, 1, memory_order_acq_rel) == 1) {
+    pthread_mutex_lock(&stripLock);
+    pthread_cond_broadcast(&stripFree);
+    pthread_mutex_unlock(&stripLock);
+  }
+}
+
+/* Run by the main thread while the workers reduce: reads every strip of the file into the next free buffer */
+bool readStrips() {
+  int numStrips = (rows + stripRows - 1) / stripRows;
+  for (int index = 0; index < numStrips; index++) {
+    struct Strip *strip = &strips[index % NUMSTRIPS];
+    pthread_mutex_lock(&stripLock); /* Wait for the workers to finish the strip that used this buffer before */
+    while (atomic_load_explicit(&strip->pending, memory_order_acquire) > 0) {
+      pthread_cond_wait(&stripFree, &stripLock);
+    }
+    pthread_mutex_unlock(&stripLock);
+
+    strip->first = index * stripRows;
+    strip->count = (strip->first + stripRows < rows) ? stripRows : rows - strip->first;
+    if (!matrixFileReadRows(&inputFile, strip->first, strip->count, &strip->buffer)) {
+      printf("Read of rows %d to %d failed\n", strip->first, strip->first + strip->count - 1);
+      return false; /* The workers are stuck waiting for this strip, main exits the process */
+    }
+    atomic_store_explicit(&strip->pending, strip->count, memory_order_relaxed);
+
+    pthread_mutex_lock(&stripLock);
+    atomic_store_explicit(&strip->loaded, index, memory_order_release);
+    pthread_cond_broadcast(&stripLoaded);
+    pthread_mutex_unlock(&stripLock);
+  }
+  return true;
+}
+
+/* Claims the next range of rows [*first, *last) from the bag of tasks according to the chosen policy, returns false when the bag is empty */
+bool claimRows(int *first, int *last) {
+  int start, count, remaining;
+  switch (policy) {
+  case POLICY_MUTEX:
+    pthread_mutex_lock(&nextRowLock);
+    if (nextRow >= job.endRow) { /* If the newRow counter has reached the size of the matrix it is time for the threads to break while loop and return results */
+      pthread_mutex_unlock(&nextRowLock);
+      return false;
+    }
+    start = nextRow; /* Lock is acquired and there are still rows to be worked on, thread takes the nextRow, increases the counter and releases the lock for next thread */
+    nextRow++;
+    pthread_mutex_unlock(&nextRowLock);
+    count = 1;
+    break;
+  case POLICY_CHUNK:
+    start = atomic_fetch_add_explicit(&nextChunk, chunkSize, memory_order_relaxed); /* Counter may run past size, threads that see this simply stop */
+    if (start >= job.endRow) return false;
+    count = chunkSize;
+    break;
+  case POLICY_GUIDED:
+    start = atomic_load_explicit(&nextChunk, memory_order_relaxed);
+    do { /* Chunk is the remaining rows split over the workers, but never smaller than chunkSize, retry if another worker moved the counter */
+      remaining = job.endRow - start;
+      if (remaining <= 0) return false;
+      count = remaining / numWorkers;
+      if (count < chunkSize) count = chunkSize;
+    } while (!atomic_compare_exchange_weak_explicit(&nextChunk, &start, start + count, memory_order_relaxed, memory_order_relaxed));
+    break;
+  default:
+    return false;
+  }
+  *first = start;
+  *last = (start + count < job.endRow) ? start + count : job.endRow;
+  return true;
+}
+
+/* Hands a job to the parked workers, resets the bag of tasks to the rows of the job */
+void postJob(int firstRow, int endRow, int firstColumn, int endColumn) {
+  pthread_mutex_lock(&poolLock);
+  job.firstRow = firstRow;
+  job.endRow = endRow;
+  job.firstColumn = firstColumn;
+  job.endColumn = endColumn;
+  nextRow = firstRow;
+  atomic_store_explicit(&nextChunk, firstRow, memory_order_relaxed);
+  workersDone = 0;
+  jobNumber++;
+  pthread_cond_broadcast(&jobPosted);
+  pthread_mutex_unlock(&poolLock);
+}
+
+/* Waits until every worker has finished the current job */
+void waitJob() {
+  TRACE_START(waited);
+  pthread_mutex_lock(&poolLock);
+  while (workersDone < numWorkers) {
+    pthread_cond_wait(&jobFinished, &poolLock);
+  }
+  pthread_mutex_unlock(&poolLock);
+  TRACE_SPAN("waitJob", waited, -1);
+}
+
+/* Waits for the current job and merges the worker results of an int32 matrix */
+struct Result finishJob() {
+  struct Result globalResult;
+  resultInit(&globalResult); /* the matrix may not be in memory yet so min and max start at the extremes */
+  waitJob();
+  for (int k = 0; k < numWorkers; k++) {
+    mergeResult(&globalResult, &results[k].result);
+  }
+  return globalResult;
+}
+
+/* Waits for the current job and merges the worker results of a matrix of another element type */
+struct TypedResult finishTypedJob() {
+  struct TypedResult globalResult;
+  typedResultInit(elementType, &globalResult);
+  waitJob();
+  for (int k = 0; k < numWorkers; k++) {
+    typedMergeResult(elementType, &globalResult, &results[k].typed);
+  }
+  return globalResult;
+}
+
+/* Prints the total, min and max of a typed result with the given separators */
+void printTypedResult(const struct TypedResult *result) {
+  printf("total ");
+  printScalar(stdout, elementType, result->total);
+  printf(", min ");
+  printScalar(stdout, elementType, result->minimum);
+  printf(" at %d,%d, max ", result->minRow, result->minColumn);
+  printScalar(stdout, elementType, result->maximum);
+  printf(" at %d,%d", result->maxRow, result->maxColumn);
+}
+
+int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* Reads queries from in, answers each with the pool and prints the result and the latency percentiles. If the
+   latencies run out of memory the percentiles cover the queries recorded until then, the mean still covers all */
+void runQueries(FILE *in) {
+  char line[MAXLINE], command[16];
+  int r0, c0, r1, c1, fields, count = 0, recorded = 0, capacity = 1024;
+  double *latencies = malloc(capacity * sizeof(double));
+  bool recording = latencies != NULL;
+  double total = 0;
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    fields = sscanf(line, "%15s %d %d %d %d", command, &r0, &c0, &r1, &c1);
+    if (fields < 1 || command[0] == '#') continue; /* Blank line or comment */
+    if (strcmp(command, "sum") == 0 && fields == 1) {
+      r0 = 0; r1 = rows - 1; c0 = 0; c1 = cols - 1;
+    } else if (strcmp(command, "rows") == 0 && fields == 3) {
+      r1 = c0; c0 = 0; c1 = cols - 1;
+    } else if (strcmp(command, "rect") == 0 && fields == 5) {
+      /* corners already in place */
+    } else if (strcmp(command, "set") == 0 && fields == 4) {
+      if (readOnly || elementType != ELEMENT_INT32 || r0 < 0 || c0 < 0 || r0 >= rows || c0 >= cols) {
+        printf("Cannot set %d,%d: %s", r0, c0, readOnly ? "the matrix is read only\n"
+               : elementType != ELEMENT_INT32 ? "set needs an int32 matrix\n" : "outside the matrix\n");
+        continue;
+      }
+      double queryStart = read_timer();
+      if (useIndex) indexUpdate(&matrixIndex, r0, c0, r1); /* r1 holds the value */
+      else matrixRow(&matrix, r0)[c0] = r1; /* The workers are parked so main can write the matrix */
+      printf("set %d,%d to %d, %g sec\n", r0, c0, r1, read_timer() - queryStart);
+      continue;
+    } else {
+      printf("Invalid query: %s", line);
+      continue;
+    }
+    if (r0 < 0 || c0 < 0 || r1 >= rows || c1 >= cols || r0 > r1 || c0 > c1) {
+      printf("Query outside the %dx%d matrix: %s", rows, cols, line);
+      continue;
+    }
+
+    double queryStart = read_timer();
+    struct Result result;
+    struct TypedResult typed;
+    if (useIndex) {
+      result = indexQuery(&matrixIndex, r0, c0, r1, c1);
+    } else {
+      postJob(r0, r1 + 1, c0, c1 + 1);
+      if (elementType == ELEMENT_INT32) result = finishJob();
+      else typed = finishTypedJob();
+    }
+    double latency = read_timer() - queryStart;
+
+    if (recording && recorded == capacity) {
+      double *grown = realloc(latencies, 2 * capacity * sizeof(double));
+      if (grown != NULL) {
+        latencies = grown;
+        capacity *= 2;
+      } else {
+        recording = false;
+      }
+    }
+    if (recording) latencies[recorded++] = latency;
+    count++;
+    total += latency;
+    if (elementType == ELEMENT_INT32) {
+      printf("%s %d,%d-%d,%d: total %lld, min %d at %d,%d, max %d at %d,%d, %g sec\n", command, r0, c0, r1, c1, result.total,
+             result.minimum, result.minRow, result.minColumn, result.maximum, result.maxRow, result.maxColumn, latency);
+    } else {
+      printf("%s %d,%d-%d,%d: ", command, r0, c0, r1, c1);
+      printTypedResult(&typed);
+      printf(", %g sec\n", latency);
+    }
+  }
+
+  if (count > 0) {
+    printf("%d queries, mean %g sec", count, total / count);
+    if (recorded > 0) {
+      qsort(latencies, recorded, sizeof(double), compareDoubles);
+      printf(", p50 %g sec, p90 %g sec, p99 %g sec, max %g sec", latencies[(recorded - 1) * 50 / 100],
+             latencies[(recorded - 1) * 90 / 100], latencies[(recorded - 1) * 99 / 100], latencies[recorded - 1]);
+    }
+    if (recorded < count) printf(" (out of memory for the latencies, the percentiles cover %d queries)", recorded);
+    printf("\n");
+  }
+  free(latencies);
+}
+
+/* Tells the workers to leave and joins them */
+void stopWorkers(pthread_t workerid[]) {
+  pthread_mutex_lock(&poolLock);
+  poolShutdown = true;
+  pthread_cond_broadcast(&jobPosted);
+  pthread_mutex_unlock(&poolLock);
+  TRACE_START(joined);
+  for (long k = 0; k < numWorkers; k++){
+    pthread_join(workerid[k], NULL);
+  }
+  TRACE_SPAN("join", joined, numWorkers);
+}
+
+/* One benchmark run (benchCore.h): a square int32 matrix of about run->size elements reduced by a fresh pool with the
+   default policy, timed like main from creating the pool to joining it. Checked against a plain sequential loop */
+bool matrixSumCore(struct BenchRun *run) {
+  struct Generator generator;
+  pthread_t workerid[MAXWORKERS];
+  struct Result globalResult, expected;
+  rows = cols = run->size > 1 ? (int) sqrt((double) run->size) : 1;
+  numWorkers = run->threads < 1 ? 1 : run->threads > MAXWORKERS ? MAXWORKERS : run->threads;
+  run->threads = numWorkers;
+  streaming = poolShutdown = gatherStats = useIndex = false;
+  elementType = ELEMENT_INT32;
+  jobNumber = 0; /* new workers start from job 0 */
+  if (!matrixAlloc(&matrix, rows, cols, false)) return false;
+  generatorInit(&generator, run->distribution, 99, run->seed);
+  generateMatrix(&generator, &matrix, numWorkers);
+  rowReduceInit();
+
+  start_time = read_timer();
+  for (long l = 0; l < numWorkers; l++) {
+    pthread_create(&workerid[l], NULL, Worker, (void *) l);
+  }
+  postJob(0, rows, 0, cols);
+  globalResult = finishJob();
+  stopWorkers(workerid);
+  end_time = read_timer();
+
+  resultInit(&expected);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      struct Result element = { matrixRow(&matrix, i)[j], matrixRow(&matrix, i)[j], i, j, matrixRow(&matrix, i)[j], i, j };
+      mergeResult(&expected, &element);
+    }
+  }
+  run->seconds = end_time - start_time;
+  run->checksum = globalResult.total;
+  run->correct = memcmp(&globalResult, &expected, sizeof(struct Result)) == 0;
+  matrixFree(&matrix);
+  return true;
+}
+
+#ifndef NO_MAIN
 /* read command line, initialize, and create threads */
 int main(int argc, char *argv[]) {
-  int i, j;
   long l,k; /* use long in case of a 64-bit system */
+  bool hugePages = false, mapFile = false;
+  const char *inputPath = NULL, *savePath = NULL, *queryPath = NULL;
+  int statsK = 0, histogramLow = HISTOGRAMLOW, histogramHigh = HISTOGRAMHIGH;
+  bool printHistogram = false;
+  struct Stats globalStats;
+  static struct option options[] = {
+    { "huge", no_argument, NULL, 'H' },
+    { "file", required_argument, NULL, 'f' },
+    { "mmap", no_argument, NULL, 'm' },
+    { "strip", required_argument, NULL, 's' },
+    { "save", required_argument, NULL, 'o' },
+    { "seed", required_argument, NULL, 'S' },
+    { "dist", required_argument, NULL, 'd' },
+    { "queries", required_argument, NULL, 'q' },
+    { "index", no_argument, NULL, 'x' },
+    { "type", required_argument, NULL, 't' },
+    { "stats", required_argument, NULL, 'k' },
+    { "hist", required_argument, NULL, 'g' },
+    { "counters", no_argument, NULL, 'c' },
+    { NULL, 0, NULL, 0 }
+  };
+  int option, arg;
+  unsigned long long seed = time(NULL); /* Random seed so the matrix is not identical each time unless --seed is given */
+  enum Distribution distribution = DIST_UNIFORM;
+  struct Generator generator;
   pthread_attr_t attr;
   pthread_t workerid[MAXWORKERS];
   struct Result globalResult;
-  srand(time(NULL)); /* Added to get random seed so the matrix is not identical each time */
+  struct TypedResult typedResult;
+  struct PerfSample since, generation, compute, merge; /* counts of the phases, all threads */
 
   /* set global thread attributes */
   pthread_attr_init(&attr);
   pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
 
-  /* initialize mutex and condition variable */
-  pthread_mutex_init(&nextRowLock, NULL);
+  /* read command line options, the remaining args are positional */
+  stripRows = 0;
+  while ((option = getopt_long(argc, argv, "Hf:ms:o:S:d:q:xt:k:g:c", options, NULL)) != -1) {
+    switch (option) {
+    case 'H': hugePages = true; break;
+    case 'c': counting = true; break;
+    case 'f': inputPath = optarg; break;
+    case 'm': mapFile = true; break;
+    case 's': stripRows = atoi(optarg); break;
+    case 'o': savePath = optarg; break;
+    case 'q': queryPath = optarg; break;
+    case 'x': useIndex = true; break;
+    case 't':
+      if (!parseElementType(optarg, &elementType)) {
+        printf("Unknown type %s, expected int8, uint16, int32, int64, float or double\n", optarg);
+        return 1;
+      }
+      break;
+    case 'k':
+      gatherStats = true;
+      statsK = atoi(optarg);
+      break;
+    case 'g':
+      if (sscanf(optarg, "%d:%d", &histogramLow, &histogramHigh) != 2) {
+        printf("Invalid histogram domain %s, expected low:high\n", optarg);
+        return 1;
+      }
+      printHistogram = true;
+      break;
+    case 'S': seed = strtoull(optarg, NULL, 0); break;
+    case 'd':
+      if (!parseDistribution(optarg, &distribution)) {
+        printf("Unknown distribution %s, expected uniform, sorted, reverse, few or zipf\n", optarg);
+        return 1;
+      }
+      break;
+    default: return 1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
 
-  /* read command line args if any */
-  size = (argc > 1)? atoi(argv[1]) : MAXSIZE;
-  numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
-  if (size > MAXSIZE) size = MAXSIZE;
+  /* read command line args if any, a file brings its own size so the size argument is left out */
+  arg = 1;
+  rows = cols = MAXSIZE;
+  if (inputPath == NULL) {
+    if (argc > arg && !parseDimensions(argv[arg], &rows, &cols)) {
+      printf("Invalid matrix size %s, expected size or rowsxcols\n", argv[arg]);
+      return 1;
+    }
+    arg++;
+  }
+  numWorkers = (argc > arg)? atoi(argv[arg]) : MAXWORKERS;
   if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
-
-  /* initialize the matrix */
-  for (i = 0; i < size; i++) {
-	  for (j = 0; j < size; j++) {
-          matrix[i][j] = rand()%99;
-	  }
+  arg++;
+  if (argc > arg) {
+    if (strcmp(argv[arg], "mutex") == 0) policy = POLICY_MUTEX;
+    else if (strcmp(argv[arg], "chunk") == 0) policy = POLICY_CHUNK;
+    else if (strcmp(argv[arg], "guided") == 0) policy = POLICY_GUIDED;
+    else {
+      printf("Unknown policy %s, expected mutex, chunk or guided\n", argv[arg]);
+      return 1;
+    }
+  }
+  arg++;
+  chunkSize = (argc > arg)? atoi(argv[arg]) : DEFAULTCHUNK;
+  if (chunkSize < 1) chunkSize = 1;
+  if (elementType != ELEMENT_INT32 && (inputPath != NULL || useIndex || savePath != NULL)) {
+    printf("--file, --index and --save need --type int32\n");
+    return 1;
+  }
+  if (gatherStats && (elementType != ELEMENT_INT32 || queryPath != NULL)) {
+    printf("--stats needs --type int32 and cannot be used with --queries\n");
+    return 1;
+  }
+  if (gatherStats) {
+    for (k = 0; k < numWorkers; k++) {
+      if (!statsInit(&workerStats[k].stats, statsK, histogramLow, histogramHigh)) {
+        printf("Could not allocate statistics for %d values and a histogram over [%d, %d)\n", statsK, histogramLow, histogramHigh);
+        return 1;
+      }
+    }
+    if (!statsInit(&globalStats, statsK, histogramLow, histogramHigh)) {
+      printf("Could not allocate statistics for %d values and a histogram over [%d, %d)\n", statsK, histogramLow, histogramHigh);
+      return 1;
+    }
+  }
+  typedKernel = typedRowKernel(elementType);
+  if (counting && !perfOpen(&processCounters, true)) {
+    printf("Hardware counters unavailable (%s), running without them\n", strerror(processCounters.error));
+    counting = false;
+  }
+  if (counting) {
+    for (k = 0; k < numWorkers; k++) perfZero(&workerCounts[k]);
   }
 
-  /* Initialize the Result struct */
-  globalResult.total = 0;
-  globalResult.minimum = matrix[0][0];
-  globalResult.minRow = 0;
-  globalResult.minColumn = 0;
-  globalResult.maximum = matrix[0][0];
-  globalResult.maxRow = 0;
-  globalResult.maxColumn = 0;
+  if (inputPath != NULL) {
+    if (!matrixFileOpen(&inputFile, inputPath)) return 1;
+    rows = inputFile.rows;
+    cols = inputFile.cols;
+    if (mapFile) {
+      if (!matrixFileMap(&inputFile, &matrix)) return 1;
+      readOnly = true;
+    } else if (queryPath != NULL) {
+      printf("Queries need the whole matrix in memory, use --mmap with --file\n");
+      return 1;
+    } else {
+      streaming = true;
+      if (stripRows <= 0) stripRows = STRIPBYTES / ((long) cols * sizeof(int));
+      if (stripRows < 1) stripRows = 1;
+      if (stripRows > rows) stripRows = rows;
+      for (k = 0; k < NUMSTRIPS; k++) {
+        if (!matrixAlloc(&strips[k].buffer, stripRows, cols, hugePages)) {
+          printf("Could not allocate a %dx%d strip\n", stripRows, cols);
+          return 1;
+        }
+        atomic_init(&strips[k].loaded, -1);
+        atomic_init(&strips[k].pending, 0);
+      }
+    }
+  } else {
+    if (!matrixAllocTyped(&matrix, rows, cols, elementSize(elementType), hugePages)) {
+      printf("Could not allocate a %dx%d matrix\n", rows, cols);
+      return 1;
+    }
+
+    /* initialize the matrix, the workers that will reduce it also generate it so its pages are placed near them */
+    generatorInit(&generator, distribution, 99, seed);
+    if (counting) perfPhase(&processCounters, &since, NULL);
+    start_time = read_timer();
+    generateMatrixTyped(&generator, &matrix, elementType, numWorkers);
+    end_time = read_timer();
+    if (counting) perfPhase(&processCounters, &since, &generation);
+    printf("The generation time is %g sec (seed %llu, %s, %s)\n", end_time - start_time, seed, distributionName(distribution),
+           elementTypeName(elementType));
+    if (savePath != NULL && !matrixFileWrite(savePath, &matrix)) return 1;
+  }
 
   /* print the matrix */
  #ifdef DEBUG
-  for (i = 0; i < size; i++) {
+  for (int i = 0; i < rows && !streaming && elementType == ELEMENT_INT32; i++) {
 	  printf("[ ");
-	  for (j = 0; j < size; j++) {
-	    printf(" %d", matrix[i][j]);
+	  for (int j = 0; j < cols; j++) {
+	    printf(" %d", matrixRow(&matrix, i)[j]);
 	  }
 	  printf(" ]\n");
   }
  #endif
 
-  /* do the parallel work: create the workers */
+  rowReduceInit(); /* pick the row kernel for this CPU before the workers start */
+
+  /* do the parallel work: create the pool of workers, they park until a job is posted */
+  if (counting) perfPhase(&processCounters, &since, NULL);
   start_time = read_timer();
   for (l = 0; l < numWorkers; l++) {
     pthread_create(&workerid[l], &attr, Worker, (void *) l);
   }
-  for (k = 0; k < numWorkers; k++){
-    struct Result *threadResult;
-    pthread_join(workerid[k], (void **) &threadResult);
-    globalResult.total += threadResult->total;
-      if (threadResult->minimum < globalResult.minimum){
-        globalResult.minimum = threadResult->minimum;
-        globalResult.minRow = threadResult->minRow;
-        globalResult.minColumn = threadResult->minColumn;
+  if (queryPath != NULL) {
+    FILE *in = strcmp(queryPath, "-") == 0 ? stdin : fopen(queryPath, "r");
+    if (in == NULL) {
+      perror(queryPath);
+      return 1;
+    }
+    if (useIndex) {
+      double buildStart = read_timer();
+      if (!indexBuild(&matrixIndex, &matrix, numWorkers)) {
+        printf("Could not allocate the index\n");
+        return 1;
       }
-      if (threadResult->maximum > globalResult.maximum){
-        globalResult.maximum = threadResult->maximum;
-        globalResult.maxRow = threadResult->maxRow;
-        globalResult.maxColumn = threadResult->maxColumn;
+      printf("The index build time is %g sec\n", read_timer() - buildStart);
+    }
+    runQueries(in);
+    if (counting) perfPhase(&processCounters, &since, &compute);
+    if (in != stdin) fclose(in);
+    if (useIndex) indexFree(&matrixIndex);
+  } else {
+    postJob(0, rows, 0, cols);
+    if (streaming && !readStrips()) return 1;
+    if (counting) { /* the reduction ends when the workers are done, finishJob then only merges */
+      waitJob();
+      perfPhase(&processCounters, &since, &compute);
+    }
+    if (elementType == ELEMENT_INT32) globalResult = finishJob();
+    else typedResult = finishTypedJob();
+    if (gatherStats) { /* merged before the end time so the reported time covers the statistics */
+      for (k = 0; k < numWorkers; k++) {
+        statsMerge(&globalStats, &workerStats[k].stats);
       }
-    free(threadResult);
+    }
+    if (counting) perfPhase(&processCounters, &since, &merge);
   }
+
+  /* shut the pool down */
+  stopWorkers(workerid);
       /* get end time */
     end_time = read_timer();
-    /* print results */
-    printf("The total is %d\n", globalResult.total);
-    printf("The minimum value is %d, located at %d,%d\n", globalResult.minimum, globalResult.minRow, globalResult.minColumn);
-    printf("The maximum value is %d, located at %d,%d\n", globalResult.maximum, globalResult.maxRow, globalResult.maxColumn);
-    printf("The execution time is %g sec\n", end_time - start_time);
+    /* print results, the queries have printed their own */
+    if (queryPath == NULL && elementType != ELEMENT_INT32) {
+      printf("The result is ");
+      printTypedResult(&typedResult);
+      printf("\nThe execution time is %g sec (%s kernel)\n", end_time - start_time, elementTypeName(elementType));
+    } else if (queryPath == NULL) {
+      printf("The total is %lld\n", globalResult.total);
+      printf("The minimum value is %d, located at %d,%d\n", globalResult.minimum, globalResult.minRow, globalResult.minColumn);
+      printf("The maximum value is %d, located at %d,%d\n", globalResult.maximum, globalResult.maxRow, globalResult.maxColumn);
+      printf("The execution time is %g sec (%s kernel)\n", end_time - start_time, rowReduceName());
+      if (inputPath != NULL) {
+        printf("Read %.1f MB at %.1f MB/s\n", (double) rows * cols * sizeof(int) / 1e6, (double) rows * cols * sizeof(int) / 1e6 / (end_time - start_time));
+      }
+      if (gatherStats) statsPrint(&globalStats, stdout, printHistogram);
+    }
+    if (counting) {
+      struct PerfSample workers;
+      char title[32];
+      printf("Counters per phase, all threads:\n");
+      if (inputPath == NULL) perfPrint(&generation, "  generation");
+      perfPrint(&compute, queryPath == NULL ? "  reduction" : "  queries");
+      if (queryPath == NULL) perfPrint(&merge, "  merge");
+      printf("Counters per worker, its jobs only:\n");
+      perfZero(&workers);
+      for (k = 0; k < numWorkers; k++) {
+        snprintf(title, sizeof(title), "  worker %ld", k);
+        perfPrint(&workerCounts[k], title);
+        perfAdd(&workers, &workerCounts[k]);
+      }
+      perfPrint(&workers, "  all workers");
+      perfClose(&processCounters);
+    }
+    if (gatherStats) {
+      for (k = 0; k < numWorkers; k++) {
+        statsFree(&workerStats[k].stats);
+      }
+      statsFree(&globalStats);
+    }
+
+    if (inputPath != NULL) {
+      matrixFileClose(&inputFile);
+      for (k = 0; k < NUMSTRIPS; k++) {
+        matrixFree(&strips[k].buffer);
+      }
+    } else {
+      matrixFree(&matrix);
+    }
 }
+#endif
 
-/* Each worker sums the values in one strip of the matrix.
-   After a barrier, worker(0) computes and prints the total */
+/* Each worker waits for a job, then takes rows from the bag of tasks and reduces the columns of the job in them.
+   The result goes to the worker's own slot in results and main merges the slots once every worker is done */
 void *Worker(void *arg) {
   long myid = (long) arg;
-  int i, j;
-  struct Result *result = malloc(sizeof(struct Result)); /* pthread_join expects a pointer to the result so result is initialized as a pointer */
+  int i, first, last, seen = 0, width;
+  struct RowReduction row;
+  struct Result *result = &results[myid].result; /* each worker owns its own padded slot */
+  struct PerfCounters counters; /* the counts of this thread alone */
+  struct PerfSample jobStart, jobCounts;
+  TRACE_THREAD("worker", myid);
+  if (counting) perfOpen(&counters, false);
 
 #ifdef DEBUG
   printf("worker %d (pthread id %d) has started\n", myid, pthread_self());
 #endif
 
-  /* initialize struct with values, since result is a pointer we have to use -> to access the members of the struct */
-  result->total = 0;
-  result->minimum = matrix[0][0];
-  result->minRow = 0;
-  result->minColumn = 0;
-  result->maximum = matrix[0][0];
-  result->maxRow = 0;
-  result->maxColumn = 0;
-
-  while (true){  
-    pthread_mutex_lock(&nextRowLock);
-    if (nextRow >= size) { /* If the newRow counter has reached the size of the matrix it is time for the threads to break while loop and return results */
-      pthread_mutex_unlock(&nextRowLock);
+  while (true) {
+    pthread_mutex_lock(&poolLock); /* Park until main posts a job this worker has not done yet */
+    while (jobNumber == seen && !poolShutdown) {
+      pthread_cond_wait(&jobPosted, &poolLock);
+    }
+    if (poolShutdown) {
+      pthread_mutex_unlock(&poolLock);
       break;
     }
-    i = nextRow; /* Lock is acquired and there are still rows to be worked on, thread takes the nextRow, increases the counter and releases the lock for next thread */
-    nextRow++;
-    pthread_mutex_unlock(&nextRowLock);
+    seen = jobNumber;
+    pthread_mutex_unlock(&poolLock);
+    if (counting) perfRead(&counters, &jobStart);
+
+    width = job.endColumn - job.firstColumn;
+    TRACE_START(traced); /* a claim span for every trip to the bag, a rows span for the rows it handed out */
 
-    /* sum values, calculates min and max */
-    for (j = 0; j < size; j++) {
-      result->total += matrix[i][j]; /* Updates partial sum */
-      if (matrix[i][j] < result->minimum){ /* Checks if current entry is smaller than min, if so it is recorded */
-        result->minimum = matrix[i][j];
-        result->minRow = i;
-        result->minColumn = j;
+    if (elementType != ELEMENT_INT32) { /* Same loop with the kernel for the element type */
+      struct TypedReduction typedRow;
+      typedResultInit(elementType, &results[myid].typed);
+      while (claimRows(&first, &last)) {
+        TRACE_SPAN("claim", traced, -1);
+        TRACE_RESET(traced);
+        for (i = first; i < last; i++) {
+          typedKernel((char *) matrixRowBytes(&matrix, i) + (long) job.firstColumn * matrix.elementSize, width, &typedRow);
+          typedMergeRow(elementType, &results[myid].typed, &typedRow, i, job.firstColumn);
+        }
+        TRACE_SPAN("rows", traced, last - first);
+        TRACE_RESET(traced);
       }
-      if (matrix[i][j] > result->maximum){ /* Check if current entry is larger than max, if so it is recorded */
-        result->maximum = matrix[i][j];
-        result->maxRow = i;
-        result->maxColumn = j;
+    } else {
+      resultInit(result); /* each job starts from an empty result */
+      if (gatherStats) statsReset(&workerStats[myid].stats);
+      while (claimRows(&first, &last)) { /* Keep taking rows from the bag of tasks until it is empty */
+        TRACE_SPAN("claim", traced, -1);
+        TRACE_RESET(traced);
+        /* sum values, calculates min and max */
+        for (i = first; i < last; i++) {
+          const int *values = getRow(i) + job.firstColumn;
+          reduceRow(values, width, &row);
+          if (gatherStats) statsAddRow(&workerStats[myid].stats, values, width, i, job.firstColumn); /* the row is still in cache */
+          result->total += row.total; /* Updates partial sum */
+          if (row.minimum < result->minimum){ /* Checks if the row minimum is smaller than min, if so it is recorded */
+            result->minimum = row.minimum;
+            result->minRow = i;
+            result->minColumn = job.firstColumn + row.minColumn;
+          }
+          if (row.maximum > result->maximum){ /* Check if the row maximum is larger than max, if so it is recorded */
+            result->maximum = row.maximum;
+            result->maxRow = i;
+            result->maxColumn = job.firstColumn + row.maxColumn;
+          }
+          rowDone(i);
+        }
+        TRACE_SPAN("rows", traced, last - first);
+        TRACE_RESET(traced);
       }
     }
+    TRACE_SPAN("claim", traced, -1); /* the claim that found the bag empty */
+    if (counting) { /* added before the job is reported done, main reads them after waitJob */
+      perfRead(&counters, &jobCounts);
+      perfSubtract(&jobCounts, &jobStart);
+      perfAdd(&workerCounts[myid], &jobCounts);
+    }
+
+    pthread_mutex_lock(&poolLock); /* The last worker to finish wakes main */
+    if (++workersDone == numWorkers) {
+      pthread_cond_signal(&jobFinished);
+    }
+    pthread_mutex_unlock(&poolLock);
   }
 
-  return result; /* Changes made to Worker function - removed call to barrier function, the total summation and the stopping of the clock. */
+  if (counting) perfClose(&counters);
+  return NULL;
 }
-
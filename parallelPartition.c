@@ -0,0 +1,86 @@
+/* in place partition of a large range by several threads at once
+
+   usage: gcc -O2 -c parallelPartition.c, then link parallelPartition.o with the program
+*/
+#include <stdbool.h>
+#include "parallelPartition.h"
+
+/* First element of part k */
+static long partStart(const struct ParallelPartition *partition, int k) {
+  return partition->low + (partition->high - partition->low) * k / partition->parts;
+}
+
+int partitionParts(long size, int threads) {
+  long parts = size < PARALLELCUTOFF ? 1 : size / MINPART;
+  if (parts > threads) parts = threads;
+  if (parts > MAXPARTS) parts = MAXPARTS;
+  return parts;
+}
+
+void partitionInit(struct ParallelPartition *partition, int *array, long low, long high, int pivot, int parts) {
+  partition->array = array;
+  partition->low = low;
+  partition->high = high;
+  partition->pivot = pivot;
+  partition->parts = parts < 1 ? 1 : parts > MAXPARTS ? MAXPARTS : parts;
+}
+
+void partitionPart(struct ParallelPartition *partition, int k) {
+  int *array = partition->array, pivot = partition->pivot;
+  long first = partStart(partition, k), i = first, j = partStart(partition, k + 1) - 1;
+  while (true) { /* Hoare style scan from both ends */
+    while (i <= j && array[i] <= pivot) i++;
+    while (i <= j && array[j] > pivot) j--;
+    if (i >= j) break;
+    int t = array[i];
+    array[i++] = array[j];
+    array[j--] = t;
+  }
+  partition->small[k] = i - first;
+}
+
+void partitionPlan(struct ParallelPartition *partition) {
+  long split = partition->low, misplaced = 0;
+  for (int k = 0; k < partition->parts; k++) {
+    split += partition->small[k];
+  }
+  for (int k = 0; k < partition->parts; k++) {
+    long start = partStart(partition, k), middle = start + partition->small[k], end = partStart(partition, k + 1);
+    partition->bigStart[k] = middle; /* large elements before the split */
+    partition->bigEnd[k] = end < split ? end : split;
+    if (partition->bigEnd[k] < middle) partition->bigEnd[k] = middle;
+    partition->smallStart[k] = start > split ? start : split; /* small elements from the split on */
+    partition->smallEnd[k] = middle;
+    if (partition->smallStart[k] > middle) partition->smallStart[k] = middle;
+    misplaced += partition->bigEnd[k] - partition->bigStart[k];
+  }
+  partition->split = split;
+  partition->misplaced = misplaced;
+}
+
+/* Finds the m-th element of a list of intervals, returns its index and sets *interval to the interval holding it */
+static long locate(const long *start, const long *end, int count, long m, int *interval) {
+  int k = 0;
+  while (k < count - 1 && m >= end[k] - start[k]) {
+    m -= end[k] - start[k];
+    k++;
+  }
+  *interval = k;
+  return start[k] + m;
+}
+
+void partitionSwapPart(struct ParallelPartition *partition, int k) {
+  long first = partition->misplaced * k / partition->parts, count = partition->misplaced * (k + 1) / partition->parts - first;
+  if (count == 0) return;
+  int big, small, *array = partition->array;
+  long i = locate(partition->bigStart, partition->bigEnd, partition->parts, first, &big);
+  long j = locate(partition->smallStart, partition->smallEnd, partition->parts, first, &small);
+  while (true) {
+    int t = array[i];
+    array[i] = array[j];
+    array[j] = t;
+    if (--count == 0) break;
+    while (++i >= partition->bigEnd[big]) i = partition->bigStart[++big] - 1; /* on to the next non empty interval */
+    while (++j >= partition->smallEnd[small]) j = partition->smallStart[++small] - 1;
+  }
+}
@@ -0,0 +1,49 @@
+/* in place partition of a large range by several threads at once
+
+   features: the range is cut into parts, each part is partitioned on its own around the same pivot (phase 1).
+             A prefix sum of the counts gives the split, every element <= pivot must end before it and every larger one after.
+             The large elements before the split and the small ones after it are equally many, in phase 2 each thread
+             swaps an equal share of them, so both phases are spread evenly whatever the data and no buffer is needed.
+             The caller runs partitionPart and partitionSwapPart for every part on any threads it likes (pthreads tasks,
+             OpenMP tasks), with partitionPlan on a single thread in between.
+
+   usage: compile parallelPartition.c together with the program
+*/
+#ifndef PARALLELPARTITION_H
+#define PARALLELPARTITION_H
+
+#define MAXPARTS 64                  /* most parts a range is split into */
+#define PARALLELCUTOFF (1 << 20)     /* smaller ranges are partitioned by one thread */
+#define MINPART 65536                /* smallest part worth a thread of its own */
+
+/* One range being partitioned, [low, high) with high exclusive */
+struct ParallelPartition {
+  int *array;
+  long low;
+  long high;
+  int pivot;
+  int parts;
+  long small[MAXPARTS];       /* elements <= pivot in each part after phase 1 */
+  long split;                 /* set by partitionPlan, [low, split) <= pivot < [split, high) once phase 2 is done */
+  long misplaced;             /* elements on the wrong side of split, half of them large and half small */
+  long bigStart[MAXPARTS];    /* misplaced large elements of each part, [bigStart, bigEnd) */
+  long bigEnd[MAXPARTS];
+  long smallStart[MAXPARTS];  /* misplaced small elements of each part */
+  long smallEnd[MAXPARTS];
+};
+
+/* Number of parts for a range of size elements and threads threads, 1 means partitioning it serially is better */
+int partitionParts(long size, int threads);
+
+void partitionInit(struct ParallelPartition *partition, int *array, long low, long high, int pivot, int parts);
+
+/* Phase 1 for part k */
+void partitionPart(struct ParallelPartition *partition, int k);
+
+/* Between the phases, after every part is done: finds the split and the misplaced elements */
+void partitionPlan(struct ParallelPartition *partition);
+
+/* Phase 2 for part k, returns nothing useful until every part is done */
+void partitionSwapPart(struct ParallelPartition *partition, int k);
+
+#endif
@@ -0,0 +1,231 @@
+/* checks and times the parallel sorting library in parallelSort.c
+
+   features: sorts the same keys as int, int64_t, double (with NaNs), records and 24 byte elements through the
+             comparator, checks every result against qsort and the stable sorts also against the original order
+             of equal keys, then prints the time of each next to the time of qsort.
+             The keys come from generator.c, --dist picks the distribution and --seed makes them reproducible.
+
+   usage under Linux:
+     gcc -O2 -c parallelSort.c introsort.c taskPool.c
+     ar rcs libparallelsort.a parallelSort.o introsort.o taskPool.o
+     gcc -O2 -o parallelSort-bench parallelSort-bench.c generator.c -L. -lparallelsort -lpthread -lm
+     ./parallelSort-bench [--seed n] [--dist name] size threads
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include "parallelSort.h"
+#include "generator.h"
+
+#define SIZE 1000000     /* default number of keys */
+#define THREADS 4        /* default number of threads */
+#define KEYRANGE 1000000 /* keys are drawn from [0, KEYRANGE) */
+#define NANEVERY 1000    /* one double in this many is a NaN */
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+/* An element bigger than a register, sorted by key through the comparator */
+struct Wide {
+  int64_t key;
+  uint64_t rowId;
+  double weight;
+};
+
+int compareInts(const void *a, const void *b) {
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+int compareInt64s(const void *a, const void *b) {
+  int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+  return (x > y) - (x < y);
+}
+
+/* NaNs last, as NAN_LAST asks */
+int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  if (isnan(x) || isnan(y)) return isnan(x) - isnan(y);
+  return (x > y) - (x < y);
+}
+
+/* Key then row id, the row ids start in order so this is the order a stable sort by key gives */
+int compareRecords(const void *a, const void *b) {
+  const struct SortRecord *x = a, *y = b;
+  if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+  return (x->rowId > y->rowId) - (x->rowId < y->rowId);
+}
+
+int compareWide(const void *a, const void *b, void *context) {
+  const struct Wide *x = a, *y = b;
+  (void) context;
+  return (x->key > y->key) - (x->key < y->key);
+}
+
+int compareWideStable(const void *a, const void *b) {
+  const struct Wide *x = a, *y = b;
+  if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+  return (x->rowId > y->rowId) - (x->rowId < y->rowId);
+}
+
+/* Keys only for the unstable sorts, everything for the stable ones */
+bool sameRecords(const struct SortRecord *a, const struct SortRecord *b, size_t n, bool stable) {
+  for (size_t i = 0; i < n; i++) {
+    if (a[i].key != b[i].key || (stable && a[i].rowId != b[i].rowId)) return false;
+  }
+  return true;
+}
+
+bool sameWide(const struct Wide *a, const struct Wide *b, size_t n, bool stable) {
+  for (size_t i = 0; i < n; i++) {
+    if (a[i].key != b[i].key || (stable && a[i].rowId != b[i].rowId)) return false;
+  }
+  return true;
+}
+
+/* NaNs are never equal, compare bit patterns instead */
+bool sameDoubles(const double *a, const double *b, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (isnan(a[i]) ? !isnan(b[i]) : a[i] != b[i]) return false;
+  }
+  return true;
+}
+
+void report(const char *name, bool correct, double seconds, double qsortSeconds) {
+  printf("%-16s %s %10.4f sec, qsort %10.4f sec, speedup %6.2f\n", name, correct ? "ok   " : "WRONG", seconds, qsortSeconds,
+         qsortSeconds / seconds);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option options[] = {
+    { "seed", required_argument, NULL, 'S' },
+    { "dist", required_argument, NULL, 'd' },
+    { NULL, 0, NULL, 0 }
+  };
+  int option;
+  unsigned long long seed = time(NULL);
+  enum Distribution distribution = DIST_UNIFORM;
+  struct Generator generator;
+  double start_time, sortSeconds, qsortSeconds;
+  bool correct, allCorrect = true;
+
+  while ((option = getopt_long(argc, argv, "S:d:", options, NULL)) != -1) {
+    switch (option) {
+    case 'S': seed = strtoull(optarg, NULL, 0); break;
+    case 'd':
+      if (!parseDistribution(optarg, &distribution)) {
+        printf("Unknown distribution %s, expected uniform, sorted, reverse, few or zipf\n", optarg);
+        return 1;
+      }
+      break;
+    default: return 1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  size_t n = (argc > 1)? strtoul(argv[1], NULL, 0) : SIZE;
+  int threads = (argc > 2)? atoi(argv[2]) : THREADS;
+  int *keys = malloc(n * sizeof *keys), *ints = malloc(n * sizeof *ints), *intsExpected = malloc(n * sizeof *ints);
+  int64_t *longs = malloc(n * sizeof *longs), *longsExpected = malloc(n * sizeof *longs);
+  double *doubles = malloc(n * sizeof *doubles), *doublesExpected = malloc(n * sizeof *doubles);
+  struct SortRecord *records = malloc(n * sizeof *records), *recordsExpected = malloc(n * sizeof *records);
+  struct Wide *wide = malloc(n * sizeof *wide), *wideExpected = malloc(n * sizeof *wide);
+  if (!keys || !ints || !intsExpected || !longs || !longsExpected || !doubles || !doublesExpected || !records
+      || !recordsExpected || !wide || !wideExpected) {
+    printf("Could not allocate %zu keys of every type\n", n);
+    return 1;
+  }
+  generatorInit(&generator, distribution, KEYRANGE, seed);
+  generateInts(&generator, keys, n, threads);
+  printf("Sorting %zu keys (seed %llu, %s) with %d threads\n", n, seed, distributionName(distribution), threads);
+
+  memcpy(ints, keys, n * sizeof *ints);
+  memcpy(intsExpected, keys, n * sizeof *ints);
+  start_time = read_timer();
+  qsort(intsExpected, n, sizeof *ints, compareInts);
+  qsortSeconds = read_timer() - start_time;
+  start_time = read_timer();
+  correct = parallelSortInts(ints, n, threads) && memcmp(ints, intsExpected, n * sizeof *ints) == 0;
+  sortSeconds = read_timer() - start_time;
+  report("int", correct, sortSeconds, qsortSeconds);
+  allCorrect &= correct;
+
+  for (size_t i = 0; i < n; i++) longs[i] = longsExpected[i] = ((int64_t) keys[i] << 32) - keys[n - 1 - i];
+  start_time = read_timer();
+  qsort(longsExpected, n, sizeof *longs, compareInt64s);
+  qsortSeconds = read_timer() - start_time;
+  start_time = read_timer();
+  correct = parallelSortInt64s(longs, n, threads) && memcmp(longs, longsExpected, n * sizeof *longs) == 0;
+  sortSeconds = read_timer() - start_time;
+  report("int64", correct, sortSeconds, qsortSeconds);
+  allCorrect &= correct;
+
+  for (size_t i = 0; i < n; i++) {
+    doubles[i] = i % NANEVERY == NANEVERY / 2 ? NAN : (keys[i] - KEYRANGE / 2) / 7.0;
+    if (doubles[i] == 0.0 && i % 2) doubles[i] = -0.0;
+  }
+  memcpy(doublesExpected, doubles, n * sizeof *doubles);
+  start_time = read_timer();
+  qsort(doublesExpected, n, sizeof *doubles, compareDoubles);
+  qsortSeconds = read_timer() - start_time;
+  start_time = read_timer();
+  correct = parallelSortDoubles(doubles, n, NAN_LAST, threads) && sameDoubles(doubles, doublesExpected, n);
+  sortSeconds = read_timer() - start_time;
+  report("double", correct, sortSeconds, qsortSeconds);
+  allCorrect &= correct;
+
+  for (int stable = 0; stable <= 1; stable++) {
+    for (size_t i = 0; i < n; i++) {
+      records[i].key = keys[i];
+      records[i].rowId = i;
+    }
+    memcpy(recordsExpected, records, n * sizeof *records);
+    start_time = read_timer();
+    qsort(recordsExpected, n, sizeof *records, compareRecords);
+    qsortSeconds = read_timer() - start_time;
+    start_time = read_timer();
+    correct = parallelSortRecords(records, n, stable, threads) && sameRecords(records, recordsExpected, n, stable);
+    sortSeconds = read_timer() - start_time;
+    report(stable ? "record stable" : "record", correct, sortSeconds, qsortSeconds);
+    allCorrect &= correct;
+  }
+
+  for (int stable = 0; stable <= 1; stable++) {
+    for (size_t i = 0; i < n; i++) {
+      wide[i].key = keys[i];
+      wide[i].rowId = i;
+      wide[i].weight = i;
+    }
+    memcpy(wideExpected, wide, n * sizeof *wide);
+    start_time = read_timer();
+    qsort(wideExpected, n, sizeof *wide, compareWideStable);
+    qsortSeconds = read_timer() - start_time;
+    start_time = read_timer();
+    correct = (stable ? parallelStableSort : parallelSort)(wide, n, sizeof *wide, compareWide, NULL, threads)
+              && sameWide(wide, wideExpected, n, stable);
+    sortSeconds = read_timer() - start_time;
+    report(stable ? "generic stable" : "generic", correct, sortSeconds, qsortSeconds);
+    allCorrect &= correct;
+  }
+
+  free(keys); free(ints); free(intsExpected); free(longs); free(longsExpected); free(doubles); free(doublesExpected);
+  free(records); free(recordsExpected); free(wide); free(wideExpected);
+  return allCorrect ? 0 : 1;
+}
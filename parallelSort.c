@@ -0,0 +1,461 @@
+/* parallel sorting library for any element type
+
+   usage: gcc -O2 -c parallelSort.c, then archive parallelSort.o with introsort.o and taskPool.o (see parallelSort.h)
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "parallelSort.h"
+#include "introsort.h"
+#include "taskPool.h"
+
+struct SortType;
+
+/* Everything a sort needs to know about the elements, passed down to every function of the templates below */
+struct SortCall {
+  const struct SortType *type;
+  size_t size;
+  SortCompare compare;
+  void *context;
+};
+
+/* Element access for the templates. The typed versions compare inline, the generic one works on bytes and
+   calls the comparator, the templates are written once against these and instantiated for every type */
+#define TYPED_ELEM(base, i) ((base) + (i))
+#define TYPED_SWAP(a, b) do { __typeof__(*(a)) swapped = *(a); *(a) = *(b); *(b) = swapped; } while (0)
+#define TYPED_COPY(to, from) (*(to) = *(from))
+#define VALUE_LESS(a, b) (*(a) < *(b))
+#define KEY_LESS(a, b) ((a)->key < (b)->key)
+#define GENERIC_ELEM(base, i) ((base) + (i) * call->size)
+#define GENERIC_SWAP(a, b) swapBytes(a, b, call->size)
+#define GENERIC_COPY(to, from) memcpy(to, from, call->size)
+#define GENERIC_LESS(a, b) (call->compare(a, b, call->context) < 0)
+
+#define SORT_TYPES(X)                                                         \
+  X(int64, int64_t, TYPED_ELEM, VALUE_LESS, TYPED_SWAP, TYPED_COPY)           \
+  X(double, double, TYPED_ELEM, VALUE_LESS, TYPED_SWAP, TYPED_COPY)           \
+  X(record, struct SortRecord, TYPED_ELEM, KEY_LESS, TYPED_SWAP, TYPED_COPY)  \
+  X(generic, char, GENERIC_ELEM, GENERIC_LESS, GENERIC_SWAP, GENERIC_COPY)
+
+static inline void swapBytes(char *a, char *b, size_t size) {
+  char swapped[64];
+  while (size > 0) {
+    size_t chunk = size < sizeof swapped ? size : sizeof swapped;
+    memcpy(swapped, a, chunk);
+    memcpy(a, b, chunk);
+    memcpy(b, swapped, chunk);
+    a += chunk;
+    b += chunk;
+    size -= chunk;
+  }
+}
+
+/* Insertion sort by adjacent swaps, equal elements never pass each other so it is stable */
+#define DEFINE_INSERTION(name, type, ELEM, LESS, SWAP, COPY)                         \
+static void insertion_##name(void *data, size_t n, const struct SortCall *call) {   \
+  type *base = data;                                                                 \
+  (void) call;                                                                       \
+  for (size_t i = 1; i < n; i++)                                                     \
+    for (size_t j = i; j > 0 && LESS(ELEM(base, j), ELEM(base, j - 1)); j--)         \
+      SWAP(ELEM(base, j), ELEM(base, j - 1));                                        \
+}
+SORT_TYPES(DEFINE_INSERTION)
+#undef DEFINE_INSERTION
+
+/* Heapsort, the fallback when a range runs out of partitions */
+#define DEFINE_HEAPSORT(name, type, ELEM, LESS, SWAP, COPY)                          \
+static void siftDown_##name(type *base, size_t i, size_t n, const struct SortCall *call) { \
+  size_t child;                                                                      \
+  (void) call;                                                                       \
+  while ((child = 2 * i + 1) < n) {                                                  \
+    if (child + 1 < n && LESS(ELEM(base, child), ELEM(base, child + 1))) child++;    \
+    if (!LESS(ELEM(base, i), ELEM(base, child))) break;                              \
+    SWAP(ELEM(base, i), ELEM(base, child));                                          \
+    i = child;                                                                       \
+  }                                                                                  \
+}                                                                                    \
+static void heapsort_##name(void *data, size_t n, const struct SortCall *call) {    \
+  type *base = data;                                                                 \
+  if (n < 2) return;                                                                 \
+  for (size_t i = n / 2; i-- > 0;) siftDown_##name(base, i, n, call);                \
+  for (size_t end = n - 1; end > 0; end--) {                                         \
+    SWAP(ELEM(base, 0), ELEM(base, end));                                            \
+    siftDown_##name(base, 0, end, call);                                             \
+  }                                                                                  \
+}
+SORT_TYPES(DEFINE_HEAPSORT)
+#undef DEFINE_HEAPSORT
+
+/* Three way partition of base[0..n-1] around a median of three or ninther, same scheme as introsort.c:
+   the pivot sits at 0 while Bentley-McIlroy collects the equal keys at both ends, which are then swapped
+   into the middle. Afterwards [0, *lt) < pivot, [*lt, *gt] == pivot and (*gt, n) > pivot */
+#define DEFINE_PARTITION(name, type, ELEM, LESS, SWAP, COPY)                         \
+static size_t median3_##name(type *base, size_t a, size_t b, size_t c, const struct SortCall *call) { \
+  (void) call;                                                                       \
+  if (LESS(ELEM(base, a), ELEM(base, b))) {                                          \
+    if (LESS(ELEM(base, b), ELEM(base, c))) return b;                                \
+    return LESS(ELEM(base, a), ELEM(base, c)) ? c : a;                               \
+  }                                                                                  \
+  if (LESS(ELEM(base, a), ELEM(base, c))) return a;                                  \
+  return LESS(ELEM(base, b), ELEM(base, c)) ? c : b;                                 \
+}                                                                                    \
+static void partition_##name(void *data, size_t n, size_t *lt, size_t *gt, const struct SortCall *call) { \
+  type *base = data;                                                                 \
+  size_t middle = n / 2, pivot;                                                      \
+  long i = 0, j = n, p = 0, q = n, k;                                                \
+  if (n < NINTHERCUTOFF) {                                                           \
+    pivot = median3_##name(base, 0, middle, n - 1, call);                            \
+  } else {                                                                           \
+    size_t step = n / 8;                                                             \
+    pivot = median3_##name(base, median3_##name(base, 0, step, 2 * step, call),      \
+                           median3_##name(base, middle - step, middle, middle + step, call), \
+                           median3_##name(base, n - 1 - 2 * step, n - 1 - step, n - 1, call), call); \
+  }                                                                                  \
+  SWAP(ELEM(base, 0), ELEM(base, pivot));                                            \
+  for (;;) {                                                                         \
+    while (LESS(ELEM(base, ++i), ELEM(base, 0))) if (i == (long) n - 1) break;       \
+    while (LESS(ELEM(base, 0), ELEM(base, --j))) if (j == 0) break;                  \
+    if (i == j && !LESS(ELEM(base, i), ELEM(base, 0)) && !LESS(ELEM(base, 0), ELEM(base, i))) { \
+      p++;                                                                           \
+      SWAP(ELEM(base, p), ELEM(base, i));                                            \
+    }                                                                                \
+    if (i >= j) break;                                                               \
+    SWAP(ELEM(base, i), ELEM(base, j));                                              \
+    if (!LESS(ELEM(base, i), ELEM(base, 0))) {                                       \
+      p++;                                                                           \
+      SWAP(ELEM(base, p), ELEM(base, i));                                            \
+    }                                                                                \
+    if (!LESS(ELEM(base, 0), ELEM(base, j))) {                                       \
+      q--;                                                                           \
+      SWAP(ELEM(base, q), ELEM(base, j));                                            \
+    }                                                                                \
+  }                                                                                  \
+  i = j + 1;                                                                         \
+  for (k = 0; k <= p; k++, j--) SWAP(ELEM(base, k), ELEM(base, j));                  \
+  for (k = n - 1; k >= q; k--, i++) SWAP(ELEM(base, k), ELEM(base, i));              \
+  *lt = j + 1;                                                                       \
+  *gt = i - 1;                                                                       \
+}
+SORT_TYPES(DEFINE_PARTITION)
+#undef DEFINE_PARTITION
+
+/* Introsort: the smaller side recursively, the larger one by the loop, heapsort once depth is used up */
+#define DEFINE_INTROSORT(name, type, ELEM, LESS, SWAP, COPY)                         \
+static void introsort_##name(void *data, size_t n, int depth, const struct SortCall *call) { \
+  type *base = data;                                                                 \
+  size_t lt, gt;                                                                     \
+  while (n > SORTLEAF) {                                                             \
+    if (depth-- <= 0) {                                                              \
+      heapsort_##name(base, n, call);                                                \
+      return;                                                                        \
+    }                                                                                \
+    partition_##name(base, n, &lt, &gt, call);                                       \
+    if (lt < n - 1 - gt) {                                                           \
+      introsort_##name(base, lt, depth, call);                                       \
+      base = ELEM(base, gt + 1);                                                     \
+      n -= gt + 1;                                                                   \
+    } else {                                                                         \
+      introsort_##name(ELEM(base, gt + 1), n - 1 - gt, depth, call);                 \
+      n = lt;                                                                        \
+    }                                                                                \
+  }                                                                                  \
+  insertion_##name(base, n, call);                                                   \
+}
+SORT_TYPES(DEFINE_INTROSORT)
+#undef DEFINE_INTROSORT
+
+/* Stable merge of a and b into out, on equal keys a goes first. coRank finds how many of the first k outputs
+   come from a, so a merge can be cut anywhere and the pieces merged independently. mergeSort sorts runs of
+   SORTLEAF by insertion, then merges bottom up between base and buffer and leaves the result in base */
+#define DEFINE_MERGE(name, type, ELEM, LESS, SWAP, COPY)                             \
+static void merge_##name(const void *left, size_t na, const void *right, size_t nb, void *output, const struct SortCall *call) { \
+  const type *a = left, *b = right;                                                  \
+  type *out = output;                                                                \
+  size_t i = 0, j = 0, k = 0;                                                        \
+  (void) call;                                                                       \
+  while (i < na && j < nb) {                                                         \
+    if (LESS(ELEM(b, j), ELEM(a, i))) COPY(ELEM(out, k), ELEM(b, j)), j++;           \
+    else COPY(ELEM(out, k), ELEM(a, i)), i++;                                        \
+    k++;                                                                             \
+  }                                                                                  \
+  for (; i < na; i++, k++) COPY(ELEM(out, k), ELEM(a, i));                           \
+  for (; j < nb; j++, k++) COPY(ELEM(out, k), ELEM(b, j));                           \
+}                                                                                    \
+static size_t coRank_##name(const void *left, size_t na, const void *right, size_t nb, size_t k, const struct SortCall *call) { \
+  const type *a = left, *b = right;                                                  \
+  size_t low = k > nb ? k - nb : 0, high = k < na ? k : na;                          \
+  (void) call;                                                                       \
+  while (low < high) { /* the answer is the smallest i whose a[i] is not taken before b[k - i - 1] */ \
+    size_t i = low + (high - low) / 2;                                               \
+    if (LESS(ELEM(b, k - i - 1), ELEM(a, i))) high = i;                              \
+    else low = i + 1;                                                                \
+  }                                                                                  \
+  return low;                                                                        \
+}                                                                                    \
+static void mergeSort_##name(void *data, void *spare, size_t n, const struct SortCall *call) { \
+  type *base = data, *from = data, *to = spare, *swapped;                            \
+  for (size_t start = 0; start < n; start += SORTLEAF)                               \
+    insertion_##name(ELEM(base, start), n - start < SORTLEAF ? n - start : SORTLEAF, call); \
+  for (size_t width = SORTLEAF; width < n; width *= 2) {                             \
+    for (size_t start = 0; start < n; start += 2 * width) {                          \
+      size_t middle = start + width < n ? start + width : n;                         \
+      size_t end = middle + width < n ? middle + width : n;                          \
+      merge_##name(ELEM(from, start), middle - start, ELEM(from, middle), end - middle, ELEM(to, start), call); \
+    }                                                                                \
+    swapped = from;                                                                  \
+    from = to;                                                                       \
+    to = swapped;                                                                    \
+  }                                                                                  \
+  if (from != base) memcpy(base, from, (char *) ELEM(from, n) - (char *) from);      \
+}
+SORT_TYPES(DEFINE_MERGE)
+#undef DEFINE_MERGE
+
+/* int keys go through introsort.c, which has the branchless partition and the sorting network */
+static void introsort_int(void *data, size_t n, int depth, const struct SortCall *call) {
+  (void) call;
+  if (n > 1) introsort(data, 0, n - 1, depth);
+}
+
+static void partition_int(void *data, size_t n, size_t *lt, size_t *gt, const struct SortCall *call) {
+  long low, high;
+  (void) call;
+  introPartition(data, 0, n - 1, &low, &high);
+  *lt = low;
+  *gt = high;
+}
+
+/* The functions of one element type */
+struct SortType {
+  void (*introsort)(void *base, size_t n, int depth, const struct SortCall *call);
+  void (*partition)(void *base, size_t n, size_t *lt, size_t *gt, const struct SortCall *call);
+  void (*mergeSort)(void *base, void *buffer, size_t n, const struct SortCall *call);
+  void (*merge)(const void *a, size_t na, const void *b, size_t nb, void *out, const struct SortCall *call);
+  size_t (*coRank)(const void *a, size_t na, const void *b, size_t nb, size_t k, const struct SortCall *call);
+};
+
+#define SORT_TYPE(name, type, ELEM, LESS, SWAP, COPY) \
+static const struct SortType type_##name = { introsort_##name, partition_##name, mergeSort_##name, merge_##name, coRank_##name };
+SORT_TYPES(SORT_TYPE)
+#undef SORT_TYPE
+/* only the unstable sort of ints goes through introsort.c, stable int sorts would use int64 width anyway */
+static const struct SortType type_int = { introsort_int, partition_int, NULL, NULL, NULL };
+
+static pthread_once_t introsortOnce = PTHREAD_ONCE_INIT;
+
+/* State of one parallel sort, shared by all its tasks */
+struct SortJob {
+  const struct SortCall *call;
+  char *base;
+  size_t count;
+  char *from;       /* the stable sort merges from one array into the other, round after round */
+  char *to;
+  size_t *bounds;   /* runs of the current round, run r is [bounds[r], bounds[r + 1]) */
+  int runs;
+  int pieces;       /* pieces every pair of runs is merged in */
+};
+
+/* Quicksort task on [low, high) of the job: the left side of every large partition is spawned, the task goes
+   on with the right side. depth travels with the task so the heapsort fallback still bounds every path */
+struct SortRange {
+  struct SortJob *job;
+  int depth;
+};
+
+static void quicksortTask(struct TaskWorker *worker, void *context, long low, long high) {
+  struct SortRange *range = context;
+  struct SortJob *job = range->job;
+  const struct SortCall *call = job->call;
+  int depth = range->depth;
+  size_t lt, gt;
+  free(range);
+  while (high - low > SORTTASKCUTOFF && depth > 0) {
+    depth--;
+    call->type->partition(job->base + low * call->size, high - low, &lt, &gt, call);
+    struct SortRange *left = malloc(sizeof *left);
+    if (left == NULL) {
+      call->type->introsort(job->base + low * call->size, lt, depth, call);
+    } else {
+      left->job = job;
+      left->depth = depth;
+      taskSpawn(worker, quicksortTask, left, low, low + lt);
+    }
+    low += gt + 1;
+  }
+  call->type->introsort(job->base + low * call->size, high - low, depth, call);
+}
+
+/* Runs one task for each index in [low, high), the root spawns the others so idle workers steal them */
+struct FanOut {
+  TaskFunction function;
+  void *context;
+};
+
+static void fanOutTask(struct TaskWorker *worker, void *context, long low, long high) {
+  struct FanOut *fan = context;
+  for (long k = low + 1; k < high; k++) taskSpawn(worker, fan->function, fan->context, k, k + 1);
+  fan->function(worker, fan->context, low, low + 1);
+}
+
+static void runEach(struct TaskPool *pool, TaskFunction function, void *context, long count) {
+  struct FanOut fan = { function, context };
+  if (pool == NULL) {
+    for (long k = 0; k < count; k++) function(NULL, context, k, k + 1);
+  } else if (count > 0) {
+    taskPoolRun(pool, fanOutTask, &fan, 0, count);
+  }
+}
+
+/* Stable sort of run k of the first round */
+static void runSortTask(struct TaskWorker *worker, void *context, long k, long end) {
+  struct SortJob *job = context;
+  const struct SortCall *call = job->call;
+  size_t start = job->bounds[k], n = job->bounds[k + 1] - start;
+  (void) worker;
+  (void) end;
+  call->type->mergeSort(job->base + start * call->size, job->to + start * call->size, n, call);
+}
+
+/* Piece k of a merge round: pair k / pieces, the piece-th slice of its output. Both ends of the slice are
+   co-ranked so every piece merges the same number of elements no matter how the keys fall. A run without
+   a partner is merged with nothing, which copies it */
+static void mergePieceTask(struct TaskWorker *worker, void *context, long k, long end) {
+  struct SortJob *job = context;
+  const struct SortCall *call = job->call;
+  int pair = k / job->pieces, piece = k % job->pieces;
+  size_t start = job->bounds[2 * pair];
+  size_t middle = job->bounds[2 * pair + 1];
+  size_t stop = job->bounds[2 * pair + 2 < job->runs ? 2 * pair + 2 : job->runs];
+  size_t na = middle - start, nb = stop - middle, length = stop - start;
+  size_t first = length * piece / job->pieces, last = length * (piece + 1) / job->pieces;
+  const char *a = job->from + start * call->size, *b = job->from + middle * call->size;
+  (void) worker;
+  (void) end;
+  size_t i0 = call->type->coRank(a, na, b, nb, first, call), i1 = call->type->coRank(a, na, b, nb, last, call);
+  call->type->merge(a + i0 * call->size, i1 - i0, b + (first - i0) * call->size, (last - i1) - (first - i0),
+                    job->to + (start + first) * call->size, call);
+}
+
+static void copyBackTask(struct TaskWorker *worker, void *context, long k, long end) {
+  struct SortJob *job = context;
+  size_t n = job->count, size = job->call->size;
+  size_t first = n * k / job->pieces, last = n * (k + 1) / job->pieces;
+  (void) worker;
+  (void) end;
+  memcpy(job->base + first * size, job->from + first * size, (last - first) * size);
+}
+
+static bool unstableSort(const struct SortCall *call, void *base, size_t count, int threads) {
+  struct TaskPool pool;
+  struct SortJob job = { call, base, count, NULL, NULL, NULL, 0, 0 };
+  struct SortRange *range;
+  int depth = introDepth(count > 1 ? count : 1);
+  if (threads <= 1 || count <= SORTTASKCUTOFF) {
+    call->type->introsort(base, count, depth, call);
+    return true;
+  }
+  range = malloc(sizeof *range);
+  if (range == NULL || !taskPoolInit(&pool, threads)) {
+    free(range);
+    return false;
+  }
+  range->job = &job;
+  range->depth = depth;
+  taskPoolRun(&pool, quicksortTask, range, 0, count);
+  taskPoolDestroy(&pool);
+  return true;
+}
+
+static bool stableSort(const struct SortCall *call, void *base, size_t count, int threads) {
+  struct TaskPool pool, *usePool = NULL;
+  struct SortJob job = { call, base, count, base, NULL, NULL, 0, 1 };
+  char *buffer;
+  size_t runs = threads > 1 ? count / MINRUN : 1;
+  if (runs > (size_t) threads) runs = threads;
+  if (runs < 1) runs = 1;
+  buffer = malloc(count * call->size + 1);
+  job.bounds = malloc((runs + 1) * sizeof *job.bounds);
+  if (buffer == NULL || job.bounds == NULL || (runs > 1 && !taskPoolInit(&pool, threads))) {
+    free(buffer);
+    free(job.bounds);
+    return false;
+  }
+  if (runs > 1) usePool = &pool;
+  for (size_t r = 0; r <= runs; r++) job.bounds[r] = count * r / runs;
+  job.runs = runs;
+  job.to = buffer;
+  runEach(usePool, runSortTask, &job, runs);
+
+  /* every round halves the runs, the pairs share the threads between them */
+  job.from = base;
+  job.to = buffer;
+  while (job.runs > 1) {
+    int pairs = (job.runs + 1) / 2;
+    job.pieces = threads / pairs > 1 ? threads / pairs : 1;
+    runEach(usePool, mergePieceTask, &job, (long) pairs * job.pieces);
+    for (int r = 0; 2 * r <= job.runs; r++) job.bounds[r] = job.bounds[2 * r < job.runs ? 2 * r : job.runs];
+    job.runs = pairs;
+    job.bounds[job.runs] = count;
+    char *swapped = job.from;
+    job.from = job.to;
+    job.to = swapped;
+  }
+  if (job.from != job.base) {
+    job.pieces = threads > 1 ? threads : 1;
+    runEach(usePool, copyBackTask, &job, job.pieces);
+  }
+  if (usePool != NULL) taskPoolDestroy(&pool);
+  free(buffer);
+  free(job.bounds);
+  return true;
+}
+
+bool parallelSort(void *base, size_t count, size_t size, SortCompare compare, void *context, int threads) {
+  struct SortCall call = { &type_generic, size, compare, context };
+  return unstableSort(&call, base, count, threads);
+}
+
+bool parallelStableSort(void *base, size_t count, size_t size, SortCompare compare, void *context, int threads) {
+  struct SortCall call = { &type_generic, size, compare, context };
+  return stableSort(&call, base, count, threads);
+}
+
+bool parallelSortInts(int *keys, size_t count, int threads) {
+  struct SortCall call = { &type_int, sizeof(int), NULL, NULL };
+  pthread_once(&introsortOnce, introsortInit);
+  return unstableSort(&call, keys, count, threads);
+}
+
+bool parallelSortInt64s(int64_t *keys, size_t count, int threads) {
+  struct SortCall call = { &type_int64, sizeof(int64_t), NULL, NULL };
+  return unstableSort(&call, keys, count, threads);
+}
+
+/* NaNs compare false with everything, so they are moved to their end first, keeping the order of the rest,
+   and only the numbers are sorted */
+bool parallelSortDoubles(double *keys, size_t count, enum NanPolicy nans, int threads) {
+  struct SortCall call = { &type_double, sizeof(double), NULL, NULL };
+  size_t numbers = 0;
+  if (nans == NAN_LAST) {
+    for (size_t i = 0; i < count; i++) {
+      if (!isnan(keys[i])) {
+        TYPED_SWAP(&keys[numbers], &keys[i]);
+        numbers++;
+      }
+    }
+    return unstableSort(&call, keys, numbers, threads);
+  }
+  for (size_t i = count; i-- > 0;) {
+    if (!isnan(keys[i])) {
+      TYPED_SWAP(&keys[count - 1 - numbers], &keys[i]);
+      numbers++;
+    }
+  }
+  return unstableSort(&call, keys + count - numbers, numbers, threads);
+}
+
+bool parallelSortRecords(struct SortRecord *records, size_t count, bool stable, int threads) {
+  struct SortCall call = { &type_record, sizeof(struct SortRecord), NULL, NULL };
+  return stable ? stableSort(&call, records, count, threads) : unstableSort(&call, records, count, threads);
+}
@@ -0,0 +1,51 @@
+/* parallel sorting library for any element type
+
+   features: parallelSort and parallelStableSort take a comparator with a context like qsort_r, any element size.
+             Fast paths for int, int64_t, double and key + row id records compare inline instead of calling through
+             a pointer. The unstable sorts are the introsort of introsort.c (ninther pivots, three way partitions,
+             heapsort fallback) with every large partition a task of the work-stealing pool of taskPool.c.
+             The stable sorts are merge sorts: every thread sorts one run, then pairs of runs are merged in rounds
+             and every merge is cut into pieces of equal output by binary search so all threads merge in every round.
+             Doubles are sorted with NaNs first or last as asked, -0.0 and 0.0 compare equal.
+             With threads <= 1 everything runs on the calling thread. The functions return false only if memory
+             (buffers, the pool) could not be allocated, the array is then left unsorted but holds the same elements.
+
+   usage: build the static library and link it with the program
+     gcc -O2 -c parallelSort.c introsort.c taskPool.c
+     ar rcs libparallelsort.a parallelSort.o introsort.o taskPool.o
+     gcc -O2 program.c -L. -lparallelsort -lpthread
+*/
+#ifndef PARALLELSORT_H
+#define PARALLELSORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SORTLEAF 16           /* runs up to this size are insertion sorted */
+#define SORTTASKCUTOFF 16384  /* partitions up to this size are not split into tasks */
+#define MINRUN 65536          /* smallest run a thread sorts on its own in the stable sorts */
+
+/* Negative, zero or positive when a is smaller than, equal to or larger than b, context is passed through */
+typedef int (*SortCompare)(const void *a, const void *b, void *context);
+
+/* Where the NaNs go when sorting doubles */
+enum NanPolicy { NAN_FIRST, NAN_LAST };
+
+/* A key and the row it came from, sorted by key only */
+struct SortRecord {
+  int64_t key;
+  uint64_t rowId;
+};
+
+bool parallelSort(void *base, size_t count, size_t size, SortCompare compare, void *context, int threads);
+bool parallelStableSort(void *base, size_t count, size_t size, SortCompare compare, void *context, int threads);
+
+bool parallelSortInts(int *keys, size_t count, int threads);
+bool parallelSortInt64s(int64_t *keys, size_t count, int threads);
+bool parallelSortDoubles(double *keys, size_t count, enum NanPolicy nans, int threads);
+
+/* Records with equal keys keep their order when stable is true */
+bool parallelSortRecords(struct SortRecord *records, size_t count, bool stable, int threads);
+
+#endif
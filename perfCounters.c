@@ -0,0 +1,144 @@
+/* hardware performance counters of a thread or a process through perf_event_open
+
+   usage: gcc -O2 -c perfCounters.c, then link perfCounters.o with the program
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perfCounters.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define CACHEMISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+  unsigned int type;
+  unsigned long long config;
+  const char *name;
+} events[PERFCOUNTERS] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses" },  /* the last level cache on x86 and most ARM */
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses" },
+  { PERF_TYPE_HW_CACHE, CACHEMISS(PERF_COUNT_HW_CACHE_DTLB), "dTLB misses" },
+};
+
+bool perfOpen(struct PerfCounters *counters, bool inherit) {
+  counters->open = false;
+  counters->error = 0;
+  for (int c = 0; c < PERFCOUNTERS; c++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[c].type;
+    attr.config = events[c].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = inherit;
+    /* the others join the leader, or count alone if the CPU has no cycle counter */
+    int leader = c > 0 ? counters->fds[COUNTER_CYCLES] : -1;
+    counters->fds[c] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (counters->fds[c] < 0) {
+      if (counters->error == 0) counters->error = errno;
+    } else {
+      counters->open = true;
+    }
+  }
+  return counters->open;
+}
+#else
+static const struct {
+  const char *name;
+} events[PERFCOUNTERS] = { { "cycles" }, { "instructions" }, { "LLC misses" }, { "branch misses" }, { "dTLB misses" } };
+
+bool perfOpen(struct PerfCounters *counters, bool inherit) { /* no perf_event_open, every counter stays closed */
+  (void) inherit;
+  for (int c = 0; c < PERFCOUNTERS; c++) counters->fds[c] = -1;
+  counters->open = false;
+  counters->error = ENOSYS;
+  return false;
+}
+#endif
+
+void perfClose(struct PerfCounters *counters) {
+  for (int c = PERFCOUNTERS - 1; c >= 0; c--) { /* the leader last */
+    if (counters->fds[c] >= 0) close(counters->fds[c]);
+    counters->fds[c] = -1;
+  }
+  counters->open = false;
+}
+
+void perfRead(const struct PerfCounters *counters, struct PerfSample *sample) {
+  for (int c = 0; c < PERFCOUNTERS; c++) {
+    uint64_t read3[3]; /* value, time enabled, time running */
+    sample->valid[c] = counters->open && counters->fds[c] >= 0 && read(counters->fds[c], read3, sizeof(read3)) == sizeof(read3);
+    sample->value[c] = sample->valid[c] ? read3[0] : 0;
+    sample->enabled[c] = sample->valid[c] ? read3[1] : 0;
+    sample->running[c] = sample->valid[c] ? read3[2] : 0;
+  }
+}
+
+void perfSubtract(struct PerfSample *sample, const struct PerfSample *start) {
+  for (int c = 0; c < PERFCOUNTERS; c++) {
+    sample->valid[c] = sample->valid[c] && start->valid[c];
+    sample->value[c] -= start->value[c];
+    sample->enabled[c] -= start->enabled[c];
+    sample->running[c] -= start->running[c];
+  }
+}
+
+void perfAdd(struct PerfSample *into, const struct PerfSample *from) {
+  for (int c = 0; c < PERFCOUNTERS; c++) {
+    into->valid[c] = into->valid[c] && from->valid[c];
+    into->value[c] += from->value[c];
+    into->enabled[c] += from->enabled[c];
+    into->running[c] += from->running[c];
+  }
+}
+
+void perfZero(struct PerfSample *sample) {
+  memset(sample, 0, sizeof(*sample));
+  for (int c = 0; c < PERFCOUNTERS; c++) sample->valid[c] = true;
+}
+
+/* The count scaled to the time the counter was enabled, negative if unknown */
+static double scaled(const struct PerfSample *sample, int c) {
+  if (!sample->valid[c]) return -1;
+  if (sample->running[c] == 0) return sample->enabled[c] == 0 ? 0 : -1; /* never on the PMU, nothing to scale */
+  return (double) sample->value[c] * sample->enabled[c] / sample->running[c];
+}
+
+void perfPrint(const struct PerfSample *sample, const char *title) {
+  double cycles = scaled(sample, COUNTER_CYCLES), instructions = scaled(sample, COUNTER_INSTRUCTIONS);
+  double lowest = 1;
+  printf("%s:", title);
+  for (int c = 0; c < PERFCOUNTERS; c++) {
+    double count = scaled(sample, c);
+    if (count < 0) {
+      printf("%s %s n/a", c > 0 ? "," : "", events[c].name);
+      continue;
+    }
+    printf("%s %.4g %s", c > 0 ? "," : "", count, events[c].name);
+    if (c >= COUNTER_LLCMISSES && instructions > 0) printf(" (%.3g MPKI)", 1000 * count / instructions);
+    if (sample->enabled[c] > 0 && (double) sample->running[c] / sample->enabled[c] < lowest) {
+      lowest = (double) sample->running[c] / sample->enabled[c];
+    }
+  }
+  if (cycles > 0 && instructions >= 0) printf(", IPC %.3g", instructions / cycles);
+  if (lowest < 1) printf(" (multiplexed, scaled from %.0f%% of the time)", 100 * lowest);
+  printf("\n");
+}
+
+void perfPhase(const struct PerfCounters *counters, struct PerfSample *since, struct PerfSample *phase) {
+  struct PerfSample now;
+  perfRead(counters, &now);
+  if (phase != NULL) {
+    *phase = now;
+    perfSubtract(phase, since);
+  }
+  *since = now;
+}
@@ -0,0 +1,62 @@
+/* hardware performance counters of a thread or a process through perf_event_open
+
+   features: one group per thread: cycles (the leader), instructions, last level cache misses, branch misses and
+             dTLB load misses, user space only so perf_event_paranoid 2 allows it. The group is scheduled on the PMU
+             as a whole, so the ratios come from the same instants; when the kernel has to multiplex the counts are
+             scaled by the time they ran. Opened with inherit it also counts every thread the caller creates later,
+             which gives the whole process without touching the workers.
+             Counters that do not exist on the CPU, in a virtual machine or under a stricter perf_event_paranoid are
+             left out and printed as n/a, perfOpen fails only when none of them opened and the program goes on
+             without counts.
+             perfPrint gives the counts with the IPC and the misses per thousand instructions (MPKI).
+
+   usage: compile perfCounters.c together with the program, elsewhere than Linux every counter is unavailable
+*/
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum PerfCounter { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_LLCMISSES, COUNTER_BRANCHMISSES, COUNTER_DTLBMISSES,
+                   PERFCOUNTERS };
+
+struct PerfCounters {
+  int fds[PERFCOUNTERS];  /* -1 for a counter that could not be opened */
+  bool open;              /* at least one counter opened */
+  int error;              /* errno of the first counter that failed, 0 if none */
+};
+
+/* Raw counts, scaled only when printed so differences of two readings stay exact */
+struct PerfSample {
+  uint64_t value[PERFCOUNTERS];
+  uint64_t enabled[PERFCOUNTERS];  /* nanoseconds the counter was enabled */
+  uint64_t running[PERFCOUNTERS];  /* nanoseconds it was on the PMU */
+  bool valid[PERFCOUNTERS];
+};
+
+/* Starts counting the calling thread, and the threads it creates from now on if inherit. False if no counter opened */
+bool perfOpen(struct PerfCounters *counters, bool inherit);
+
+void perfClose(struct PerfCounters *counters);
+
+/* The counts so far, every counter invalid if counters is not open */
+void perfRead(const struct PerfCounters *counters, struct PerfSample *sample);
+
+/* sample becomes the counts between start and sample */
+void perfSubtract(struct PerfSample *sample, const struct PerfSample *start);
+
+/* Adds the counts of from to into, for totals over threads. A counter is valid if it is valid in both */
+void perfAdd(struct PerfSample *into, const struct PerfSample *from);
+
+/* An empty sample to add to */
+void perfZero(struct PerfSample *sample);
+
+/* One line: title, the counts, IPC and MPKI */
+void perfPrint(const struct PerfSample *sample, const char *title);
+
+/* Stores the counts since *since in phase unless it is NULL and restarts *since at now, so consecutive phases are
+   timed without printing in between */
+void perfPhase(const struct PerfCounters *counters, struct PerfSample *since, struct PerfSample *phase);
+
+#endif
@@ -1,98 +1,543 @@
 /* quicksort using OpenMP
 
-   usage with gcc (version 4.2 or higher required):
-     gcc -O -fopenmp -o quicksort-openmp quicksort-openmp.c 
-     ./quicksort-openmp size numWorkers
+   features: the array is generated in parallel by generator.c, --seed makes it reproducible for any number of workers
+             and --dist picks the distribution.
+             Ranges of PARALLELCUTOFF elements or more are partitioned by the whole team with two taskloops
+             (parallelPartition.c), so the first levels of the recursion no longer run on a single thread.
+             Pivots are ninthers, partitions are three way and ranges partitioned more than 2 log2 n times are heapsorted
+             (introsort.c), so sorted, reversed and duplicate heavy input stay O(n log n) with O(log n) stack.
+             Keys are partitioned without branches (BlockQuicksort) unless the pivot sample shows duplicates, and small
+             ranges are finished by an AVX2 sorting network or insertion sort, SORTLEAF and SORTLEAFSIZE pick them.
+             --radix sorts the keys, all below KEYRANGE, with the parallel LSD radix sort of radixSort.c instead.
+             --quantiles q1,q2,... finds those order statistics (nearest rank) and --partial k sorts the k smallest keys
+             instead of the whole array: the same partitions run, but only the sides holding a wanted rank are followed,
+             each by a task of its own. Both are checked against a sorted copy.
+             Task granularity adapts to the run: a range becomes a task only if it is larger than the cutoff
+             size / (TASKSPERTHREAD * threads), so there are about that many tasks per thread whatever the size, the
+             cores or the pivots. The cutoff never drops below a minimum calibrated at startup, the size whose sort
+             costs MINTASKCOST times the measured overhead of a task. Tasks whose range is within twice the cutoff are
+             final, everything below them runs serially without creating tasks, and tasks are untied so a thread
+             waiting in a taskwait can leave them to another. --tasks-per-thread m changes the multiple, --cutoff n
+             fixes the cutoff instead (the old rule was 50000). The tasks spawned and the ranges sorted inline are counted.
+             quicksortOpenmpCore sorts with the adaptive cutoff for bench.c, -DNO_MAIN drops main when linking it there.
+             Compiled with -DTRACE and trace.c every thread of the team records a timeline (trace.h): the partitions, the
+             serial sorts, the final tasks and the waits in taskwait. An untied task that resumes on another thread after
+             its taskwait records the wait on that thread.
+             --counters reads hardware counters (perfCounters.c): cycles, instructions, LLC, branch and dTLB misses of
+             the whole process for the generation and the sort, and of every thread of the team in its own group for its
+             part of the sort, the waits at the end of the region included, printed with IPC and misses per thousand
+             instructions. There is no merge phase, the sort ends in place. Without counters it runs as usual.
+
+   usage with gcc (version 6 or higher required, for taskloop):
+     gcc -O -fopenmp -o quicksort-openmp quicksort-openmp.c parallelPartition.c introsort.c radixSort.c generator.c perfCounters.c -lm
+     ./quicksort-openmp [--seed n] [--dist name] [--radix] [--quantiles q1,q2,...] [--partial k] [--tasks-per-thread m] [--cutoff n] [--counters] size numWorkers
+     gcc -O -fopenmp -DTRACE ... trace.c, then TRACEFILE=openmp.json ./quicksort-openmp 10000000 4 writes the timeline
 
 */
 
 #include <omp.h>
-#include <stdlib.h> /* To allow use of rand function */
-#include <time.h> /* Only to allow random seed on the rand function */
+#include <stdlib.h>
+#include <time.h> /* Only to allow a random default seed */
+#include <getopt.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include "generator.h"
+#include "parallelPartition.h"
+#include "introsort.h"
+#include "radixSort.h"
+#include "benchCore.h"
+#include "perfCounters.h"
+#include "trace.h"
 
-double start_time, end_time;
+static double start_time, end_time;
 
 #include <stdio.h>
 #define MAXSIZE 5000000  /* maximum array size */
 #define MAXWORKERS 8   /* maximum number of workers */
+#define KEYRANGE 1000000 /* keys are generated in [0, KEYRANGE) */
+#define MAXQUANTILES 64 /* most quantiles --quantiles takes */
+#define TASKSPERTHREAD 8 /* default tasks per thread the cutoff aims for */
+#define MINTASKCOST 20   /* a task must sort at least this many times its own overhead */
+#define PROBETASKS 1024  /* empty tasks spawned to measure the task overhead */
+#define PROBESIZE 16384  /* keys sorted to measure the cost of sorting per key */
+
+static int numWorkers;
+
+static bool counting;                       /* true with --counters once the counters of the process are open */
+static struct PerfCounters processCounters; /* opened by main before the team exists, so they count every thread */
+static struct PerfSample threadCounts[MAXWORKERS]; /* what each thread of the team counted in its own group */
+static int size; 
 
-int numWorkers;
-int size; 
+/* How large a range must be to become a task, and what happened in the last run */
+struct Granularity {
+    long cutoff;          /* ranges larger than this become tasks */
+    long minimum;         /* calibrated smallest cutoff worth a task */
+    int tasksPerThread;
+    double taskSeconds;   /* overhead of spawning and running an empty task */
+    double keySeconds;    /* time to sort one key of a PROBESIZE range */
+    long spawned;         /* tasks created */
+    long inlined;         /* ranges sorted or selected by the task that partitioned them */
+};
+
+static struct Granularity grain;
 
 /* Helper function to swap the contents of two pointers */
-void swap(int *a, int *b) {
+static void swap(int *a, int *b) {
   int t = *a;
   *a = *b;
   *b = t;
 }
 
-/* Function that implements quicksort algorithm using omp for parallelism. It accepts an array and the indicies that mark the boudary of the part of the array to work on */
-void quicksort(int array[], int low, int high) {
-    if (low < high) { /* Terminaton condition, when low = high there is only one element left and the recursion should end */
-        int pivot = array[high]; /* Pivot is arbitrarily chosen to be the last element in the subarray */
-        int i = (low - 1); /* Variable that keeps track of the boundary between numbers lower and higher than pivot */
-        for (int j = low; j < high; j++) {
-            if (array[j] <= pivot) { /* If value is smaller than pivot place it in the front part of the subarray*/
-                i++;
-                swap(&array[i], &array[j]);
+/* Partitions array[low..high) around pivot with the whole team, two taskloops run the two phases of parallelPartition.c.
+   Returns the split, [low, split) <= pivot < [split, high) */
+long partitionTogether(int array[], long low, long high, int pivot, int parts) {
+    struct ParallelPartition partition;
+    partitionInit(&partition, array, low, high, pivot, parts);
+    #pragma omp taskloop grainsize(1) shared(partition) /* partition would be firstprivate in the tasks otherwise */
+    for (int k = 0; k < parts; k++) {
+        partitionPart(&partition, k);
+    }
+    partitionPlan(&partition);
+    #pragma omp taskloop grainsize(1) shared(partition)
+    for (int k = 0; k < parts; k++) {
+        partitionSwapPart(&partition, k);
+    }
+    return partition.split;
+}
+
+/* Partitions a large range with the whole team like introPartition: the pivot waits at high while the parts are partitioned,
+   a second pass splits the elements equal to the pivot off when most of the range ended up <= pivot.
+   Afterwards [low, lt) <= pivot, [lt, gt] == pivot and (gt, high] > pivot */
+void partitionLarge(int array[], long low, long high, int parts, long *lt, long *gt) {
+    swap(&array[choosePivot(array, low, high)], &array[high]);
+    int pivot = array[high];
+    long split = partitionTogether(array, low, high, pivot, parts);
+    *lt = split;
+    parts = partitionParts(split - low, omp_get_num_threads());
+    if (2 * (split - low) > high - low && pivot > INT_MIN && parts > 1) { /* Mostly <= pivot, split off the == pivot */
+        *lt = partitionTogether(array, low, split, pivot - 1, parts);
+    }
+    swap(&array[split], &array[high]);
+    *gt = split;
+}
+
+/* Measures the overhead of a task and the cost of sorting a key with the whole team, the smallest cutoff worth a task
+   is the size whose sort costs MINTASKCOST task overheads */
+void calibrateGranularity(struct Granularity *grain) {
+    int *keys = malloc(PROBESIZE * sizeof(int));
+    unsigned int random = 12345;
+    for (int i = 0; i < PROBESIZE; i++) {
+        random = random * 1103515245 + 12345;
+        keys[i] = random >> 1;
+    }
+    double start = omp_get_wtime();
+    introsort(keys, 0, PROBESIZE - 1, introDepth(PROBESIZE));
+    grain->keySeconds = (omp_get_wtime() - start) / PROBESIZE;
+    free(keys);
+
+    #pragma omp parallel
+    {
+        #pragma omp single
+        {
+            long ran = 0;
+            double start = omp_get_wtime();
+            for (int i = 0; i < PROBETASKS; i++) {
+                #pragma omp task untied shared(ran) /* the increment keeps the task from being optimized away */
+                {
+                    #pragma omp atomic
+                    ran++;
+                }
             }
+            #pragma omp taskwait
+            grain->taskSeconds = (omp_get_wtime() - start) / PROBETASKS;
         }
-        swap(&array[i + 1], &array[high]); /* Once all elements of subarray has been sorted into smaller and bigger than pivot place pivot in correct position */
-        pivot = i + 1;
+    }
+    grain->minimum = (long) (MINTASKCOST * grain->taskSeconds / grain->keySeconds);
+    if (grain->minimum < PROBESIZE / 16) grain->minimum = PROBESIZE / 16;
+}
 
-        if ((high - low) > 50000){ /* Thershold to stop spawning too small parallel tasks that cause worse performance */      
-            #pragma omp task /* Parallel task for each recusive call */
-            quicksort(array, low, pivot - 1);
+/* Cutoff for sorting size keys, about tasksPerThread tasks per thread but none smaller than the calibrated minimum */
+void setCutoff(struct Granularity *grain, long size, int threads) {
+    grain->cutoff = size / ((long) grain->tasksPerThread * threads);
+    if (grain->cutoff < grain->minimum) grain->cutoff = grain->minimum;
+    grain->spawned = grain->inlined = 0;
+}
 
-            #pragma omp task
-            quicksort(array, pivot + 1, high);
+/* Function that implements quicksort algorithm using omp for parallelism. It accepts an array and the indicies that mark the boudary of the part of the array to work on.
+   Pivots are ninthers, partitions are three way and a range is heapsorted once depth partitions have led to it (introsort.c) */
+static void quicksort(int array[], int low, int high, int depth) {
+    if (low < high) { /* Terminaton condition, when low = high there is only one element left and the recursion should end */
+        long lt, gt;
+        TRACE_START(traced);
+        if (omp_in_final()) { /* A final task sorts its whole range on its own */
+            introsort(array, low, high, depth);
+            TRACE_SPAN("final", traced, high - low + 1);
+            return;
+        }
+        if (depth <= 0) { /* Too many bad pivots on the way here, heapsort keeps it O(n log n) */
+            heapsortRange(array, low, high);
+            return;
+        }
+        int parts = partitionParts(high - low, omp_get_num_threads());
+        if (parts > 1) { /* Large range, every part is partitioned by a task and the misplaced elements are swapped by another */
+            partitionLarge(array, low, high, parts, &lt, &gt);
+        } else {
+            introPartition(array, low, high, &lt, &gt); /* Elements equal to the pivot end up in [lt, gt] and are done */
+        }
+        TRACE_SPAN("partition", traced, high - low + 1);
 
+        /* The left side becomes a task if it is above the cutoff, the right side is sorted by this task, so every
+           large partition costs one task. Sides at or below the cutoff are sorted serially right here */
+        long leftSize = lt - low, rightSize = high - gt;
+        bool spawnLeft = leftSize > grain.cutoff;
+        if (spawnLeft) {
+            #pragma omp atomic
+            grain.spawned++;
+            #pragma omp task final(leftSize <= 2 * grain.cutoff) mergeable untied
+            quicksort(array, low, lt - 1, depth - 1);
+        }
+        if (rightSize > grain.cutoff) {
+            quicksort(array, gt + 1, high, depth - 1);
+        } else {
+            #pragma omp atomic
+            grain.inlined++;
+            TRACE_RESET(traced);
+            introsort(array, gt + 1, high, depth - 1);
+            TRACE_SPAN("sort", traced, rightSize);
+        }
+        TRACE_RESET(traced);
+        if (spawnLeft) {
             #pragma omp taskwait /* To ensure all tasks are allowed to complete */
+            TRACE_SPAN("taskwait", traced, leftSize);
         } else {
-            quicksort(array, low, pivot - 1);
-            quicksort(array, pivot + 1, high);
+            #pragma omp atomic
+            grain.inlined++;
+            introsort(array, low, lt - 1, depth - 1);
+            TRACE_SPAN("sort", traced, leftSize);
         }
     }
 }
 
+/* Puts the elements of the ascending ranks in their sorted positions, the quickselect counterpart of quicksort.
+   The sides holding no rank are dropped, the left one holding some becomes a task and the right one is followed here */
+void selectMany(int array[], long low, long high, const long ranks[], int count, int depth) {
+    while (count > 0 && low < high) {
+        long lt, gt;
+        int parts = partitionParts(high - low, omp_get_num_threads());
+        if (high - low < grain.cutoff || depth <= 0 || omp_in_final()) { /* Same cutoff as the quicksort */
+            #pragma omp atomic
+            grain.inlined++;
+            introselectMany(array, low, high, ranks, count, depth);
+            break;
+        }
+        depth--;
+        if (parts > 1) partitionLarge(array, low, high, parts, &lt, &gt);
+        else introPartition(array, low, high, &lt, &gt);
+        int left = 0, right;
+        while (left < count && ranks[left] < lt) left++;
+        for (right = left; right < count && ranks[right] <= gt; right++); /* the ranks in [lt, gt] hold the pivot, done */
+        if (left > 0) {
+            #pragma omp atomic
+            grain.spawned++;
+            #pragma omp task final(lt - low <= 2 * grain.cutoff) mergeable untied
+            selectMany(array, low, lt - 1, ranks, left, depth);
+        }
+        ranks += right;
+        count -= right;
+        low = gt + 1;
+    }
+    #pragma omp taskwait
+}
+
+/* One benchmark run (benchCore.h): run->size keys sorted by a team of run->threads threads with the adaptive cutoff,
+   timed like main without the calibration */
+bool quicksortOpenmpCore(struct BenchRun *run) {
+    struct Generator generator;
+    size = run->size;
+    numWorkers = run->threads < 1 ? 1 : run->threads > MAXWORKERS ? MAXWORKERS : run->threads;
+    run->threads = numWorkers;
+    omp_set_num_threads(numWorkers);
+    int *array = malloc((size > 0 ? size : 1) * sizeof(int));
+    if (array == NULL) return false;
+    generatorInit(&generator, run->distribution, KEYRANGE, run->seed);
+    #pragma omp parallel
+    {
+        long blocks = generatorBlocks(size);
+        int id = omp_get_thread_num(), threads = omp_get_num_threads();
+        generateBlocks(&generator, array, 1, size, size, blocks * id / threads, blocks * (id + 1) / threads);
+    }
+    introsortInit();
+    grain.tasksPerThread = TASKSPERTHREAD;
+    calibrateGranularity(&grain);
+    setCutoff(&grain, size, numWorkers);
+
+    start_time = omp_get_wtime();
+    #pragma omp parallel
+    {
+        TRACE_THREAD("openmp", omp_get_thread_num());
+        #pragma omp single
+        quicksort(array, 0, size - 1, introDepth(size));
+    }
+    end_time = omp_get_wtime();
+
+    run->seconds = end_time - start_time;
+    run->correct = true;
+    for (int i = 1; i < size; i++) {
+        if (array[i - 1] > array[i]) run->correct = false;
+    }
+    run->checksum = hashInts(array, size);
+    free(array);
+    return true;
+}
+
+#ifndef NO_MAIN
+/* Nearest rank of quantile q among n keys, as in stats.c: the smallest rank with at least q n keys at or below it */
+long quantileRank(double q, long n) {
+    long rank = (long) ceil(q * n) - 1;
+    return rank < 0 ? 0 : rank >= n ? n - 1 : rank;
+}
+
+int compareLongs(const void *a, const void *b) {
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+/* Opens a group for the calling thread of the team, its counts start at start */
+static void threadCountersOpen(struct PerfCounters *counters, struct PerfSample *start) {
+    if (perfOpen(counters, false)) perfRead(counters, start);
+}
+
+/* Adds what the calling thread counted since threadCountersOpen to its total and closes the group */
+static void threadCountersClose(struct PerfCounters *counters, const struct PerfSample *start) {
+    struct PerfSample sample;
+    if (!counters->open) return;
+    perfRead(counters, &sample);
+    perfSubtract(&sample, start);
+    perfAdd(&threadCounts[omp_get_thread_num()], &sample);
+    perfClose(counters);
+}
+
 int main(int argc, char *argv[]) {
-    int i;
-    srand(time(NULL)); /* Added to get random seed so the matrix is not identical each time */
+    int option;
+    unsigned long long seed = time(NULL); /* Random seed so the array is not identical each time unless --seed is given */
+    enum Distribution distribution = DIST_UNIFORM;
+    struct Generator generator;
+    static struct option options[] = {
+        { "seed", required_argument, NULL, 'S' },
+        { "dist", required_argument, NULL, 'd' },
+        { "radix", no_argument, NULL, 'r' },
+        { "quantiles", required_argument, NULL, 'q' },
+        { "partial", required_argument, NULL, 'k' },
+        { "tasks-per-thread", required_argument, NULL, 'm' },
+        { "cutoff", required_argument, NULL, 'c' },
+        { "counters", no_argument, NULL, 'C' },
+        { NULL, 0, NULL, 0 }
+    };
+    long fixedCutoff = 0;
+    bool radix = false;
+    double quantiles[MAXQUANTILES];
+    long ranks[MAXQUANTILES], partial = 0;
+    int numQuantiles = 0, numRanks = 0;
+    char *next;
+    struct RadixSort sort;
+    struct PerfSample since, generation, sorting; /* counts of the phases, all threads */
+
+    /* read command line options, the remaining args are positional */
+    while ((option = getopt_long(argc, argv, "S:d:rq:k:m:c:C", options, NULL)) != -1) {
+        switch (option) {
+        case 'S': seed = strtoull(optarg, NULL, 0); break;
+        case 'd':
+            if (!parseDistribution(optarg, &distribution)) {
+                printf("Unknown distribution %s, expected uniform, sorted, reverse, few or zipf\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r': radix = true; break;
+        case 'q':
+            for (next = optarg; numQuantiles < MAXQUANTILES && *next != '\0'; next += *next == ',') {
+                char *end;
+                quantiles[numQuantiles] = strtod(next, &end);
+                if (end == next || quantiles[numQuantiles] < 0 || quantiles[numQuantiles] > 1) {
+                    printf("Invalid quantiles %s, expected numbers in [0, 1] separated by commas\n", optarg);
+                    return 1;
+                }
+                numQuantiles++;
+                next = end;
+            }
+            break;
+        case 'k': partial = atol(optarg); break;
+        case 'm': grain.tasksPerThread = atoi(optarg); break;
+        case 'c': fixedCutoff = atol(optarg); break;
+        case 'C': counting = true; break;
+        default: return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
     /* read command line args if any */
     size = (argc > 1)? atoi(argv[1]) : MAXSIZE;
     numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
     if (size > MAXSIZE) size = MAXSIZE;
     if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
+    if (numWorkers < 1) numWorkers = 1; /* 0 or garbage would divide by zero in the cutoff */
 
     omp_set_num_threads(numWorkers);
+    if (counting && !perfOpen(&processCounters, true)) {
+        printf("Hardware counters unavailable (%s), running without them\n", strerror(processCounters.error));
+        counting = false;
+    }
+    for (int t = 0; t < MAXWORKERS; t++) perfZero(&threadCounts[t]);
 
-    int *array = malloc(size * sizeof(int)); /* Create an populate array */
-    for (i = 0; i < size; i++) {
-        array[i] = rand()%1000000;
+    int *array = malloc(size * sizeof(int)); /* Create an populate array, each thread generates a contiguous range of blocks */
+    generatorInit(&generator, distribution, KEYRANGE, seed);
+    if (counting) perfPhase(&processCounters, &since, NULL);
+    start_time = omp_get_wtime();
+    #pragma omp parallel
+    {
+        long blocks = generatorBlocks(size);
+        int id = omp_get_thread_num(), threads = omp_get_num_threads();
+        generateBlocks(&generator, array, 1, size, size, blocks * id / threads, blocks * (id + 1) / threads);
     }
+    end_time = omp_get_wtime();
+    if (counting) perfPhase(&processCounters, &since, &generation);
+    printf("The generation time is %g sec (seed %llu, %s)\n", end_time - start_time, seed, distributionName(distribution));
   
+    introsortInit(); /* pick the leaf kernel for this CPU */
+    if (grain.tasksPerThread < 1) grain.tasksPerThread = TASKSPERTHREAD;
+    calibrateGranularity(&grain);
+    if (fixedCutoff > 0) grain.minimum = fixedCutoff, grain.tasksPerThread = INT_MAX / numWorkers; /* the cutoff is the minimum */
+    setCutoff(&grain, size, numWorkers);
+    if (partial > size) partial = size;
+    for (int i = 0; i < numQuantiles; i++) ranks[i] = quantileRank(quantiles[i], size);
+    qsort(ranks, numQuantiles, sizeof(long), compareLongs);
+    for (int i = 0; i < numQuantiles; i++) { /* the ranks must be ascending and distinct */
+        if (numRanks == 0 || ranks[i] != ranks[numRanks - 1]) ranks[numRanks++] = ranks[i];
+    }
+    int *sorted = NULL;
+    if ((numRanks > 0 || partial > 0) && size > 0) { /* sorted copy to check the selection against */
+        sorted = malloc(size * sizeof(int));
+        memcpy(sorted, array, size * sizeof(int));
+        introsort(sorted, 0, size - 1, introDepth(size));
+    }
+    if (counting) perfPhase(&processCounters, &since, NULL);
     start_time = omp_get_wtime();
 
-    #pragma omp parallel
-    {
-        #pragma omp single /* One thread starts the recursion */
+    if (sorted != NULL) {
+        #pragma omp parallel
+        {
+            struct PerfCounters counters;
+            struct PerfSample start;
+            if (counting) threadCountersOpen(&counters, &start);
+            #pragma omp single /* One thread starts the selection */
+            {
+                if (partial > 0) { /* the k smallest end up before rank k - 1, which are then sorted */
+                    long rank = partial - 1;
+                    selectMany(array, 0, size - 1, &rank, 1, introDepth(size));
+                    quicksort(array, 0, rank - 1, introDepth(rank));
+                } else {
+                    selectMany(array, 0, size - 1, ranks, numRanks, introDepth(size));
+                }
+            }
+            if (counting) threadCountersClose(&counters, &start); /* after the barrier of single, every task is done */
+        }
+    } else if (radix) {
+        if (!radixInit(&sort, array, size, KEYRANGE - 1, radixParts(size, numWorkers))) {
+            printf("Could not allocate the radix sort buffers\n");
+            return 1;
+        }
+        #pragma omp parallel
+        {
+            struct PerfCounters counters;
+            struct PerfSample start;
+            if (counting) threadCountersOpen(&counters, &start);
+            while (sort.pass < sort.passes) { /* every thread sees the same pass, it only changes in the single below */
+                #pragma omp for
+                for (int k = 0; k < sort.parts; k++) {
+                    radixCount(&sort, k);
+                }
+                #pragma omp single
+                radixPlan(&sort);
+                #pragma omp for
+                for (int k = 0; k < sort.parts; k++) {
+                    radixScatter(&sort, k);
+                }
+                #pragma omp single
+                radixFinishPass(&sort);
+            }
+            #pragma omp for
+            for (int k = 0; k < sort.parts; k++) {
+                radixCopyBack(&sort, k);
+            }
+            if (counting) threadCountersClose(&counters, &start);
+        }
+        radixFree(&sort);
+    } else {
+        #pragma omp parallel
         {
-            quicksort(array, 0, size-1);
+            struct PerfCounters counters;
+            struct PerfSample start;
+            TRACE_THREAD("openmp", omp_get_thread_num());
+            if (counting) threadCountersOpen(&counters, &start);
+            #pragma omp single /* One thread starts the recursion */
+            {
+                quicksort(array, 0, size-1, introDepth(size));
+            }
+            if (counting) threadCountersClose(&counters, &start);
         }
     }
 
     end_time = omp_get_wtime(); 
+    if (counting) perfPhase(&processCounters, &since, &sorting);
 
-    printf("The execution time is %g sec\n", end_time - start_time);
+    if (sorted != NULL && partial > 0) {
+        printf("The execution time is %g sec (partial sort of the %ld smallest keys%s)\n", end_time - start_time, partial,
+               memcmp(array, sorted, partial * sizeof(int)) == 0 ? "" : ", wrong");
+    } else if (sorted != NULL) {
+        for (int i = 0; i < numQuantiles; i++) {
+            long rank = quantileRank(quantiles[i], size);
+            printf("The %g quantile is %d%s\n", quantiles[i], array[rank], array[rank] == sorted[rank] ? "" : " (wrong)");
+        }
+        printf("The execution time is %g sec (selecting %d quantiles)\n", end_time - start_time, numQuantiles);
+    } else if (radix) {
+        printf("The execution time is %g sec (radix sort, %d passes of %d bits, %d parts)\n", end_time - start_time, sort.passes,
+               sort.digitBits, sort.parts);
+    } else {
+        printf("The execution time is %g sec (%s leaves up to %d)\n", end_time - start_time, introsortName(), introsortLeafSize());
+    }
+    if (!radix) {
+        printf("The cutoff is %ld keys (%s, %ld tasks spawned, %ld ranges inlined, a task costs %g us, a key %g ns to sort)\n",
+               grain.cutoff, fixedCutoff > 0 ? "fixed" : "adaptive", grain.spawned, grain.inlined, grain.taskSeconds * 1e6,
+               grain.keySeconds * 1e9);
+    }
+    if (counting) {
+        struct PerfSample threads;
+        char title[32];
+        printf("Counters per phase, all threads:\n");
+        perfPrint(&generation, "  generation");
+        perfPrint(&sorting, sorted != NULL ? "  selection" : radix ? "  radix sort" : "  sort");
+        printf("Counters per thread of the team, its part of the %s:\n", sorted != NULL ? "selection" : "sort");
+        perfZero(&threads);
+        for (int t = 0; t < numWorkers; t++) {
+            snprintf(title, sizeof(title), "  thread %d", t);
+            perfPrint(&threadCounts[t], title);
+            perfAdd(&threads, &threadCounts[t]);
+        }
+        perfPrint(&threads, "  all threads");
+        perfClose(&processCounters);
+    }
 
     #ifdef DEBUG
     int printout = size > 20 ? 20 : size;
     printf("[ %d", array[0]);
-    for (i = 1; i < size; i++) {
+    for (int i = 1; i < size; i++) {
         printf(", %d", array[i]);
     }
     printf(" ]\n");
     #endif
 
-}
\ No newline at end of file
+    free(sorted);
+
+}
+#endif
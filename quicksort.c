@@ -1,14 +1,42 @@
 /* quicksort function for array of ints
 
    features: spawns pthreads recursively
+             The array is generated in parallel by generator.c, --seed makes it reproducible and --dist picks the distribution.
+             The same sort also runs on a fixed pool of --threads workers (default one per core, taskPool.c) where every
+             partition larger than STEALCUTOFF becomes a task on the worker's deque that idle workers can steal,
+             it reports the tasks, steals and idle time of the pool. --sweep runs the pool with 1, 2, 4, ... up to the
+             number of cores and compares every run with spawning threads per partition.
+             On the pool, ranges of PARALLELCUTOFF elements or more are partitioned by several workers together
+             (parallelPartition.c), so the first levels of the recursion no longer run on a single core.
+             All three sorts pick ninther pivots, partition three ways and heapsort any range that has been partitioned
+             more than 2 log2 n times (introsort.c), so sorted, reversed and duplicate heavy input stay O(n log n).
+             Keys are partitioned without branches (BlockQuicksort) unless the pivot sample shows duplicates, and small
+             ranges are finished by an AVX2 sorting network or insertion sort, SORTLEAF and SORTLEAFSIZE pick them.
+             --radix also sorts the keys, all below KEYRANGE, with the parallel LSD radix sort of radixSort.c on the pool.
+             --external sorts a binary file of ints into another one instead, using --memory megabytes (default MEMORY)
+             for sorted runs and a k-way merge (externalSort.c), and prints the bytes/sec of both phases.
+             --quantiles q1,q2,... finds those order statistics (nearest rank) and --partial k the k smallest keys in order
+             on the pool without sorting everything: ranges of PARALLELCUTOFF or more holding a wanted rank are partitioned
+             by all workers, the sides without one are dropped and the ranges left are selected by a task each.
+             quicksortSpawnCore and quicksortPoolCore time the two parallel sorts for bench.c (compile with -DNO_MAIN there).
+             Compiled with -DTRACE and trace.c the sorts record a timeline (trace.h): every spawned thread its partition,
+             the sequential sort of its sides or its wait in pthread_join, every pool worker its tasks and idle time.
+             --counters reads hardware counters (perfCounters.c): cycles, instructions, LLC, branch and dTLB misses of
+             the whole process for the generation, each sort and the check of the pool's result, and of every thread
+             the pthread quicksort spawns in its own group, printed with IPC and misses per thousand instructions.
+             Without counters, or with --sweep, it runs as usual.
 
    usage under Windows:
-     gcc -o quicksort quicksort.c -lpthread -DDEBUG
-     quicksort size
+     gcc -o quicksort quicksort.c taskPool.c parallelPartition.c introsort.c radixSort.c externalSort.c parallelSort.c generator.c perfCounters.c -lpthread -lm -DDEBUG
+     quicksort [--seed n] [--dist name] [--threads n] [--sweep] [--radix] [--quantiles q1,q2,...] [--partial k] [--counters] size
+     quicksort [--threads n] [--memory megabytes] --external input output
 
    usage under Linux:
-     gcc quicksort.c -lpthread
-     a.out size
+     gcc quicksort.c taskPool.c parallelPartition.c introsort.c radixSort.c externalSort.c parallelSort.c generator.c perfCounters.c -lpthread -lm
+     a.out [--seed n] [--dist name] [--threads n] [--sweep] [--radix] [--quantiles q1,q2,...] [--partial k] [--counters] size
+     a.out [--threads n] [--memory megabytes] --external input output
+     head -c 8G /dev/urandom > keys.bin makes an input
+     gcc -O2 -DTRACE quicksort.c trace.c ... then TRACEFILE=quicksort.json ./a.out --threads 4 10000000 writes the timeline
 
 */
 #ifndef _REENTRANT 
@@ -18,34 +46,53 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
-#include <sys/time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include "generator.h"
+#include "taskPool.h"
+#include "parallelPartition.h"
+#include "introsort.h"
+#include "radixSort.h"
+#include "externalSort.h"
+#include "benchCore.h"
+#include "trace.h"
+#include "perfCounters.h"
 
 #define MAXSIZE 5000000;
+#define KEYRANGE 1000000 /* keys are generated in [0, KEYRANGE) */
+#define STEALCUTOFF 16384 /* partitions up to this size are sorted by the task that made them instead of becoming tasks */
+#define MEMORY 1024 /* default megabytes of buffers for --external */
+#define MAXQUANTILES 64 /* most quantiles --quantiles takes */
+#define MAXCOUNTED 256  /* spawned threads that get a line of their own with --counters */
 
-void quicksort(int array[], int low, int high);
-void *quicksortWorker(void* args);
+static void quicksort(int array[], int low, int high, int depth);
+static void *quicksortWorker(void* args);
 
-double start_time, end_time; /* start and end times */
-int arraySize;
-pthread_attr_t attr;
+static double start_time, end_time; /* start and end times */
+static int arraySize;
+static pthread_attr_t attr;
+static atomic_int threadsCreated; /* threads spawned by the pthread quicksort */
 
-/* timer */
-double read_timer() {
-    static bool initialized = false;
-    static struct timeval start;
-    struct timeval end;
-    if( !initialized )
-    {
-        gettimeofday( &start, NULL );
-        initialized = true;
-    }
-    gettimeofday( &end, NULL );
-    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+static bool counting;                       /* true with --counters once the counters of the process are open */
+static struct PerfCounters processCounters; /* opened by main before any other thread, so they count every thread */
+static struct PerfSample since, poolSort, poolCheck; /* start of the current phase, the phases inside timePool */
+static struct PerfSample threadCounts[MAXCOUNTED];   /* what each spawned thread counted in its own group */
+static atomic_int threadsCounted;
+
+/* timer, monotonic so a clock adjustment cannot skew a run */
+static double read_timer() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1.0e-9 * now.tv_nsec;
 }
 
 /* Helper function to swap the contents of two pointers */
-void swap(int *a, int *b) {
+static void swap(int *a, int *b) {
   int t = *a;
   *a = *b;
   *b = t;
@@ -56,29 +103,42 @@ struct Arguments {
     int *array;
     int low;
     int high;
+    int depth;
 };
 
 /* Since the pthread is passed a struct a function is required to unpack the struct and call the quicksort function */
-void *quicksortWorker(void* args) {
+static void *quicksortWorker(void* args) {
     struct Arguments* arguments = (struct Arguments*)args;
-    quicksort(arguments->array, arguments->low, arguments->high);
+    struct PerfCounters counters; /* the counts of this thread alone, its partition and the sorts below it */
+    struct PerfSample start;
+    TRACE_THREAD("quicksort", -1);
+    if (counting && perfOpen(&counters, false)) perfRead(&counters, &start);
+    quicksort(arguments->array, arguments->low, arguments->high, arguments->depth);
     free(arguments);
+    if (counting && counters.open) {
+        int index = atomic_fetch_add(&threadsCounted, 1);
+        if (index < MAXCOUNTED) {
+            perfRead(&counters, &threadCounts[index]);
+            perfSubtract(&threadCounts[index], &start);
+        }
+        perfClose(&counters);
+    }
     return NULL;
 }
 
-/* Function that implements quicksort algorithm using pthreads for parallelism. It accepts an array and the indicies that mark the boudary of the part of the array to work on */
-void quicksort(int array[], int low, int high) {
+/* Function that implements quicksort algorithm using pthreads for parallelism. It accepts an array and the indicies that mark the boudary of the part of the array to work on.
+   depth is the number of partitions left before the range is heapsorted instead (introsort.c) */
+static void quicksort(int array[], int low, int high, int depth) {
     if (low < high) { /* Terminaton condition, when low = high there is only one element left and the recursion should end */
-        int pivot = array[high]; /* Pivot is arbitrarily chosen to be the last element in the subarray */
-        int i = (low - 1); /* Variable that keeps track of the boundary between numbers lower and higher than pivot */
-        for (int j = low; j < high; j++) {
-          if (array[j] <= pivot) { /* If value is smaller than pivot place it in the front part of the subarray*/
-            i++;
-            swap(&array[i], &array[j]);
-          }
+        long lt, gt;
+        if (depth <= 0) { /* Too many bad pivots on the way here, heapsort keeps it O(n log n) */
+            heapsortRange(array, low, high);
+            return;
         }
-        swap(&array[i + 1], &array[high]); /* Once all elements of subarray has been sorted into smaller and bigger than pivot place pivot in correct position */
-        pivot = i + 1;
+        TRACE_START(traced);
+        introPartition(array, low, high, &lt, &gt); /* Elements equal to the pivot end up in [lt, gt] and are done */
+        TRACE_SPAN("partition", traced, high - low + 1);
+        TRACE_RESET(traced);
 
         if ((high - low) > (arraySize / 16) && (high - low) > 50000) { /* Allowing the function to spawn threads for small subarrays causes the overhead of creating the thread to take longer than to let the program run sequentially */  
             pthread_t leftThread, rightThread;
@@ -86,81 +146,657 @@ void quicksort(int array[], int low, int high) {
             struct Arguments* leftArgs = malloc(sizeof(struct Arguments));
             leftArgs->array = array;
             leftArgs->low = low;
-            leftArgs->high = pivot - 1;
+            leftArgs->high = lt - 1;
+            leftArgs->depth = depth - 1;
 
             struct Arguments* rightArgs = malloc(sizeof(struct Arguments));
             rightArgs->array = array;
-            rightArgs->low = pivot + 1;
+            rightArgs->low = gt + 1;
             rightArgs->high = high;
+            rightArgs->depth = depth - 1;
 
             pthread_create(&leftThread, &attr, quicksortWorker, leftArgs);
             pthread_create(&rightThread, &attr, quicksortWorker, rightArgs);
+            atomic_fetch_add(&threadsCreated, 2);
 
             pthread_join(leftThread, NULL);
             pthread_join(rightThread, NULL);
+            TRACE_SPAN("join", traced, 2);
         }
-        else {
-            quicksort(array, low, pivot - 1);
-            quicksort(array, pivot + 1, high);
+        else { /* No more threads below here, the sequential sort finishes with its leaf kernel */
+            introsort(array, low, lt - 1, depth - 1);
+            introsort(array, gt + 1, high, depth - 1);
+            TRACE_SPAN("sort", traced, high - low + 1);
         }
     }
 }
 
-/* Function that implements quicksort algorithm normally. It accepts an array and the indicies that mark the boudary of the part of the array to work on */
+/* Function that implements quicksort algorithm normally. It accepts an array and the indicies that mark the boudary of the part of the array to work on.
+   Pivots are ninthers, partitions are three way and ranges that run out of depth are heapsorted (introsort.c) */
 void quicksortSequential(int array[], int low, int high) {
-    if (low < high) { /* Terminaton condition, when low = high there is only one element left and the recursion should end */
-        int pivot = array[high]; /* Pivot is arbitrarily chosen to be the last element in the subarray */
-        int i = (low - 1); /* Variable that keeps track of the boundary between numbers lower and higher than pivot */
-        for (int j = low; j < high; j++) {
-          if (array[j] <= pivot) { /* If value is smaller than pivot place it in the front part of the subarray*/
-            i++;
-            swap(&array[i], &array[j]);
-          }
+    introsort(array, low, high, introDepth(high - low + 1));
+}
+
+void quicksortTask(struct TaskWorker *worker, void *context, long low, long high);
+void sortRange(struct TaskWorker *worker, int *array, long low, long high, int depth);
+
+/* The context of a quicksortTask, every task carries its own depth budget */
+struct SortRange {
+    int *array;
+    int depth;
+};
+
+/* Spawns a task sorting array[low..high - 1], or sorts it right away if there is no memory for the task */
+void spawnSort(struct TaskWorker *worker, int *array, long low, long high, int depth) {
+    struct SortRange *range = malloc(sizeof(struct SortRange));
+    if (range == NULL) {
+        introsort(array, low, high - 1, depth);
+        return;
+    }
+    range->array = array;
+    range->depth = depth;
+    taskSpawn(worker, quicksortTask, range, low, high);
+}
+
+/* A range being partitioned by several workers (parallelPartition.c). Nobody waits for the parts, the last part
+   of phase 1 plans and spawns phase 2 and the last part of phase 2 places the pivot and spawns the two halves.
+   When most of the range ends up <= pivot a second pass over that side splits off the elements equal to the pivot,
+   so heavy duplicates are not partitioned again and again */
+struct PartitionJob {
+    struct ParallelPartition partition;
+    atomic_int remaining; /* parts of the current phase that are not done */
+    int *array;
+    long low;
+    long high;            /* the pivot waits here until both passes are done */
+    long split;           /* [low, split) <= pivot after the first pass */
+    int pass;
+    int depth;
+};
+
+/* Spawns function for every part but the first and runs the first itself */
+void spawnParts(struct TaskWorker *worker, TaskFunction function, struct PartitionJob *job) {
+    int parts = job->partition.parts; /* read first, the last part to finish frees job */
+    atomic_store(&job->remaining, parts);
+    for (int k = 1; k < parts; k++) {
+        taskSpawn(worker, function, job, k, k + 1);
+    }
+    function(worker, job, 0, 1);
+}
+
+void partitionPartTask(struct TaskWorker *worker, void *context, long k, long end);
+
+void partitionSwapTask(struct TaskWorker *worker, void *context, long k, long end) {
+    struct PartitionJob *job = context;
+    (void) end;
+    partitionSwapPart(&job->partition, k);
+    if (atomic_fetch_sub(&job->remaining, 1) == 1) {
+        int *array = job->array, pivot = array[job->high], parts;
+        long low = job->low, high = job->high, lt;
+        if (job->pass == 0) {
+            job->split = job->partition.split;
+            parts = partitionParts(job->split - low, worker->pool->numWorkers);
+            if (2 * (job->split - low) > high - low && pivot > INT_MIN && parts > 1) { /* Second pass, < pivot from == pivot */
+                job->pass = 1;
+                partitionInit(&job->partition, array, low, job->split, pivot - 1, parts);
+                spawnParts(worker, partitionPartTask, job);
+                return;
+            }
+            lt = job->split;
+        } else {
+            lt = job->partition.split;
+        }
+        long split = job->split;
+        int depth = job->depth;
+        free(job);
+        swap(&array[split], &array[high]); /* [lt, split] now holds every element equal to the pivot */
+        spawnSort(worker, array, low, lt, depth);
+        sortRange(worker, array, split + 1, high + 1, depth);
+    }
+}
+
+void partitionPartTask(struct TaskWorker *worker, void *context, long k, long end) {
+    struct PartitionJob *job = context;
+    (void) end;
+    partitionPart(&job->partition, k);
+    if (atomic_fetch_sub(&job->remaining, 1) == 1) {
+        partitionPlan(&job->partition);
+        spawnParts(worker, partitionSwapTask, job);
+    }
+}
+
+/* Task for the work-stealing pool, sorts array[low..high - 1] and frees its SortRange */
+void quicksortTask(struct TaskWorker *worker, void *context, long low, long high) {
+    struct SortRange *range = context;
+    int *array = range->array, depth = range->depth;
+    free(range);
+    sortRange(worker, array, low, high, depth);
+}
+
+/* The first task of a sort, its SortRange belongs to the caller of taskPoolRun */
+void quicksortRootTask(struct TaskWorker *worker, void *context, long low, long high) {
+    struct SortRange *range = context;
+    sortRange(worker, range->array, low, high, range->depth);
+}
+
+/* Sorts array[low..high - 1] on the calling worker. Ranges of PARALLELCUTOFF elements or more are partitioned by
+   several workers, or by this one alone if there is no memory for the job. The left part of every large partition
+   is spawned for a thief to take and the task goes on with the right part, small parts are sorted right away */
+void sortRange(struct TaskWorker *worker, int *array, long low, long high, int depth) {
+    long lt, gt;
+    high--; /* tasks get half open ranges */
+    while (high - low > STEALCUTOFF) {
+        if (depth-- <= 0) {
+            heapsortRange(array, low, high);
+            return;
+        }
+        int parts = partitionParts(high - low, worker->pool->numWorkers);
+        struct PartitionJob *job = parts > 1 ? malloc(sizeof(struct PartitionJob)) : NULL;
+        if (job != NULL) {
+            swap(&array[choosePivot(array, low, high)], &array[high]); /* the pivot waits at high */
+            partitionInit(&job->partition, array, low, high, array[high], parts);
+            job->array = array;
+            job->low = low;
+            job->high = high;
+            job->pass = 0;
+            job->depth = depth;
+            spawnParts(worker, partitionPartTask, job);
+            return;
+        }
+        introPartition(array, low, high, &lt, &gt);
+        spawnSort(worker, array, low, lt, depth);
+        low = gt + 1;
+    }
+    introsort(array, low, high, depth);
+}
+
+/* True if the array is in non-decreasing order */
+bool isSorted(const int array[], int size) {
+    for (int i = 1; i < size; i++) {
+        if (array[i - 1] > array[i]) return false;
+    }
+    return true;
+}
+
+/* Sorts a fresh copy of the generated array with the spawning quicksort, returns the time and how many threads it made */
+double timeSpawning(struct Generator *generator, int *copy, int numCores, int *threads) {
+    generateInts(generator, copy, arraySize, numCores);
+    atomic_store(&threadsCreated, 0);
+    double start = read_timer();
+    quicksort(copy, 0, arraySize - 1, introDepth(arraySize));
+    double time = read_timer() - start;
+    *threads = atomic_load(&threadsCreated);
+    if (!isSorted(copy, arraySize)) printf("The pthread quicksort did not sort the array\n");
+    return time;
+}
+
+/* Sorts a fresh copy of the generated array on a pool of numThreads workers, returns the time and the pool counters */
+double timePool(struct Generator *generator, int *copy, int numCores, int numThreads, struct TaskStats *stats) {
+    struct TaskPool pool;
+    generateInts(generator, copy, arraySize, numCores);
+    if (!taskPoolInit(&pool, numThreads)) {
+        printf("Could not start %d workers\n", numThreads);
+        exit(1);
+    }
+    if (counting) perfPhase(&processCounters, &since, NULL);
+    double start = read_timer();
+    struct SortRange range = { copy, introDepth(arraySize) };
+    taskPoolRun(&pool, quicksortRootTask, &range, 0, arraySize);
+    double time = read_timer() - start;
+    if (counting) perfPhase(&processCounters, &since, &poolSort);
+    *stats = taskPoolStats(&pool);
+    taskPoolDestroy(&pool);
+    if (counting) perfPhase(&processCounters, &since, NULL);
+    if (!isSorted(copy, arraySize)) printf("The work-stealing quicksort did not sort the array\n");
+    if (counting) perfPhase(&processCounters, &since, &poolCheck);
+    return time;
+}
+
+/* The radix sort and the phase its parts run next, the context of radixPartTask */
+struct RadixJob {
+    struct RadixSort *sort;
+    void (*phase)(struct RadixSort *sort, int k);
+};
+
+/* Runs the phase for parts [low, high), every part but the first becomes a task of its own */
+void radixPartTask(struct TaskWorker *worker, void *context, long low, long high) {
+    struct RadixJob *job = context;
+    for (long k = low + 1; k < high; k++) {
+        taskSpawn(worker, radixPartTask, job, k, k + 1);
+    }
+    job->phase(job->sort, low);
+}
+
+/* Sorts a fresh copy of the generated array with the radix sort on a pool of numThreads workers, every phase is a job
+   of the pool so returning from taskPoolRun is the barrier between phases. Returns the time, sort keeps the digit layout */
+double timeRadix(struct Generator *generator, int *copy, int numCores, int numThreads, struct RadixSort *sort) {
+    struct TaskPool pool;
+    generateInts(generator, copy, arraySize, numCores);
+    if (!taskPoolInit(&pool, numThreads)) {
+        printf("Could not start %d workers\n", numThreads);
+        exit(1);
+    }
+    double start = read_timer();
+    if (!radixInit(sort, copy, arraySize, KEYRANGE - 1, radixParts(arraySize, pool.numWorkers))) {
+        printf("Could not allocate the radix sort buffers\n");
+        exit(1);
+    }
+    struct RadixJob count = { sort, radixCount }, scatter = { sort, radixScatter }, copyBack = { sort, radixCopyBack };
+    while (sort->pass < sort->passes) {
+        taskPoolRun(&pool, radixPartTask, &count, 0, sort->parts);
+        radixPlan(sort);
+        taskPoolRun(&pool, radixPartTask, &scatter, 0, sort->parts);
+        radixFinishPass(sort);
+    }
+    taskPoolRun(&pool, radixPartTask, &copyBack, 0, sort->parts);
+    radixFree(sort);
+    double time = read_timer() - start;
+    taskPoolDestroy(&pool);
+    if (!isSorted(copy, arraySize)) printf("The radix sort did not sort the array\n");
+    return time;
+}
+
+/* One phase of a partition by the whole pool, the context of partitionPhaseTask */
+struct PartitionPhase {
+    struct ParallelPartition *partition;
+    void (*phase)(struct ParallelPartition *partition, int k);
+};
+
+/* Runs the phase for parts [low, high), every part but the first becomes a task of its own */
+void partitionPhaseTask(struct TaskWorker *worker, void *context, long low, long high) {
+    struct PartitionPhase *phase = context;
+    for (long k = low + 1; k < high; k++) {
+        taskSpawn(worker, partitionPhaseTask, phase, k, k + 1);
+    }
+    phase->phase(phase->partition, low);
+}
+
+/* Partitions array[low..high) around pivot with every worker, each phase is a job so taskPoolRun is the barrier */
+long partitionWithPool(struct TaskPool *pool, int *array, long low, long high, int pivot, int parts) {
+    struct ParallelPartition partition;
+    struct PartitionPhase count = { &partition, partitionPart }, swaps = { &partition, partitionSwapPart };
+    partitionInit(&partition, array, low, high, pivot, parts);
+    taskPoolRun(pool, partitionPhaseTask, &count, 0, parts);
+    partitionPlan(&partition);
+    taskPoolRun(pool, partitionPhaseTask, &swaps, 0, parts);
+    return partition.split;
+}
+
+/* A range of the array and the ranks still to be found in it, ranks[first..first + count) in ascending order */
+struct SelectRange {
+    long low;
+    long high;
+    int first;
+    int count;
+    int depth;
+};
+
+/* The ranges left to the tasks of selectTask */
+struct SelectJob {
+    int *array;
+    const long *ranks;
+    struct SelectRange *ranges;
+};
+
+/* Selects the ranks of ranges [low, high), every range but the first becomes a task of its own */
+void selectTask(struct TaskWorker *worker, void *context, long low, long high) {
+    struct SelectJob *job = context;
+    for (long k = low + 1; k < high; k++) {
+        taskSpawn(worker, selectTask, job, k, k + 1);
+    }
+    struct SelectRange *range = &job->ranges[low];
+    introselectMany(job->array, range->low, range->high, job->ranks + range->first, range->count, range->depth);
+}
+
+/* Puts the elements of the ascending ranks of array[0..n - 1] in their sorted positions. A range large enough for
+   partitionParts is partitioned by the whole pool with the pivot and duplicate passes of the quicksort, the sides
+   holding no rank are never looked at again. The smaller ranges left over are selected by one task each.
+   Returns false, with the array untouched, if the ranges could not be allocated */
+bool selectWithPool(struct TaskPool *pool, int *array, long n, const long ranks[], int count) {
+    struct SelectRange *pending = malloc((count + 1) * sizeof(struct SelectRange)), *small = malloc((count + 1) * sizeof(struct SelectRange));
+    int numPending = 0, numSmall = 0;
+    if (pending == NULL || small == NULL) {
+        free(pending);
+        free(small);
+        return false;
+    }
+    if (count > 0) pending[numPending++] = (struct SelectRange) { 0, n - 1, 0, count, introDepth(n) };
+    while (numPending > 0) { /* every range holds a rank and ranges never overlap, so at most count of them */
+        struct SelectRange range = pending[--numPending];
+        long low = range.low, high = range.high, lt, gt;
+        int parts = partitionParts(high - low, pool->numWorkers);
+        if (parts <= 1 || range.depth <= 0) {
+            small[numSmall++] = range;
+            continue;
         }
-        swap(&array[i + 1], &array[high]); /* Once all elements of subarray has been sorted into smaller and bigger than pivot place pivot in correct position */
-        pivot = i + 1;
+        swap(&array[choosePivot(array, low, high)], &array[high]); /* the pivot waits at high */
+        int pivot = array[high];
+        long split = partitionWithPool(pool, array, low, high, pivot, parts);
+        lt = split;
+        parts = partitionParts(split - low, pool->numWorkers);
+        if (2 * (split - low) > high - low && pivot > INT_MIN && parts > 1) { /* Mostly <= pivot, split off the == pivot */
+            lt = partitionWithPool(pool, array, low, split, pivot - 1, parts);
+        }
+        swap(&array[split], &array[high]);
+        gt = split; /* [low, lt) <= pivot, [lt, gt] == pivot and done, (gt, high] > pivot */
+        int left = 0, right;
+        while (left < range.count && ranks[range.first + left] < lt) left++;
+        for (right = left; right < range.count && ranks[range.first + right] <= gt; right++);
+        if (left > 0) pending[numPending++] = (struct SelectRange) { low, lt - 1, range.first, left, range.depth - 1 };
+        if (right < range.count) {
+            pending[numPending++] = (struct SelectRange) { gt + 1, high, range.first + right, range.count - right, range.depth - 1 };
+        }
+    }
+    struct SelectJob job = { array, ranks, small };
+    if (numSmall > 0) taskPoolRun(pool, selectTask, &job, 0, numSmall);
+    free(pending);
+    free(small);
+    return true;
+}
+
+/* Nearest rank of quantile q among n keys, as in stats.c: the smallest rank with at least q n keys at or below it */
+static long quantileRank(double q, long n) {
+    long rank = (long) ceil(q * n) - 1;
+    return rank < 0 ? 0 : rank >= n ? n - 1 : rank;
+}
+
+static int compareLongs(const void *a, const void *b) {
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
 
-        quicksortSequential(array, low, pivot - 1);
-        quicksortSequential(array, pivot + 1, high);
+/* Selects the quantiles of a fresh copy of the generated array on the pool and checks them against the sorted array */
+double timeSelect(struct Generator *generator, int *copy, const int *sorted, int numCores, int numThreads, const double quantiles[], int count) {
+    struct TaskPool pool;
+    long ranks[MAXQUANTILES];
+    int unique = 0;
+    generateInts(generator, copy, arraySize, numCores);
+    if (!taskPoolInit(&pool, numThreads)) {
+        printf("Could not start %d workers\n", numThreads);
+        exit(1);
     }
+    for (int i = 0; i < count; i++) ranks[i] = quantileRank(quantiles[i], arraySize);
+    qsort(ranks, count, sizeof(long), compareLongs);
+    for (int i = 0; i < count; i++) { /* the ranks must be ascending and distinct */
+        if (unique == 0 || ranks[i] != ranks[unique - 1]) ranks[unique++] = ranks[i];
+    }
+    double start = read_timer();
+    bool selected = selectWithPool(&pool, copy, arraySize, ranks, unique);
+    double time = read_timer() - start;
+    taskPoolDestroy(&pool);
+    if (!selected) {
+        printf("Could not allocate the ranges of the selection\n");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++) {
+        long rank = quantileRank(quantiles[i], arraySize);
+        printf("The %g quantile is %d%s\n", quantiles[i], copy[rank], copy[rank] == sorted[rank] ? "" : " (wrong)");
+    }
+    return time;
+}
+
+/* Sorts the k smallest keys of a fresh copy of the generated array into copy[0..k - 1] on the pool: the rank k - 1 is
+   selected, then the pool quicksort sorts what is before it. Checks the result against the sorted array */
+double timePartial(struct Generator *generator, int *copy, const int *sorted, int numCores, int numThreads, long k) {
+    struct TaskPool pool;
+    long rank = k - 1;
+    generateInts(generator, copy, arraySize, numCores);
+    if (!taskPoolInit(&pool, numThreads)) {
+        printf("Could not start %d workers\n", numThreads);
+        exit(1);
+    }
+    double start = read_timer();
+    if (!selectWithPool(&pool, copy, arraySize, &rank, 1)) {
+        taskPoolDestroy(&pool);
+        printf("Could not allocate the ranges of the selection\n");
+        exit(1);
+    }
+    if (rank > 0) {
+        struct SortRange range = { copy, introDepth(rank) };
+        taskPoolRun(&pool, quicksortRootTask, &range, 0, rank);
+    }
+    double time = read_timer() - start;
+    taskPoolDestroy(&pool);
+    if (memcmp(copy, sorted, k * sizeof(int)) != 0) printf("The partial sort did not sort the %ld smallest keys\n", k);
+    return time;
 }
 
+/* Fills run->size keys with the run's distribution and seed for a benchmark core */
+static int *generateRun(struct BenchRun *run) {
+    struct Generator generator;
+    int *keys = malloc((run->size > 0 ? run->size : 1) * sizeof(int));
+    if (keys == NULL) return NULL;
+    arraySize = run->size;
+    generatorInit(&generator, run->distribution, KEYRANGE, run->seed);
+    generateInts(&generator, keys, arraySize, sysconf(_SC_NPROCESSORS_ONLN));
+    introsortInit();
+    return keys;
+}
+
+/* One benchmark run (benchCore.h) of the quicksort that spawns threads per partition. It spawns as many as the
+   sizes call for whatever run->threads is, so run->threads is set to the threads it made */
+bool quicksortSpawnCore(struct BenchRun *run) {
+    int *keys = generateRun(run);
+    if (keys == NULL) return false;
+    pthread_attr_init(&attr);
+    pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+    atomic_store(&threadsCreated, 0);
+    start_time = read_timer();
+    quicksort(keys, 0, arraySize - 1, introDepth(arraySize));
+    end_time = read_timer();
+    run->seconds = end_time - start_time;
+    run->threads = atomic_load(&threadsCreated) + 1;
+    run->correct = isSorted(keys, arraySize);
+    run->checksum = hashInts(keys, arraySize);
+    free(keys);
+    return true;
+}
 
+/* One benchmark run (benchCore.h) of the work-stealing quicksort on a pool of run->threads workers, the time
+   leaves out starting and stopping the pool */
+bool quicksortPoolCore(struct BenchRun *run) {
+    struct TaskPool pool;
+    int *keys = generateRun(run);
+    if (keys == NULL) return false;
+    if (!taskPoolInit(&pool, run->threads)) {
+        free(keys);
+        return false;
+    }
+    run->threads = pool.numWorkers;
+    struct SortRange range = { keys, introDepth(arraySize) };
+    start_time = read_timer();
+    taskPoolRun(&pool, quicksortRootTask, &range, 0, arraySize);
+    end_time = read_timer();
+    taskPoolDestroy(&pool);
+    run->seconds = end_time - start_time;
+    run->correct = isSorted(keys, arraySize);
+    run->checksum = hashInts(keys, arraySize);
+    free(keys);
+    return true;
+}
+
+#ifndef NO_MAIN
 int main(int argc, char *argv[]) {
-    srand(time(NULL)); /* Added to get random seed so the array is not identical each time */
-    int i;
+    int option;
+    unsigned long long seed = time(NULL); /* Random seed so the array is not identical each time unless --seed is given */
+    enum Distribution distribution = DIST_UNIFORM;
+    struct Generator generator;
+    int numCores = sysconf(_SC_NPROCESSORS_ONLN);
+    static struct option options[] = {
+        { "seed", required_argument, NULL, 'S' },
+        { "dist", required_argument, NULL, 'd' },
+        { "threads", required_argument, NULL, 't' },
+        { "sweep", no_argument, NULL, 'w' },
+        { "radix", no_argument, NULL, 'r' },
+        { "external", no_argument, NULL, 'x' },
+        { "memory", required_argument, NULL, 'm' },
+        { "quantiles", required_argument, NULL, 'q' },
+        { "partial", required_argument, NULL, 'k' },
+        { "counters", no_argument, NULL, 'c' },
+        { NULL, 0, NULL, 0 }
+    };
+    double quantiles[MAXQUANTILES];
+    int numQuantiles = 0;
+    long partial = 0;
+    char *next;
+    int numThreads = numCores, spawned;
+    bool sweep = false, radix = false, external = false;
+    long long memory = MEMORY;
+    struct TaskStats stats;
+    struct PerfSample generation, sequential, spawning; /* counts of the phases, all threads */
 
     /* set global thread attributes */
     pthread_attr_init(&attr);
     pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
 
+    /* read command line options, the remaining args are positional */
+    while ((option = getopt_long(argc, argv, "S:d:t:wrxm:q:k:c", options, NULL)) != -1) {
+        switch (option) {
+        case 'S': seed = strtoull(optarg, NULL, 0); break;
+        case 'd':
+            if (!parseDistribution(optarg, &distribution)) {
+                printf("Unknown distribution %s, expected uniform, sorted, reverse, few or zipf\n", optarg);
+                return 1;
+            }
+            break;
+        case 't': numThreads = atoi(optarg); break;
+        case 'w': sweep = true; break;
+        case 'r': radix = true; break;
+        case 'x': external = true; break;
+        case 'm': memory = atoll(optarg); break;
+        case 'q':
+            for (next = optarg; numQuantiles < MAXQUANTILES && *next != '\0'; next += *next == ',') {
+                char *end;
+                quantiles[numQuantiles] = strtod(next, &end);
+                if (end == next || quantiles[numQuantiles] < 0 || quantiles[numQuantiles] > 1) {
+                    printf("Invalid quantiles %s, expected numbers in [0, 1] separated by commas\n", optarg);
+                    return 1;
+                }
+                numQuantiles++;
+                next = end;
+            }
+            break;
+        case 'k': partial = atol(optarg); break;
+        case 'c': counting = true; break;
+        default: return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (external) { /* Sorts a file instead of generated arrays, only the runs and merge buffers are in memory */
+        struct ExternalSortStats stats;
+        if (argc < 3) {
+            printf("--external needs an input and an output file\n");
+            return 1;
+        }
+        if (!externalSort(argv[1], argv[2], memory << 20, numThreads, &stats)) return 1;
+        printf("The run phase took %g sec, %g MB/s (%d runs, %g sec sorting with %d threads)\n", stats.runSeconds,
+               stats.bytes / stats.runSeconds / 1e6, stats.runs, stats.sortSeconds, numThreads);
+        if (stats.runs > 1) {
+            printf("The merge phase took %g sec, %g MB/s (%ld byte buffers per run)\n", stats.mergeSeconds,
+                   stats.bytes / stats.mergeSeconds / 1e6, stats.mergeBuffer);
+        }
+        printf("The external sort of %lld bytes took %g sec in total\n", stats.bytes, stats.runSeconds + stats.mergeSeconds);
+        return 0;
+    }
+
     arraySize = (argc > 1)? atoi(argv[1]) : MAXSIZE;
+    counting = counting && !sweep; /* the sweep repeats the phases, only single runs are counted */
+    if (counting && !perfOpen(&processCounters, true)) {
+        printf("Hardware counters unavailable (%s), running without them\n", strerror(processCounters.error));
+        counting = false;
+    }
 
-    /* Two identical arrays are created */
+    /* Two identical arrays are created, the generator gives the same values for the same seed so both are generated in parallel */
     int *array = malloc(arraySize * sizeof(int));
     int *copy = malloc(arraySize * sizeof(int));
-    for (i = 0; i < arraySize; i++) {
-        array[i] = rand()%1000000;
-        copy[i] = array[i];
-    }
+    generatorInit(&generator, distribution, KEYRANGE, seed);
+    if (counting) perfPhase(&processCounters, &since, NULL);
+    start_time = read_timer();
+    generateInts(&generator, array, arraySize, numCores);
+    generateInts(&generator, copy, arraySize, numCores);
+    end_time = read_timer();
+    if (counting) perfPhase(&processCounters, &since, &generation);
+    printf("The generation time is %g sec (seed %llu, %s)\n", end_time - start_time, seed, distributionName(distribution));
+
+    introsortInit(); /* pick the leaf kernel for this CPU */
 
     /* Sequential quicksort is tested on the first array */
+    if (counting) perfPhase(&processCounters, &since, NULL);
     start_time = read_timer();
     quicksortSequential(array, 0, arraySize - 1);
     end_time = read_timer();
-    printf("The execution time for the regular quicksort is %g sec\n", end_time - start_time);
+    if (counting) perfPhase(&processCounters, &since, &sequential);
+    printf("The execution time for the regular quicksort is %g sec (%s leaves up to %d)\n", end_time - start_time, introsortName(), introsortLeafSize());
 
     /* Pthread quicksort is tested on the second array */
+    if (counting) perfPhase(&processCounters, &since, NULL);
     start_time = read_timer();
-    quicksort(copy, 0, arraySize - 1);
+    quicksort(copy, 0, arraySize - 1, introDepth(arraySize));
     end_time = read_timer();
+    if (counting) perfPhase(&processCounters, &since, &spawning);
     printf("The execution time for the pthread quicksort is %g sec\n", end_time - start_time);
 
+    if (sweep) { /* Every run sorts a freshly generated copy so all of them sort the same data */
+        printf("threads  spawning(sec)  created  pool(sec)  speedup  tasks  steals  failed  idle(sec)\n");
+        for (int threads = 1; ; threads = threads * 2 < numCores ? threads * 2 : numCores) {
+            double spawnTime = timeSpawning(&generator, copy, numCores, &spawned);
+            double poolTime = timePool(&generator, copy, numCores, threads, &stats);
+            printf("%7d  %13.6f  %7d  %9.6f  %7.2f  %5ld  %6ld  %6ld  %9.6f\n", threads, spawnTime, spawned, poolTime,
+                   spawnTime / poolTime, stats.tasks, stats.steals, stats.failedSteals, stats.idleSeconds);
+            if (threads >= numCores) break;
+        }
+    } else {
+        double poolTime = timePool(&generator, copy, numCores, numThreads, &stats);
+        printf("The execution time for the work-stealing quicksort is %g sec (%d workers, %ld tasks, %ld steals, %ld failed steals, %g sec idle)\n",
+               poolTime, numThreads, stats.tasks, stats.steals, stats.failedSteals, stats.idleSeconds);
+    }
+
+    if (counting) {
+        struct PerfSample threads;
+        char title[32];
+        int counted = atomic_load(&threadsCounted) < MAXCOUNTED ? atomic_load(&threadsCounted) : MAXCOUNTED;
+        printf("Counters per phase, all threads:\n");
+        perfPrint(&generation, "  generation");
+        perfPrint(&sequential, "  regular quicksort");
+        perfPrint(&spawning, "  pthread quicksort");
+        perfPrint(&poolSort, "  work-stealing quicksort");
+        perfPrint(&poolCheck, "  check");
+        printf("Counters per spawned thread of the pthread quicksort, in the order they finished:\n");
+        perfZero(&threads);
+        for (int t = 0; t < counted; t++) {
+            snprintf(title, sizeof(title), "  thread %d", t);
+            perfPrint(&threadCounts[t], title);
+            perfAdd(&threads, &threadCounts[t]);
+        }
+        perfPrint(&threads, "  all spawned threads");
+        perfClose(&processCounters);
+        counting = false; /* the runs below are not counted */
+    }
+
+    if (radix) {
+        struct RadixSort sort;
+        double radixTime = timeRadix(&generator, copy, numCores, numThreads, &sort);
+        printf("The execution time for the radix sort is %g sec (%d passes of %d bits, %d parts)\n", radixTime, sort.passes,
+               sort.digitBits, sort.parts);
+    }
+
+    if (numQuantiles > 0 && arraySize > 0) {
+        double selectTime = timeSelect(&generator, copy, array, numCores, numThreads, quantiles, numQuantiles);
+        printf("The execution time for selecting %d quantiles is %g sec (%d workers)\n", numQuantiles, selectTime, numThreads);
+    }
+
+    if (partial > 0) {
+        if (partial > arraySize) partial = arraySize;
+        double partialTime = timePartial(&generator, copy, array, numCores, numThreads, partial);
+        printf("The execution time for the partial sort of the %ld smallest keys is %g sec (%d workers)\n", partial, partialTime, numThreads);
+    }
+
     /* print the pthread quicksort array */
     #ifdef DEBUG
     int printout = arraySize > 20 ? 20 : arraySize;
     printf("[ %d", copy[0]);
-    for (i = 1; i < arraySize; i++) {
+    for (int i = 1; i < arraySize; i++) {
         printf(", %d", copy[i]);
     }
     printf(" ]\n");
@@ -169,6 +805,4 @@ int main(int argc, char *argv[]) {
     free(array);
     free(copy);
 }
-
-
-
+#endif
@@ -0,0 +1,111 @@
+/* parallel LSD radix sort of non-negative int keys with a known bound
+
+   usage: gcc -O2 -c radixSort.c, then link radixSort.o with the program
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "radixSort.h"
+
+/* First key of part k */
+static long partStart(const struct RadixSort *sort, int k) {
+  return sort->n * k / sort->parts;
+}
+
+int radixParts(long n, int threads) {
+  long parts = n / MINRADIXPART;
+  if (parts > threads) parts = threads;
+  if (parts > MAXRADIXPARTS) parts = MAXRADIXPARTS;
+  return parts < 1 ? 1 : parts;
+}
+
+bool radixInit(struct RadixSort *sort, int *keys, long n, int maxKey, int parts) {
+  int bits = 1;
+  while (bits < 31 && (maxKey >> bits) != 0) bits++;
+  memset(sort, 0, sizeof(*sort));
+  sort->keys = sort->original = keys;
+  sort->n = n;
+  sort->parts = parts < 1 ? 1 : parts > MAXRADIXPARTS ? MAXRADIXPARTS : parts;
+  sort->passes = (bits + MAXDIGITBITS - 1) / MAXDIGITBITS;
+  sort->digitBits = (bits + sort->passes - 1) / sort->passes; /* spread the bits evenly, 20 bits are 2 x 10 not 11 + 9 */
+  size_t buckets = (size_t) 1 << sort->digitBits;
+  sort->buffer = aligned_alloc(64, ((n > 0 ? n : 1) * sizeof(int) + 63) / 64 * 64);
+  sort->counts = malloc(sort->parts * buckets * sizeof(size_t));
+  sort->combine = aligned_alloc(64, sort->parts * buckets * COMBINESIZE * sizeof(int));
+  if (sort->buffer == NULL || sort->counts == NULL || sort->combine == NULL) {
+    radixFree(sort);
+    return false;
+  }
+  return true;
+}
+
+void radixFree(struct RadixSort *sort) {
+  free(sort->keys == sort->original ? sort->buffer : sort->keys); /* whichever of the two is not the caller's array */
+  sort->keys = sort->original;
+  free(sort->counts);
+  free(sort->combine);
+  sort->buffer = NULL;
+  sort->counts = NULL;
+  sort->combine = NULL;
+}
+
+void radixCount(struct RadixSort *sort, int k) {
+  size_t buckets = (size_t) 1 << sort->digitBits, *counts = sort->counts + k * buckets;
+  int shift = sort->pass * sort->digitBits, mask = buckets - 1;
+  const int *keys = sort->keys;
+  memset(counts, 0, buckets * sizeof(size_t));
+  for (long i = partStart(sort, k); i < partStart(sort, k + 1); i++) {
+    counts[(keys[i] >> shift) & mask]++;
+  }
+}
+
+void radixPlan(struct RadixSort *sort) {
+  size_t buckets = (size_t) 1 << sort->digitBits, next = 0;
+  for (size_t digit = 0; digit < buckets; digit++) { /* bucket by bucket, inside a bucket part by part keeps it stable */
+    for (int k = 0; k < sort->parts; k++) {
+      size_t count = sort->counts[k * buckets + digit];
+      sort->counts[k * buckets + digit] = next;
+      next += count;
+    }
+  }
+}
+
+void radixScatter(struct RadixSort *sort, int k) {
+  size_t buckets = (size_t) 1 << sort->digitBits, *next = sort->counts + k * buckets;
+  int shift = sort->pass * sort->digitBits, mask = buckets - 1;
+  int *combine = sort->combine + k * buckets * COMBINESIZE, *destination = sort->buffer;
+  const int *keys = sort->keys;
+  unsigned char fill[1 << MAXDIGITBITS], limit[1 << MAXDIGITBITS];
+  memset(fill, 0, buckets);
+  for (size_t digit = 0; digit < buckets; digit++) { /* the first flush of a digit only goes up to a line boundary */
+    limit[digit] = COMBINESIZE - ((uintptr_t) (destination + next[digit]) / sizeof(int)) % COMBINESIZE;
+  }
+  for (long i = partStart(sort, k); i < partStart(sort, k + 1); i++) {
+    int key = keys[i], digit = (key >> shift) & mask;
+    int *line = combine + digit * COMBINESIZE;
+    line[fill[digit]++] = key;
+    if (fill[digit] == limit[digit]) { /* the keys up to the next line boundary go out in one piece */
+      memcpy(destination + next[digit], line, fill[digit] * sizeof(int));
+      next[digit] += fill[digit];
+      fill[digit] = 0;
+      limit[digit] = COMBINESIZE; /* aligned from now on, every flush is a whole line */
+    }
+  }
+  for (size_t digit = 0; digit < buckets; digit++) { /* whatever is left in the lines */
+    memcpy(destination + next[digit], combine + digit * COMBINESIZE, fill[digit] * sizeof(int));
+    next[digit] += fill[digit];
+  }
+}
+
+void radixFinishPass(struct RadixSort *sort) {
+  int *swap = sort->keys;
+  sort->keys = sort->buffer;
+  sort->buffer = swap;
+  sort->pass++;
+}
+
+void radixCopyBack(struct RadixSort *sort, int k) {
+  if (sort->keys == sort->original) return;
+  long start = partStart(sort, k);
+  memcpy(sort->original + start, sort->keys + start, (partStart(sort, k + 1) - start) * sizeof(int));
+}
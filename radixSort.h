@@ -0,0 +1,63 @@
+/* parallel LSD radix sort of non-negative int keys with a known bound
+
+   features: the digit width follows the key range, as few passes of at most MAXDIGITBITS bits as the largest key
+             needs (two passes of 10 bits for keys below 1,000,000). Each pass has two phases over the same parts:
+             every part counts its digits into its own histogram, a prefix sum over digit then part gives each part
+             its own place in every bucket, and every part scatters its keys there. The scatter goes through
+             write-combining buffers of a cache line per digit. The first flush of a digit fills the destination up to
+             the next line boundary, after that every flush writes a whole aligned line; only the two ends of a part's
+             run in a bucket are partial lines.
+             The sort is stable and ping-pongs between the array and a buffer of the same size.
+             The caller runs radixCount and radixScatter for every part on any threads it likes and radixPlan and
+             radixFinishPass on a single thread in between, like parallelPartition.c.
+
+   usage: compile radixSort.c together with the program
+*/
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAXDIGITBITS 11  /* widest digit, 2048 buckets of histogram and write-combining buffer still fit in L2 */
+#define COMBINESIZE 16   /* keys per write-combining buffer, one cache line */
+#define MAXRADIXPARTS 64 /* most parts the keys are split into */
+#define MINRADIXPART 65536 /* smallest part worth a thread of its own */
+
+struct RadixSort {
+  int *keys;      /* source of the current pass */
+  int *buffer;    /* destination of the current pass */
+  int *original;  /* the array given to radixInit, where the sorted keys must end up */
+  long n;
+  int parts;
+  int digitBits;
+  int passes;
+  int pass;       /* current pass, the digit is bits [pass * digitBits, (pass + 1) * digitBits) */
+  size_t *counts; /* parts x buckets, the counts of each part and after radixPlan the first index it writes to */
+  int *combine;   /* parts x buckets x COMBINESIZE write-combining buffers */
+};
+
+/* Number of parts for n keys and threads threads */
+int radixParts(long n, int threads);
+
+/* Prepares sorting keys[0..n-1], all of them in [0, maxKey]. Returns false if the buffers could not be allocated */
+bool radixInit(struct RadixSort *sort, int *keys, long n, int maxKey, int parts);
+
+void radixFree(struct RadixSort *sort);
+
+/* Phase 1 of the current pass for part k */
+void radixCount(struct RadixSort *sort, int k);
+
+/* Between the phases: turns the counts into the first index of every part in every bucket */
+void radixPlan(struct RadixSort *sort);
+
+/* Phase 2 of the current pass for part k */
+void radixScatter(struct RadixSort *sort, int k);
+
+/* After every part is scattered: the destination becomes the source of the next pass */
+void radixFinishPass(struct RadixSort *sort);
+
+/* After the last pass, copies part k of the result back when it ended in the buffer (odd number of passes) */
+void radixCopyBack(struct RadixSort *sort, int k);
+
+#endif
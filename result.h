@@ -0,0 +1,55 @@
+/* result of a reduction over (part of) a matrix, shared by matrixSum and the matrix index
+
+   usage: include in the program, everything is inline
+*/
+#ifndef RESULT_H
+#define RESULT_H
+
+#include <limits.h>
+
+/* struct to encapsulate the result, returns total sum, min value and its position, max value and its position */
+struct Result {
+  long long total;
+  int minimum;
+  int minRow;
+  int minColumn;
+  int maximum;
+  int maxRow;
+  int maxColumn;
+};
+
+/* Empty result, min and max start at the extremes so the first value always replaces them */
+static inline void resultInit(struct Result *result) {
+  result->total = 0;
+  result->minimum = INT_MAX;
+  result->minRow = 0;
+  result->minColumn = 0;
+  result->maximum = INT_MIN;
+  result->maxRow = 0;
+  result->maxColumn = 0;
+}
+
+/* True if position a comes before position b in row major order */
+static inline int positionBefore(int rowA, int columnA, int rowB, int columnB) {
+  return rowA < rowB || (rowA == rowB && columnA < columnB);
+}
+
+/* Merges part into global. When both hold the same min or max the first position in row major order is kept,
+   so the merged result does not depend on the order the parts are merged in */
+static inline void mergeResult(struct Result *global, const struct Result *part) {
+  global->total += part->total;
+  if (part->minimum < global->minimum
+      || (part->minimum == global->minimum && positionBefore(part->minRow, part->minColumn, global->minRow, global->minColumn))){
+    global->minimum = part->minimum;
+    global->minRow = part->minRow;
+    global->minColumn = part->minColumn;
+  }
+  if (part->maximum > global->maximum
+      || (part->maximum == global->maximum && positionBefore(part->maxRow, part->maxColumn, global->maxRow, global->maxColumn))){
+    global->maximum = part->maximum;
+    global->maxRow = part->maxRow;
+    global->maxColumn = part->maxColumn;
+  }
+}
+
+#endif
@@ -0,0 +1,156 @@
+/* microbenchmark for the row reduction kernels in rowReduce.c
+
+   features: checks every supported kernel against the scalar one on random rows of all short lengths,
+             then reports the throughput of each kernel in GB/s next to the memcpy bandwidth of the machine.
+             Also checks that a NaN propagates through the typed double kernel and the merge of rows (typedReduce.c)
+             wherever it is, before or after the finite min and max.
+
+   usage under Linux:
+     gcc -O2 -o rowReduce-bench rowReduce-bench.c rowReduce.c typedReduce.c
+     ./rowReduce-bench megabytes rowLength repeats
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/time.h>
+#include "rowReduce.h"
+#include "typedReduce.h"
+
+#define MEGABYTES 256   /* default size of the buffer that is reduced */
+#define ROWLENGTH 10000 /* default row length, same as the default matrix size */
+#define REPEATS 5       /* default number of timed runs, the best one is reported */
+#define CHECKLENGTH 100 /* rows of length 1 to CHECKLENGTH are checked against the scalar kernel */
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+bool sameReduction(const struct RowReduction *a, const struct RowReduction *b) {
+  return a->total == b->total && a->minimum == b->minimum && a->minColumn == b->minColumn
+      && a->maximum == b->maximum && a->maxColumn == b->maxColumn;
+}
+
+/* Compares a kernel with the scalar one on signed values with many duplicates so ties in the positions are tested */
+bool checkKernel(RowKernel kernel, RowKernel reference) {
+  int row[CHECKLENGTH];
+  struct RowReduction expected, actual;
+  for (int length = 1; length <= CHECKLENGTH; length++) {
+    for (int trial = 0; trial < 20; trial++) {
+      for (int j = 0; j < length; j++) {
+        row[j] = (trial % 2 == 0) ? rand() % 7 - 3 : rand() - RAND_MAX / 2;
+      }
+      reference(row, length, &expected);
+      kernel(row, length, &actual);
+      if (!sameReduction(&expected, &actual)) {
+        printf("mismatch at length %d: total %lld/%lld min %d@%d/%d@%d max %d@%d/%d@%d\n", length,
+               expected.total, actual.total, expected.minimum, expected.minColumn, actual.minimum, actual.minColumn,
+               expected.maximum, expected.maxColumn, actual.maximum, actual.maxColumn);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Merges the rows of a double matrix as the programs do and checks that the min, max and total are NaN at the
+   first NaN (nanRow, nanColumn) */
+bool checkNaN(double matrix[][3], int rows, int nanRow, int nanColumn) {
+  struct TypedResult result;
+  struct TypedReduction row;
+  typedResultInit(ELEMENT_DOUBLE, &result);
+  for (int i = 0; i < rows; i++) {
+    typedRowKernel(ELEMENT_DOUBLE)(matrix[i], 3, &row);
+    typedMergeRow(ELEMENT_DOUBLE, &result, &row, i, 0);
+  }
+  if (isnan(result.total.f) && isnan(result.minimum.f) && isnan(result.maximum.f) && result.minRow == nanRow
+      && result.minColumn == nanColumn && result.maxRow == nanRow && result.maxColumn == nanColumn) return true;
+  printf("NaN at %d,%d: total %g, min %g at %d,%d, max %g at %d,%d\n", nanRow, nanColumn, result.total.f,
+         result.minimum.f, result.minRow, result.minColumn, result.maximum.f, result.maxRow, result.maxColumn);
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  long megabytes = (argc > 1)? atol(argv[1]) : MEGABYTES;
+  int rowLength = (argc > 2)? atoi(argv[2]) : ROWLENGTH;
+  int repeats = (argc > 3)? atoi(argv[3]) : REPEATS;
+  long count = megabytes * 1024 * 1024 / sizeof(int);
+  long rows = count / rowLength;
+  double bytes, best, start_time, end_time;
+  RowKernel reference = rowKernels[numRowKernels - 1].kernel; /* the scalar kernel is always last */
+  srand(time(NULL));
+
+  if (rows < 1) {
+    printf("The buffer must hold at least one row\n");
+    return 1;
+  }
+  count = rows * rowLength;
+  bytes = (double) count * sizeof(int);
+
+  rowReduceInit();
+  double nanAfter[][3] = { { 1, -5, 9 }, { 2, 3, 4 }, { 7, NAN, -1 }, { 8, NAN, -9 } };  /* after the finite min and max */
+  double nanFirst[][3] = { { NAN, 1, 2 }, { -5, 9, 3 } };                              /* before them, in column 0 */
+  if (!checkNaN(nanAfter, 4, 2, 1) || !checkNaN(nanFirst, 2, 0, 0)) {
+    printf("NaNs do not propagate through the typed kernels\n");
+    return 1;
+  }
+
+  int *data = malloc(count * sizeof(int));
+  int *copy = malloc(count * sizeof(int));
+  for (long i = 0; i < count; i++) {
+    data[i] = rand()%99;
+  }
+  memcpy(copy, data, count * sizeof(int)); /* touch the copy once so page faults are not timed */
+
+  /* memcpy reads and writes every byte, so its bandwidth is counted as twice the buffer size */
+  best = 1e30;
+  for (int r = 0; r < repeats; r++) {
+    start_time = read_timer();
+    memcpy(copy, data, count * sizeof(int));
+    end_time = read_timer();
+    if (end_time - start_time < best) best = end_time - start_time;
+  }
+  double copyBandwidth = 2 * bytes / best / 1e9;
+  printf("%ld rows of %d ints (%.1f MB), memcpy bandwidth %.2f GB/s\n", rows, rowLength, bytes / 1e6, copyBandwidth);
+
+  for (int k = 0; k < numRowKernels; k++) {
+    if (!rowKernels[k].supported()) {
+      printf("%-8s not supported on this CPU\n", rowKernels[k].name);
+      continue;
+    }
+    if (!checkKernel(rowKernels[k].kernel, reference)) {
+      printf("%-8s FAILED the check against the scalar kernel\n", rowKernels[k].name);
+      continue;
+    }
+    long long total = 0;
+    struct RowReduction row;
+    best = 1e30;
+    for (int r = 0; r < repeats; r++) {
+      start_time = read_timer();
+      for (long i = 0; i < rows; i++) {
+        rowKernels[k].kernel(data + i * rowLength, rowLength, &row);
+        total += row.total;
+      }
+      end_time = read_timer();
+      if (end_time - start_time < best) best = end_time - start_time;
+    }
+    double bandwidth = bytes / best / 1e9;
+    printf("%-8s %8.2f GB/s  %5.1f%% of memcpy bandwidth  (checksum %lld)\n", rowKernels[k].name, bandwidth,
+           100.0 * bandwidth / copyBandwidth, total / repeats);
+  }
+
+  free(data);
+  free(copy);
+}
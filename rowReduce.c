@@ -0,0 +1,226 @@
+/* vectorized row reduction: sum, min and max with positions
+
+   features: one kernel per instruction set, each lane keeps its own min/max and the column where it was first seen.
+             The lanes are merged at the end of the row, ties go to the smallest column so the result is identical to a scalar scan.
+
+   usage: gcc -O2 -c rowReduce.c, then link rowReduce.o with matrixSum or matrixSum-openmp
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "rowReduce.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ROWREDUCE_X86
+#include <immintrin.h>
+#endif
+
+/* Continues a scan from column start with the values already in result, used for the tail that does not fill a vector */
+static void scanTail(const int *row, int start, int length, struct RowReduction *result) {
+  for (int j = start; j < length; j++) {
+    result->total += row[j];
+    if (row[j] < result->minimum) { /* Strict comparison keeps the first occurrence */
+      result->minimum = row[j];
+      result->minColumn = j;
+    }
+    if (row[j] > result->maximum) {
+      result->maximum = row[j];
+      result->maxColumn = j;
+    }
+  }
+}
+
+/* Plain loop, used when no vector instructions are available and as the reference for the others */
+static void reduceRowScalar(const int *row, int length, struct RowReduction *result) {
+  result->total = row[0];
+  result->minimum = row[0];
+  result->minColumn = 0;
+  result->maximum = row[0];
+  result->maxColumn = 0;
+  scanTail(row, 1, length, result);
+}
+
+static int alwaysSupported(void) {
+  return 1;
+}
+
+#ifdef ROWREDUCE_X86
+/* Merges the per lane results into one, when two lanes hold the same value the smaller column wins */
+static void mergeLanes(const long long *sums, int numSums, const int *mins, const int *minColumns,
+                       const int *maxs, const int *maxColumns, int lanes, struct RowReduction *result) {
+  int k;
+  result->total = 0;
+  for (k = 0; k < numSums; k++) {
+    result->total += sums[k];
+  }
+  result->minimum = mins[0];
+  result->minColumn = minColumns[0];
+  result->maximum = maxs[0];
+  result->maxColumn = maxColumns[0];
+  for (k = 1; k < lanes; k++) {
+    if (mins[k] < result->minimum || (mins[k] == result->minimum && minColumns[k] < result->minColumn)) {
+      result->minimum = mins[k];
+      result->minColumn = minColumns[k];
+    }
+    if (maxs[k] > result->maximum || (maxs[k] == result->maximum && maxColumns[k] < result->maxColumn)) {
+      result->maximum = maxs[k];
+      result->maxColumn = maxColumns[k];
+    }
+  }
+}
+
+/* SSE2 has no blend, min/max or sign extension for 32 bit ints so they are built from compares and logic operations */
+__attribute__((target("sse2")))
+static void reduceRowSse2(const int *row, int length, struct RowReduction *result) {
+  if (length < 4) {
+    reduceRowScalar(row, length, result);
+    return;
+  }
+  __m128i column = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i step = _mm_set1_epi32(4);
+  __m128i value = _mm_loadu_si128((const __m128i *) row);
+  __m128i minimum = value, maximum = value, minColumn = column, maxColumn = column;
+  __m128i sign = _mm_srai_epi32(value, 31);
+  __m128i sum = _mm_add_epi64(_mm_unpacklo_epi32(value, sign), _mm_unpackhi_epi32(value, sign));
+  int j;
+  for (j = 4; j + 4 <= length; j += 4) {
+    column = _mm_add_epi32(column, step);
+    value = _mm_loadu_si128((const __m128i *) (row + j));
+    sign = _mm_srai_epi32(value, 31);
+    sum = _mm_add_epi64(sum, _mm_add_epi64(_mm_unpacklo_epi32(value, sign), _mm_unpackhi_epi32(value, sign)));
+    __m128i less = _mm_cmpgt_epi32(minimum, value);
+    minimum = _mm_or_si128(_mm_and_si128(less, value), _mm_andnot_si128(less, minimum));
+    minColumn = _mm_or_si128(_mm_and_si128(less, column), _mm_andnot_si128(less, minColumn));
+    __m128i greater = _mm_cmpgt_epi32(value, maximum);
+    maximum = _mm_or_si128(_mm_and_si128(greater, value), _mm_andnot_si128(greater, maximum));
+    maxColumn = _mm_or_si128(_mm_and_si128(greater, column), _mm_andnot_si128(greater, maxColumn));
+  }
+  long long sums[2];
+  int mins[4], minColumns[4], maxs[4], maxColumns[4];
+  _mm_storeu_si128((__m128i *) sums, sum);
+  _mm_storeu_si128((__m128i *) mins, minimum);
+  _mm_storeu_si128((__m128i *) minColumns, minColumn);
+  _mm_storeu_si128((__m128i *) maxs, maximum);
+  _mm_storeu_si128((__m128i *) maxColumns, maxColumn);
+  mergeLanes(sums, 2, mins, minColumns, maxs, maxColumns, 4, result);
+  scanTail(row, j, length, result);
+}
+
+__attribute__((target("avx2")))
+static void reduceRowAvx2(const int *row, int length, struct RowReduction *result) {
+  if (length < 8) {
+    reduceRowScalar(row, length, result);
+    return;
+  }
+  __m256i column = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i step = _mm256_set1_epi32(8);
+  __m256i value = _mm256_loadu_si256((const __m256i *) row);
+  __m256i minimum = value, maximum = value, minColumn = column, maxColumn = column;
+  __m256i sumLow = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(value)); /* Widen to 64 bits before adding */
+  __m256i sumHigh = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(value, 1));
+  int j;
+  for (j = 8; j + 8 <= length; j += 8) {
+    column = _mm256_add_epi32(column, step);
+    value = _mm256_loadu_si256((const __m256i *) (row + j));
+    sumLow = _mm256_add_epi64(sumLow, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(value)));
+    sumHigh = _mm256_add_epi64(sumHigh, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(value, 1)));
+    __m256i less = _mm256_cmpgt_epi32(minimum, value);
+    minimum = _mm256_min_epi32(minimum, value);
+    minColumn = _mm256_blendv_epi8(minColumn, column, less);
+    __m256i greater = _mm256_cmpgt_epi32(value, maximum);
+    maximum = _mm256_max_epi32(maximum, value);
+    maxColumn = _mm256_blendv_epi8(maxColumn, column, greater);
+  }
+  long long sums[8];
+  int mins[8], minColumns[8], maxs[8], maxColumns[8];
+  _mm256_storeu_si256((__m256i *) sums, sumLow);
+  _mm256_storeu_si256((__m256i *) (sums + 4), sumHigh);
+  _mm256_storeu_si256((__m256i *) mins, minimum);
+  _mm256_storeu_si256((__m256i *) minColumns, minColumn);
+  _mm256_storeu_si256((__m256i *) maxs, maximum);
+  _mm256_storeu_si256((__m256i *) maxColumns, maxColumn);
+  mergeLanes(sums, 8, mins, minColumns, maxs, maxColumns, 8, result);
+  scanTail(row, j, length, result);
+}
+
+__attribute__((target("avx512f")))
+static void reduceRowAvx512(const int *row, int length, struct RowReduction *result) {
+  if (length < 16) {
+    reduceRowScalar(row, length, result);
+    return;
+  }
+  __m512i column = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m512i step = _mm512_set1_epi32(16);
+  __m512i value = _mm512_loadu_si512((const void *) row);
+  __m512i minimum = value, maximum = value, minColumn = column, maxColumn = column;
+  __m512i sumLow = _mm512_cvtepi32_epi64(_mm512_castsi512_si256(value));
+  __m512i sumHigh = _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(value, 1));
+  int j;
+  for (j = 16; j + 16 <= length; j += 16) {
+    column = _mm512_add_epi32(column, step);
+    value = _mm512_loadu_si512((const void *) (row + j));
+    sumLow = _mm512_add_epi64(sumLow, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(value)));
+    sumHigh = _mm512_add_epi64(sumHigh, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(value, 1)));
+    __mmask16 less = _mm512_cmplt_epi32_mask(value, minimum);
+    minimum = _mm512_mask_mov_epi32(minimum, less, value);
+    minColumn = _mm512_mask_mov_epi32(minColumn, less, column);
+    __mmask16 greater = _mm512_cmpgt_epi32_mask(value, maximum);
+    maximum = _mm512_mask_mov_epi32(maximum, greater, value);
+    maxColumn = _mm512_mask_mov_epi32(maxColumn, greater, column);
+  }
+  long long sums[16];
+  int mins[16], minColumns[16], maxs[16], maxColumns[16];
+  _mm512_storeu_si512((void *) sums, sumLow);
+  _mm512_storeu_si512((void *) (sums + 8), sumHigh);
+  _mm512_storeu_si512((void *) mins, minimum);
+  _mm512_storeu_si512((void *) minColumns, minColumn);
+  _mm512_storeu_si512((void *) maxs, maximum);
+  _mm512_storeu_si512((void *) maxColumns, maxColumn);
+  mergeLanes(sums, 16, mins, minColumns, maxs, maxColumns, 16, result);
+  scanTail(row, j, length, result);
+}
+
+static int sse2Supported(void) {
+  return __builtin_cpu_supports("sse2");
+}
+
+static int avx2Supported(void) {
+  return __builtin_cpu_supports("avx2");
+}
+
+static int avx512Supported(void) {
+  return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+/* Ordered from fastest to slowest, rowReduceInit picks the first supported entry */
+const struct RowKernelInfo rowKernels[] = {
+#ifdef ROWREDUCE_X86
+  { "avx512", reduceRowAvx512, avx512Supported },
+  { "avx2", reduceRowAvx2, avx2Supported },
+  { "sse2", reduceRowSse2, sse2Supported },
+#endif
+  { "scalar", reduceRowScalar, alwaysSupported },
+};
+const int numRowKernels = sizeof(rowKernels) / sizeof(rowKernels[0]);
+
+static RowKernel selectedKernel = reduceRowScalar;
+static const char *selectedName = "scalar";
+
+void rowReduceInit(void) {
+  const char *forced = getenv("ROWREDUCE");
+  for (int k = 0; k < numRowKernels; k++) {
+    if (!rowKernels[k].supported()) continue;
+    if (forced != NULL && strcmp(forced, rowKernels[k].name) != 0) continue;
+    selectedKernel = rowKernels[k].kernel;
+    selectedName = rowKernels[k].name;
+    return;
+  }
+}
+
+const char *rowReduceName(void) {
+  return selectedName;
+}
+
+void reduceRow(const int *row, int length, struct RowReduction *result) {
+  selectedKernel(row, length, result);
+}
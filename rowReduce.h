@@ -0,0 +1,42 @@
+/* vectorized row reduction: sum, min and max with positions
+
+   features: the kernel is picked at runtime from the CPU features (AVX-512, AVX2, SSE2 or a scalar fallback).
+             The sum is accumulated in 64 bits so large matrices do not overflow.
+             The minimum and maximum positions are the first occurrence in the row, same as a scalar left to right scan.
+
+   usage: compile rowReduce.c together with the program, call rowReduceInit() once before reduceRow()
+*/
+#ifndef ROWREDUCE_H
+#define ROWREDUCE_H
+
+/* struct to encapsulate the result for one row, same meaning as the Result struct but positions are columns only */
+struct RowReduction {
+  long long total;
+  int minimum;
+  int minColumn;
+  int maximum;
+  int maxColumn;
+};
+
+typedef void (*RowKernel)(const int *row, int length, struct RowReduction *result);
+
+/* One entry per kernel compiled in, used by the benchmark to test all of them */
+struct RowKernelInfo {
+  const char *name;
+  RowKernel kernel;
+  int (*supported)(void);
+};
+
+extern const struct RowKernelInfo rowKernels[];
+extern const int numRowKernels;
+
+/* Picks the fastest kernel the CPU supports, the environment variable ROWREDUCE=name can force a specific one */
+void rowReduceInit(void);
+
+/* Name of the kernel picked by rowReduceInit */
+const char *rowReduceName(void);
+
+/* Reduces length (> 0) ints starting at row */
+void reduceRow(const int *row, int length, struct RowReduction *result);
+
+#endif
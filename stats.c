@@ -0,0 +1,183 @@
+/* statistics of an int matrix gathered in the same pass as the sum, min and max
+
+   usage: gcc -O2 -c stats.c, then link stats.o with the program
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stats.h"
+
+/* True if a should be kept before b among the largest: a larger value, or the same value found earlier */
+static inline bool largerEntry(const struct Entry *a, const struct Entry *b) {
+  if (a->value != b->value) return a->value > b->value;
+  return a->row < b->row || (a->row == b->row && a->column < b->column);
+}
+
+/* True if a should be kept before b among the smallest: a smaller value, or the same value found earlier */
+static inline bool smallerEntry(const struct Entry *a, const struct Entry *b) {
+  if (a->value != b->value) return a->value < b->value;
+  return a->row < b->row || (a->row == b->row && a->column < b->column);
+}
+
+/* Offers entry to a heap of at most k entries whose root is the worst kept entry, better(a, b) says a beats b */
+static void offer(struct Entry *heap, int *size, int k, struct Entry entry, bool (*better)(const struct Entry *, const struct Entry *)) {
+  int i, child;
+  if (*size < k) { /* Room left, sift the new entry up */
+    i = (*size)++;
+    while (i > 0 && better(&heap[(i - 1) / 2], &entry)) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap[i] = entry;
+    return;
+  }
+  if (k == 0 || !better(&entry, &heap[0])) return;
+  i = 0; /* Replace the worst entry and sift down */
+  while ((child = 2 * i + 1) < k) {
+    if (child + 1 < k && better(&heap[child], &heap[child + 1])) child++;
+    if (!better(&entry, &heap[child])) break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = entry;
+}
+
+bool statsInit(struct Stats *stats, int k, int low, int high) {
+  memset(stats, 0, sizeof(*stats));
+  if (k < 0 || high <= low || (long) high - low > MAXHISTOGRAM) return false;
+  stats->k = k;
+  stats->histogramLow = low;
+  stats->histogramHigh = high;
+  stats->largest = malloc((k > 0 ? k : 1) * sizeof(struct Entry));
+  stats->smallest = malloc((k > 0 ? k : 1) * sizeof(struct Entry));
+  stats->histogram = calloc(high - low, sizeof(long long));
+  if (stats->largest == NULL || stats->smallest == NULL || stats->histogram == NULL) {
+    statsFree(stats);
+    return false;
+  }
+  return true;
+}
+
+void statsFree(struct Stats *stats) {
+  free(stats->largest);
+  free(stats->smallest);
+  free(stats->histogram);
+  stats->largest = stats->smallest = NULL;
+  stats->histogram = NULL;
+}
+
+void statsReset(struct Stats *stats) {
+  stats->numLargest = stats->numSmallest = 0;
+  stats->count = stats->total = 0;
+  stats->sumSquares = 0;
+  stats->below = stats->above = 0;
+  memset(stats->histogram, 0, (size_t) (stats->histogramHigh - stats->histogramLow) * sizeof(long long));
+}
+
+void statsAddRow(struct Stats *stats, const int *row, int length, int rowIndex, int firstColumn) {
+  unsigned int range = stats->histogramHigh - stats->histogramLow;
+  long long total = 0;
+  __int128 sumSquares = 0;
+  for (int j = 0; j < length; j++) {
+    int value = row[j];
+    total += value;
+    sumSquares += (long long) value * value;
+    unsigned int bucket = (unsigned int) value - (unsigned int) stats->histogramLow;
+    if (bucket < range) stats->histogram[bucket]++;
+    else if (value < stats->histogramLow) stats->below++;
+    else stats->above++;
+    /* Only values that can enter a heap pay for the heap, once the heaps are full that is rare */
+    if (stats->numLargest < stats->k || (stats->k > 0 && value >= stats->largest[0].value)) {
+      offer(stats->largest, &stats->numLargest, stats->k, (struct Entry) { value, rowIndex, firstColumn + j }, largerEntry);
+    }
+    if (stats->numSmallest < stats->k || (stats->k > 0 && value <= stats->smallest[0].value)) {
+      offer(stats->smallest, &stats->numSmallest, stats->k, (struct Entry) { value, rowIndex, firstColumn + j }, smallerEntry);
+    }
+  }
+  stats->count += length;
+  stats->total += total;
+  stats->sumSquares += sumSquares;
+}
+
+void statsMerge(struct Stats *global, const struct Stats *part) {
+  int i;
+  for (i = 0; i < part->numLargest; i++) {
+    offer(global->largest, &global->numLargest, global->k, part->largest[i], largerEntry);
+  }
+  for (i = 0; i < part->numSmallest; i++) {
+    offer(global->smallest, &global->numSmallest, global->k, part->smallest[i], smallerEntry);
+  }
+  for (i = 0; i < global->histogramHigh - global->histogramLow; i++) {
+    global->histogram[i] += part->histogram[i];
+  }
+  global->count += part->count;
+  global->total += part->total;
+  global->sumSquares += part->sumSquares;
+  global->below += part->below;
+  global->above += part->above;
+}
+
+bool statsQuantile(const struct Stats *stats, double q, int *value) {
+  long long rank = (long long) ceil(q * stats->count); /* the nearest rank definition */
+  long long seen = stats->below;
+  if (rank < 1) rank = 1;
+  if (stats->count == 0 || rank <= seen) return false;
+  for (int i = 0; i < stats->histogramHigh - stats->histogramLow; i++) {
+    seen += stats->histogram[i];
+    if (seen >= rank) {
+      *value = stats->histogramLow + i;
+      return true;
+    }
+  }
+  return false; /* Rank is among the values above the histogram */
+}
+
+static int compareLarger(const void *a, const void *b) {
+  return largerEntry(a, b) ? -1 : 1;
+}
+
+static int compareSmaller(const void *a, const void *b) {
+  return smallerEntry(a, b) ? -1 : 1;
+}
+
+static void printQuantile(const struct Stats *stats, FILE *out, const char *name, double q) {
+  int value;
+  if (statsQuantile(stats, q, &value)) fprintf(out, "The %s is %d\n", name, value);
+  else fprintf(out, "The %s is outside the histogram [%d, %d)\n", name, stats->histogramLow, stats->histogramHigh);
+}
+
+void statsPrint(const struct Stats *stats, FILE *out, bool printHistogram) {
+  int i;
+  if (stats->count == 0) return;
+  /* variance = (n * sum(x^2) - sum(x)^2) / n^2, exact in 128 bits until the final division */
+  __int128 numerator = (__int128) stats->count * stats->sumSquares - (__int128) stats->total * stats->total;
+  double mean = (double) stats->total / stats->count;
+  double variance = (double) numerator / ((double) stats->count * stats->count);
+  fprintf(out, "The mean is %.6f and the variance is %.6f\n", mean, variance);
+  printQuantile(stats, out, "median", 0.5);
+  printQuantile(stats, out, "99th percentile", 0.99);
+
+  struct Entry *sorted = malloc((stats->k > 0 ? stats->k : 1) * sizeof(struct Entry));
+  memcpy(sorted, stats->largest, stats->numLargest * sizeof(struct Entry));
+  qsort(sorted, stats->numLargest, sizeof(struct Entry), compareLarger);
+  fprintf(out, "The %d largest values are:", stats->numLargest);
+  for (i = 0; i < stats->numLargest; i++) {
+    fprintf(out, " %d at %d,%d%s", sorted[i].value, sorted[i].row, sorted[i].column, i + 1 < stats->numLargest ? ";" : "");
+  }
+  memcpy(sorted, stats->smallest, stats->numSmallest * sizeof(struct Entry));
+  qsort(sorted, stats->numSmallest, sizeof(struct Entry), compareSmaller);
+  fprintf(out, "\nThe %d smallest values are:", stats->numSmallest);
+  for (i = 0; i < stats->numSmallest; i++) {
+    fprintf(out, " %d at %d,%d%s", sorted[i].value, sorted[i].row, sorted[i].column, i + 1 < stats->numSmallest ? ";" : "");
+  }
+  fprintf(out, "\n");
+  free(sorted);
+
+  if (printHistogram) {
+    if (stats->below > 0) fprintf(out, "below %d: %lld\n", stats->histogramLow, stats->below);
+    for (i = 0; i < stats->histogramHigh - stats->histogramLow; i++) {
+      if (stats->histogram[i] > 0) fprintf(out, "%d: %lld\n", stats->histogramLow + i, stats->histogram[i]);
+    }
+    if (stats->above > 0) fprintf(out, "%d and above: %lld\n", stats->histogramHigh, stats->above);
+  }
+}
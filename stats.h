@@ -0,0 +1,64 @@
+/* statistics of an int matrix gathered in the same pass as the sum, min and max
+
+   features: the K largest and K smallest values with their positions (bounded heaps), the mean and the exact variance
+             (sum of squares kept in 128 bits) and a histogram over [low, high) with counts of the values outside it.
+             Quantiles are exact whenever the requested rank falls inside the histogram, which is always the case
+             when every value is inside it, like the 0..98 values of the generated matrices.
+             Each thread gathers its own Stats and they are merged at the end.
+
+   usage: compile stats.c together with the program
+*/
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define HISTOGRAMLOW 0      /* default histogram domain, covers the generated values */
+#define HISTOGRAMHIGH 65536
+#define MAXHISTOGRAM (1 << 24) /* largest histogram allowed, in buckets */
+
+/* A value and where it was found */
+struct Entry {
+  int value;
+  int row;
+  int column;
+};
+
+struct Stats {
+  int k;
+  struct Entry *largest;  /* min-heap of the k largest values, the root is the one to drop first */
+  int numLargest;
+  struct Entry *smallest; /* max-heap of the k smallest values */
+  int numSmallest;
+  long long count;
+  long long total;
+  __int128 sumSquares;
+  int histogramLow;       /* the histogram covers [histogramLow, histogramHigh) */
+  int histogramHigh;
+  long long *histogram;
+  long long below;        /* values below and at or above the histogram */
+  long long above;
+};
+
+/* Allocates empty statistics keeping k largest and smallest values, returns false if the memory could not be allocated */
+bool statsInit(struct Stats *stats, int k, int low, int high);
+
+void statsFree(struct Stats *stats);
+
+/* Empties the statistics without freeing them */
+void statsReset(struct Stats *stats);
+
+/* Adds length values of row rowIndex starting at column firstColumn */
+void statsAddRow(struct Stats *stats, const int *row, int length, int rowIndex, int firstColumn);
+
+/* Adds everything in part to global, both must have the same k and histogram domain */
+void statsMerge(struct Stats *global, const struct Stats *part);
+
+/* Nearest rank quantile, 0 < q <= 1. Returns false if the rank falls outside the histogram so the value is not known */
+bool statsQuantile(const struct Stats *stats, double q, int *value);
+
+/* Prints mean, variance, median, p99, the largest and smallest values and, if wanted, the non-empty histogram buckets */
+void statsPrint(const struct Stats *stats, FILE *out, bool printHistogram);
+
+#endif
@@ -0,0 +1,258 @@
+/* fixed pool of worker threads with work stealing
+
+   The deques follow Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models"
+   (PPoPP 2013), with a fixed size buffer and pointers to heap allocated tasks so every slot is read atomically.
+
+   usage: gcc -O2 -c taskPool.c, then link taskPool.o with the program and -lpthread
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include "taskPool.h"
+#include "trace.h"
+
+#define STEALROUNDS 4 /* rounds of steal attempts over all workers before yielding the core */
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/* Owner only. Returns false if the deque is full */
+static bool push(struct TaskWorker *worker, struct Task *task) {
+  long bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+  long top = atomic_load_explicit(&worker->top, memory_order_acquire);
+  if (bottom - top >= DEQUESIZE) return false;
+  /* release on the slot as well as the fence, so a thief's acquire load of the slot sees the task written */
+  atomic_store_explicit(&worker->tasks[bottom & (DEQUESIZE - 1)], task, memory_order_release);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+  return true;
+}
+
+/* Owner only. Returns the newest task or NULL if the deque is empty */
+static struct Task *pop(struct TaskWorker *worker) {
+  long bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+  struct Task *task = NULL;
+  if (top <= bottom) {
+    task = atomic_load_explicit(&worker->tasks[bottom & (DEQUESIZE - 1)], memory_order_relaxed);
+    if (top == bottom) { /* Last task, race the thieves for it */
+      if (!atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        task = NULL;
+      }
+      atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+  }
+  return task;
+}
+
+/* Any thread. Returns the oldest task or NULL if the deque is empty or another thread got it first */
+static struct Task *steal(struct TaskWorker *victim) {
+  long top = atomic_load_explicit(&victim->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long bottom = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+  if (top >= bottom) return NULL;
+  struct Task *task = atomic_load_explicit(&victim->tasks[top & (DEQUESIZE - 1)], memory_order_acquire);
+  if (!atomic_compare_exchange_strong_explicit(&victim->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+    return NULL;
+  }
+  return task;
+}
+
+/* Runs a task and frees it, the worker that finishes the last pending task wakes main */
+static void runTask(struct TaskWorker *worker, struct Task *task) {
+  struct TaskPool *pool = worker->pool;
+  TRACE_START(started);
+  task->function(worker, task->context, task->low, task->high);
+  TRACE_SPAN("task", started, task->high - task->low);
+  worker->stats.tasks++;
+  if (task != &pool->root) free(task); /* the root lives in the pool */
+  if (atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel) == 1) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->jobFinished);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+/* Tries every other worker once starting from a random one */
+static struct Task *stealAny(struct TaskWorker *worker) {
+  struct TaskPool *pool = worker->pool;
+  worker->random ^= worker->random << 13; /* xorshift, only needs to spread the victims */
+  worker->random ^= worker->random >> 7;
+  worker->random ^= worker->random << 17;
+  int start = worker->random % pool->numWorkers;
+  for (int k = 0; k < pool->numWorkers; k++) {
+    struct TaskWorker *victim = &pool->workers[(start + k) % pool->numWorkers];
+    if (victim == worker) continue;
+    struct Task *task = steal(victim);
+    if (task != NULL) {
+      worker->stats.steals++;
+      return task;
+    }
+    worker->stats.failedSteals++;
+  }
+  return NULL;
+}
+
+/* Runs the tasks of one job until no task is pending anywhere */
+static void workJob(struct TaskWorker *worker) {
+  struct TaskPool *pool = worker->pool;
+  int rounds = 0;
+  double idleStart = 0;
+  TRACE_START(idle);
+  while (atomic_load_explicit(&pool->pending, memory_order_acquire) > 0) {
+    struct Task *task = pop(worker);
+    if (task == NULL) task = atomic_exchange_explicit(&pool->submitted, NULL, memory_order_acq_rel);
+    if (task == NULL) task = stealAny(worker);
+    if (task != NULL) {
+      if (idleStart != 0) {
+        worker->stats.idleSeconds += seconds() - idleStart;
+        TRACE_SPAN("idle", idle, -1);
+      }
+      idleStart = 0;
+      rounds = 0;
+      runTask(worker, task);
+    } else {
+      if (idleStart == 0) {
+        idleStart = seconds();
+        TRACE_RESET(idle);
+      }
+      if (++rounds >= STEALROUNDS) { /* Nothing to steal for a while, let the busy workers have the core */
+        sched_yield();
+        rounds = 0;
+      }
+    }
+  }
+  if (idleStart != 0) {
+    worker->stats.idleSeconds += seconds() - idleStart;
+    TRACE_SPAN("idle", idle, -1);
+  }
+}
+
+static void *poolWorker(void *arg) {
+  struct TaskWorker *worker = arg;
+  struct TaskPool *pool = worker->pool;
+  int seen = 0;
+  TRACE_THREAD("pool worker", worker->id);
+  while (true) {
+    pthread_mutex_lock(&pool->lock); /* Park until a job this worker has not done yet is posted */
+    while (pool->jobNumber == seen && !pool->shutdown) {
+      pthread_cond_wait(&pool->jobPosted, &pool->lock);
+    }
+    if (pool->shutdown) {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+    seen = pool->jobNumber;
+    pthread_mutex_unlock(&pool->lock);
+
+    workJob(worker);
+
+    if (atomic_fetch_sub_explicit(&pool->active, 1, memory_order_acq_rel) == 1) { /* The last worker out wakes main */
+      pthread_mutex_lock(&pool->lock);
+      pthread_cond_signal(&pool->jobFinished);
+      pthread_mutex_unlock(&pool->lock);
+    }
+  }
+  return NULL;
+}
+
+bool taskPoolInit(struct TaskPool *pool, int numWorkers) {
+  if (numWorkers < 1) numWorkers = 1;
+  if (numWorkers > MAXPOOLWORKERS) numWorkers = MAXPOOLWORKERS;
+  memset(pool, 0, sizeof(*pool));
+  pool->numWorkers = numWorkers;
+  pool->workers = aligned_alloc(64, numWorkers * sizeof(struct TaskWorker));
+  pool->threads = malloc(numWorkers * sizeof(pthread_t));
+  if (pool->workers == NULL || pool->threads == NULL) {
+    free(pool->workers);
+    free(pool->threads);
+    return false;
+  }
+  memset(pool->workers, 0, numWorkers * sizeof(struct TaskWorker));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->jobPosted, NULL);
+  pthread_cond_init(&pool->jobFinished, NULL);
+  for (int k = 0; k < numWorkers; k++) {
+    pool->workers[k].pool = pool;
+    pool->workers[k].id = k;
+    pool->workers[k].random = 0x9e3779b97f4a7c15ULL * (k + 1);
+  }
+  for (int k = 0; k < numWorkers; k++) {
+    if (pthread_create(&pool->threads[k], NULL, poolWorker, &pool->workers[k]) != 0) {
+      pool->numWorkers = k; /* Keep the workers that did start so destroy can join them */
+      taskPoolDestroy(pool);
+      return false;
+    }
+  }
+  return true;
+}
+
+void taskPoolDestroy(struct TaskPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->jobPosted);
+  pthread_mutex_unlock(&pool->lock);
+  for (int k = 0; k < pool->numWorkers; k++) {
+    pthread_join(pool->threads[k], NULL);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->jobPosted);
+  pthread_cond_destroy(&pool->jobFinished);
+  free(pool->workers);
+  free(pool->threads);
+}
+
+void taskPoolRun(struct TaskPool *pool, TaskFunction function, void *context, long low, long high) {
+  struct Task *task = &pool->root; /* nothing to allocate, so posting a job cannot fail */
+  *task = (struct Task) { function, context, low, high };
+  for (int k = 0; k < pool->numWorkers; k++) {
+    memset(&pool->workers[k].stats, 0, sizeof(struct TaskStats));
+  }
+  atomic_store(&pool->pending, 1);
+  atomic_store(&pool->active, pool->numWorkers);
+  atomic_store(&pool->submitted, task);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->jobNumber++;
+  pthread_cond_broadcast(&pool->jobPosted);
+  /* Every task has finished once pending is 0, waiting for active too makes sure no worker still reads the deques */
+  while (atomic_load(&pool->pending) > 0 || atomic_load(&pool->active) > 0) {
+    pthread_cond_wait(&pool->jobFinished, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void taskSpawn(struct TaskWorker *worker, TaskFunction function, void *context, long low, long high) {
+  struct Task *task = malloc(sizeof(struct Task));
+  if (task != NULL) {
+    *task = (struct Task) { function, context, low, high };
+    atomic_fetch_add_explicit(&worker->pool->pending, 1, memory_order_relaxed);
+    if (push(worker, task)) return;
+    atomic_fetch_sub_explicit(&worker->pool->pending, 1, memory_order_relaxed);
+    free(task);
+  }
+  function(worker, context, low, high); /* No room (or memory) for another task, run it now */
+  worker->stats.tasks++;
+}
+
+struct TaskStats taskPoolStats(const struct TaskPool *pool) {
+  struct TaskStats total = { 0, 0, 0, 0 };
+  for (int k = 0; k < pool->numWorkers; k++) {
+    total.tasks += pool->workers[k].stats.tasks;
+    total.steals += pool->workers[k].stats.steals;
+    total.failedSteals += pool->workers[k].stats.failedSteals;
+    total.idleSeconds += pool->workers[k].stats.idleSeconds;
+  }
+  return total;
+}
@@ -0,0 +1,84 @@
+/* fixed pool of worker threads with work stealing
+
+   features: one worker per core (or as many as asked), created once and parked on a condition variable between jobs.
+             Each worker owns a Chase-Lev deque of tasks: it pushes and pops at the bottom without locks while idle
+             workers steal from the top of a random victim, so the oldest and usually largest tasks are the ones stolen.
+             A task may spawn more tasks, the job is done when the last of them has finished, nobody joins anybody.
+             When a deque is full the spawned task runs inline instead, so spawning never fails.
+             Every worker counts the tasks it ran, the tasks it stole, its failed steal attempts and the time it spent
+             looking for work, taskPoolStats adds them up for the last job.
+             With -DTRACE (trace.h) every task and every stretch of looking for work is a span on the worker's row.
+
+   usage: compile taskPool.c together with the program, link with -lpthread
+*/
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define MAXPOOLWORKERS 256 /* largest pool */
+#define DEQUESIZE 4096     /* tasks per deque, a power of two */
+
+struct TaskWorker;
+
+/* A task works on [low, high) of whatever context points to, it may spawn more tasks through worker */
+typedef void (*TaskFunction)(struct TaskWorker *worker, void *context, long low, long high);
+
+struct Task {
+  TaskFunction function;
+  void *context;
+  long low;
+  long high;
+};
+
+/* Counters of one worker, or of the whole pool once added up */
+struct TaskStats {
+  long tasks;          /* tasks run, including inline ones */
+  long steals;         /* tasks taken from another worker's deque */
+  long failedSteals;   /* steal attempts that found nothing or lost a race */
+  double idleSeconds;  /* time spent looking for work while the job was running */
+};
+
+struct TaskWorker {
+  struct TaskPool *pool;
+  int id;
+  atomic_long top;     /* thieves take from the top */
+  atomic_long bottom;  /* the owner pushes and pops at the bottom */
+  _Atomic(struct Task *) tasks[DEQUESIZE];
+  unsigned long long random; /* picks the victims */
+  struct TaskStats stats;
+} __attribute__((aligned(64)));
+
+struct TaskPool {
+  int numWorkers;
+  struct TaskWorker *workers;
+  pthread_t *threads;
+  pthread_mutex_t lock;       /* protects jobNumber and shutdown, and the waits on the conditions */
+  pthread_cond_t jobPosted;
+  pthread_cond_t jobFinished;
+  int jobNumber;              /* incremented for every job, workers compare it with the last job they joined */
+  bool shutdown;
+  _Atomic(struct Task *) submitted; /* the first task of a job, taken by whichever worker gets it first */
+  struct Task root;           /* storage of the first task, so posting a job never allocates */
+  atomic_long pending;        /* tasks spawned but not finished, the job is done when it drops to 0 */
+  atomic_int active;          /* workers inside the current job, main waits for all of them to leave */
+};
+
+/* Starts numWorkers threads, returns false if they or their deques could not be created */
+bool taskPoolInit(struct TaskPool *pool, int numWorkers);
+
+/* Stops and joins the workers */
+void taskPoolDestroy(struct TaskPool *pool);
+
+/* Runs function on [low, high) and everything it spawns, returns when all of it has finished */
+void taskPoolRun(struct TaskPool *pool, TaskFunction function, void *context, long low, long high);
+
+/* Called from a task: queues function on [low, high) on the worker's own deque, or runs it right away if the deque is full */
+void taskSpawn(struct TaskWorker *worker, TaskFunction function, void *context, long low, long high);
+
+/* Sum of the counters of all workers for the last job */
+struct TaskStats taskPoolStats(const struct TaskPool *pool);
+
+#endif
@@ -0,0 +1,141 @@
+/* timeline of spans per thread, written as Chrome trace JSON
+
+   usage: gcc -O2 -DTRACE -c trace.c, then link trace.o with the program (compiled with -DTRACE too) and -lpthread
+*/
+#ifndef TRACE
+#define TRACE
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+#define TRACENAME 32 /* longest thread name */
+
+/* A span [start, end], an instant when end is 0 */
+struct TraceEvent {
+  uint64_t start;
+  uint64_t end;
+  const char *name;
+  long value;
+};
+
+struct TraceChunk {
+  struct TraceChunk *next;
+  int count;
+  struct TraceEvent events[TRACECHUNK];
+};
+
+/* The events of one thread, owned by it until the program exits */
+struct TraceBuffer {
+  struct TraceBuffer *next;
+  int thread;
+  char name[TRACENAME];
+  struct TraceChunk *first, *last;
+};
+
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER; /* taken only to add a buffer and to write */
+static struct TraceBuffer *buffers;
+static int numBuffers;
+static _Thread_local struct TraceBuffer *local;
+
+static void traceWrite();
+
+/* The buffer of the calling thread, registered on its first event. NULL if out of memory */
+static struct TraceBuffer *buffer() {
+  if (local != NULL) return local;
+  struct TraceBuffer *created = calloc(1, sizeof(struct TraceBuffer));
+  if (created == NULL) return NULL;
+  pthread_mutex_lock(&traceLock);
+  if (numBuffers == 0) atexit(traceWrite);
+  created->thread = numBuffers++;
+  snprintf(created->name, TRACENAME, "thread %d", created->thread);
+  created->next = buffers;
+  buffers = created;
+  pthread_mutex_unlock(&traceLock);
+  return local = created;
+}
+
+/* Appends an event, a new chunk when the last one is full. Drops it if out of memory */
+static void record(uint64_t start, uint64_t end, const char *name, long value) {
+  struct TraceBuffer *own = buffer();
+  if (own == NULL) return;
+  struct TraceChunk *chunk = own->last;
+  if (chunk == NULL || chunk->count == TRACECHUNK) {
+    chunk = malloc(sizeof(struct TraceChunk));
+    if (chunk == NULL) return;
+    chunk->next = NULL;
+    chunk->count = 0;
+    if (own->last == NULL) own->first = chunk; else own->last->next = chunk;
+    own->last = chunk;
+  }
+  chunk->events[chunk->count++] = (struct TraceEvent) { start, end, name, value };
+}
+
+uint64_t traceNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void traceSpan(const char *name, uint64_t start, long value) {
+  record(start, traceNow(), name, value);
+}
+
+void traceMark(const char *name, long value) {
+  record(traceNow(), 0, name, value);
+}
+
+void traceThread(const char *name, long id) {
+  struct TraceBuffer *own = buffer();
+  if (own == NULL) return;
+  if (id < 0) snprintf(own->name, TRACENAME, "%s", name);
+  else snprintf(own->name, TRACENAME, "%s %ld", name, id);
+}
+
+/* Writes every buffer with the times in microseconds since the earliest event. Runs at exit, when the traced
+   threads are done */
+static void traceWrite() {
+  const char *path = getenv("TRACEFILE") != NULL ? getenv("TRACEFILE") : "trace.json";
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    perror(path);
+    return;
+  }
+  pthread_mutex_lock(&traceLock);
+  uint64_t origin = UINT64_MAX;
+  long events = 0;
+  for (struct TraceBuffer *own = buffers; own != NULL; own = own->next) { /* spans are stored when they end */
+    for (struct TraceChunk *chunk = own->first; chunk != NULL; chunk = chunk->next) {
+      for (int e = 0; e < chunk->count; e++) {
+        if (chunk->events[e].start < origin) origin = chunk->events[e].start;
+      }
+    }
+  }
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  for (struct TraceBuffer *own = buffers; own != NULL; own = own->next) {
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", own->thread, own->name);
+    first = false;
+    for (struct TraceChunk *chunk = own->first; chunk != NULL; chunk = chunk->next) {
+      for (int e = 0; e < chunk->count; e++) {
+        struct TraceEvent *event = &chunk->events[e];
+        fprintf(file, ",\n{\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,", event->name, own->thread,
+                (double) (event->start - origin) / 1e3);
+        if (event->end != 0) fprintf(file, "\"ph\":\"X\",\"dur\":%.3f", (double) (event->end - event->start) / 1e3);
+        else fprintf(file, "\"ph\":\"i\",\"s\":\"t\"");
+        if (event->value >= 0) fprintf(file, ",\"args\":{\"n\":%ld}", event->value);
+        fprintf(file, "}");
+        events++;
+      }
+    }
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  fprintf(stderr, "Traced %ld events of %d threads to %s\n", events, numBuffers, path);
+  pthread_mutex_unlock(&traceLock);
+}
@@ -0,0 +1,47 @@
+/* timeline of spans per thread, written as Chrome trace JSON
+
+   features: compiled in only with -DTRACE, otherwise every TRACE_ macro is empty and trace.c need not be linked.
+             Every thread appends to a buffer of its own, chunks of TRACECHUNK events grown on demand, so recording a
+             span is two clock reads and a few stores and never takes a lock. A span is stored whole when it ends
+             (a complete "X" event): tasks that move to another thread, like untied OpenMP tasks, end on the thread
+             that finishes them. At exit the buffers of every thread, also of the ones that have ended, are written to
+             the file in the environment variable TRACEFILE (default trace.json), which chrome://tracing and
+             ui.perfetto.dev open as one row per thread, so load imbalance and idle threads show as gaps.
+
+   usage: compile trace.c together with the program and -DTRACE, e.g.
+     gcc -O2 -DTRACE -o quicksort quicksort.c trace.c ... && TRACEFILE=quicksort.json ./quicksort 10000000
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef TRACE
+#include <stdint.h>
+
+#define TRACECHUNK 4096 /* events per buffer chunk */
+
+/* Monotonic nanoseconds */
+uint64_t traceNow();
+
+/* Records the span [start, now] of the calling thread, value is shown as its argument n unless negative */
+void traceSpan(const char *name, uint64_t start, long value);
+
+/* Records an instant event */
+void traceMark(const char *name, long value);
+
+/* Names the row of the calling thread "name id", or just name if id is negative */
+void traceThread(const char *name, long id);
+
+#define TRACE_START(start) uint64_t start = traceNow()
+#define TRACE_RESET(start) (start = traceNow())
+#define TRACE_SPAN(name, start, value) traceSpan(name, start, value)
+#define TRACE_MARK(name, value) traceMark(name, value)
+#define TRACE_THREAD(name, id) traceThread(name, id)
+#else
+#define TRACE_START(start) ((void) 0)
+#define TRACE_RESET(start) ((void) 0)
+#define TRACE_SPAN(name, start, value) ((void) 0)
+#define TRACE_MARK(name, value) ((void) 0)
+#define TRACE_THREAD(name, id) ((void) 0)
+#endif
+
+#endif
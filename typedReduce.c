@@ -0,0 +1,162 @@
+/* sum, min and max reduction for matrices of any element type
+
+   usage: gcc -O2 -c typedReduce.c, then link typedReduce.o with rowReduce.o
+*/
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include "typedReduce.h"
+#include "rowReduce.h"
+
+/* Kernel for one element type: the first loop has no data dependent branches, so at -O2 it vectorizes for the
+   narrow integers, while int64 needs 64 bit vector compares (-march with SSE4.2 or later) and the float sums stay
+   sequential, as vectorizing them would reassociate the additions and change the rounding. A NaN leaves the
+   comparisons false, so if the sum came out NaN the first NaN of the row becomes the min and max. The last loops
+   find the first column holding the min and max while the row is still in cache */
+#define DEFINE_KERNEL(upper, name, type, field)                                      \
+__attribute__((optimize("tree-vectorize")))                                         \
+static void reduceRow_##name(const void *data, int length, struct TypedReduction *result) { \
+  const type *row = data;                                                            \
+  __typeof__(result->total.field) total = 0;                                         \
+  type minimum = row[0], maximum = row[0];                                           \
+  int j;                                                                             \
+  for (j = 0; j < length; j++) {                                                     \
+    total += row[j];                                                                 \
+    minimum = row[j] < minimum ? row[j] : minimum;                                   \
+    maximum = row[j] > maximum ? row[j] : maximum;                                   \
+  }                                                                                  \
+  int nan = length;                                                                  \
+  if (total != total) { /* only a float sum, from a NaN or from inf - inf */         \
+    for (nan = 0; nan < length && row[nan] == row[nan]; nan++);                      \
+  }                                                                                  \
+  result->minColumn = result->maxColumn = 0;                                         \
+  if (nan < length) {                                                                \
+    minimum = maximum = row[nan];                                                    \
+    result->minColumn = result->maxColumn = nan;                                     \
+  } else {                                                                           \
+    for (j = 0; j < length && row[j] != minimum; j++);                               \
+    if (j < length) result->minColumn = j;                                           \
+    for (j = 0; j < length && row[j] != maximum; j++);                               \
+    if (j < length) result->maxColumn = j;                                           \
+  }                                                                                  \
+  result->total.field = total;                                                       \
+  result->minimum.field = minimum;                                                   \
+  result->maximum.field = maximum;                                                   \
+}
+ELEMENT_TYPES(DEFINE_KERNEL)
+#undef DEFINE_KERNEL
+
+/* int32 goes through the vectorized kernel picked by rowReduceInit */
+static void reduceRowInt32Simd(const void *data, int length, struct TypedReduction *result) {
+  struct RowReduction row;
+  reduceRow(data, length, &row);
+  result->total.i = row.total;
+  result->minimum.i = row.minimum;
+  result->minColumn = row.minColumn;
+  result->maximum.i = row.maximum;
+  result->maxColumn = row.maxColumn;
+}
+
+/* Everything known about a type, one entry per type in ELEMENT_TYPES order */
+struct ElementInfo {
+  const char *name;
+  int size;
+  bool isFloat;
+  TypedRowKernel kernel;
+};
+
+#define IS_FLOAT_i false
+#define IS_FLOAT_f true
+#define ELEMENT_INFO(upper, name, type, field) { #name, sizeof(type), IS_FLOAT_##field, reduceRow_##name },
+static struct ElementInfo elements[] = { ELEMENT_TYPES(ELEMENT_INFO) };
+#undef ELEMENT_INFO
+
+bool parseElementType(const char *text, enum ElementType *type) {
+  for (int t = 0; t < NUMELEMENTTYPES; t++) {
+    if (strcmp(text, elements[t].name) == 0) {
+      *type = (enum ElementType) t;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *elementTypeName(enum ElementType type) {
+  return elements[type].name;
+}
+
+int elementSize(enum ElementType type) {
+  return elements[type].size;
+}
+
+bool elementIsFloat(enum ElementType type) {
+  return elements[type].isFloat;
+}
+
+TypedRowKernel typedRowKernel(enum ElementType type) {
+  return type == ELEMENT_INT32 ? reduceRowInt32Simd : elements[type].kernel;
+}
+
+void typedResultInit(enum ElementType type, struct TypedResult *result) {
+  memset(result, 0, sizeof(*result));
+  if (elements[type].isFloat) {
+    result->minimum.f = DBL_MAX;
+    result->maximum.f = -DBL_MAX;
+  } else {
+    result->minimum.i = LLONG_MAX;
+    result->maximum.i = LLONG_MIN;
+  }
+}
+
+/* Compares two values of the type, negative if a < b. A NaN is ordered toward nanSide (-1 below every number for
+   the minimum, 1 above for the maximum) so it wins both and propagates, two NaNs tie and the position decides */
+static inline int compareScalars(bool isFloat, union Scalar a, union Scalar b, int nanSide) {
+  if (isFloat) {
+    bool nanA = isnan(a.f), nanB = isnan(b.f);
+    if (nanA || nanB) return nanSide * (nanA - nanB);
+    return (a.f > b.f) - (a.f < b.f);
+  }
+  return (a.i > b.i) - (a.i < b.i);
+}
+
+static inline bool before(int rowA, int columnA, int rowB, int columnB) {
+  return rowA < rowB || (rowA == rowB && columnA < columnB);
+}
+
+void typedMergeResult(enum ElementType type, struct TypedResult *global, const struct TypedResult *part) {
+  bool isFloat = elements[type].isFloat;
+  int order;
+  if (isFloat) global->total.f += part->total.f;
+  else global->total.i += part->total.i;
+  order = compareScalars(isFloat, part->minimum, global->minimum, -1);
+  if (order < 0 || (order == 0 && before(part->minRow, part->minColumn, global->minRow, global->minColumn))) {
+    global->minimum = part->minimum;
+    global->minRow = part->minRow;
+    global->minColumn = part->minColumn;
+  }
+  order = compareScalars(isFloat, part->maximum, global->maximum, 1);
+  if (order > 0 || (order == 0 && before(part->maxRow, part->maxColumn, global->maxRow, global->maxColumn))) {
+    global->maximum = part->maximum;
+    global->maxRow = part->maxRow;
+    global->maxColumn = part->maxColumn;
+  }
+}
+
+void typedMergeRow(enum ElementType type, struct TypedResult *result, const struct TypedReduction *reduction, int row, int firstColumn) {
+  struct TypedResult part;
+  part.total = reduction->total;
+  part.minimum = reduction->minimum;
+  part.minRow = row;
+  part.minColumn = firstColumn + reduction->minColumn;
+  part.maximum = reduction->maximum;
+  part.maxRow = row;
+  part.maxColumn = firstColumn + reduction->maxColumn;
+  typedMergeResult(type, result, &part);
+}
+
+void printScalar(FILE *out, enum ElementType type, union Scalar value) {
+  if (elements[type].isFloat) fprintf(out, "%g", value.f);
+  else fprintf(out, "%lld", value.i);
+}
@@ -0,0 +1,87 @@
+/* sum, min and max reduction for matrices of any element type
+
+   features: one kernel per element type, generated from the same macro so each is specialized at compile time.
+             Sums are widened: the integer types accumulate in 64 bits (int64 wraps past 2^63), float and double in double.
+             The int32 kernel is the vectorized one from rowReduce.c, the others use a branch free first pass and a second
+             pass over the (cached) row to find the first position of the min and max. At -O2 the first pass vectorizes
+             for int8 and uint16, int64 only with 64 bit vector compares (-march=native on x86) and float and double not
+             at all: their sums are added in row order, since reordering them would change the rounding.
+             NaNs propagate: a row holding one has NaN as its sum, min and max, at the column of its first NaN, and
+             merging ranks a NaN below every number for the min and above for the max, so a part holding one gives
+             NaN at the first NaN in row major order. rowReduce-bench.c checks both.
+
+   types: int8, uint16, int32, int64, float, double
+
+   usage: compile typedReduce.c and rowReduce.c together with the program, call rowReduceInit() first
+*/
+#ifndef TYPEDREDUCE_H
+#define TYPEDREDUCE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* X macro with every element type: name, C type, field of Scalar holding its values */
+#define ELEMENT_TYPES(X)        \
+  X(INT8, int8, int8_t, i)      \
+  X(UINT16, uint16, uint16_t, i) \
+  X(INT32, int32, int32_t, i)   \
+  X(INT64, int64, int64_t, i)   \
+  X(FLOAT, float, float, f)     \
+  X(DOUBLE, double, double, f)
+
+#define ELEMENT_ENUM(upper, name, type, field) ELEMENT_##upper,
+enum ElementType { ELEMENT_TYPES(ELEMENT_ENUM) NUMELEMENTTYPES };
+#undef ELEMENT_ENUM
+
+/* A value of any element type, integer types use i and floating point types use f */
+union Scalar {
+  long long i;
+  double f;
+};
+
+/* Result for one row, same meaning as struct RowReduction */
+struct TypedReduction {
+  union Scalar total;
+  union Scalar minimum;
+  int minColumn;
+  union Scalar maximum;
+  int maxColumn;
+};
+
+/* Result for a part of the matrix, same meaning as struct Result */
+struct TypedResult {
+  union Scalar total;
+  union Scalar minimum;
+  int minRow;
+  int minColumn;
+  union Scalar maximum;
+  int maxRow;
+  int maxColumn;
+};
+
+typedef void (*TypedRowKernel)(const void *row, int length, struct TypedReduction *result);
+
+/* Reads a type name, returns false if it is unknown */
+bool parseElementType(const char *text, enum ElementType *type);
+
+const char *elementTypeName(enum ElementType type);
+
+int elementSize(enum ElementType type);
+
+bool elementIsFloat(enum ElementType type);
+
+TypedRowKernel typedRowKernel(enum ElementType type);
+
+/* Empty result, min and max start at the extremes of the type */
+void typedResultInit(enum ElementType type, struct TypedResult *result);
+
+/* Merges the reduction of row into result, the first position wins a tie like mergeResult */
+void typedMergeRow(enum ElementType type, struct TypedResult *result, const struct TypedReduction *reduction, int row, int firstColumn);
+
+/* Merges part into global, the first position in row major order wins a tie */
+void typedMergeResult(enum ElementType type, struct TypedResult *global, const struct TypedResult *part);
+
+/* Prints a value of the type */
+void printScalar(FILE *out, enum ElementType type, union Scalar value);
+
+#endif
@@ -1,126 +1,444 @@
 /* program to simulate unisex bathroom problem
 
+   features: the bathroom is a group lock (groupLock.c): people of one group share it, the groups never meet. Waiting
+             people of the group whose turn it is go in together, and once another group waits the group inside
+             admits at most --batch more (default GROUPBATCH) before it has to give way, so nobody waits forever.
+             --groups n has n groups instead of women and men, --capacity n lets at most n in at once.
+             --semaphores uses the original protocol of four semaphores instead (two groups only), for comparison.
+             --duration seconds benchmarks the lock: nobody sleeps or prints, every person goes in and out as fast
+             as possible until the time is up, then the visits per second, the share of every group, Jain's fairness
+             index over the persons and the mean and longest wait of every group are printed. --compare runs the
+             semaphores and the group lock one after the other with the same people.
+             bathroomCore and bathroomSemaphoreCore (benchCore.h) let bench.c time a bounded number of visits the
+             same way. Atomic occupancy counters of their own check that the groups never share the bathroom.
+             --simulate seconds runs numberOfOneSex persons per group as records on a pool of --workers threads instead
+             of a thread each (bathroomSim.c): a virtual clock of --tick seconds replaces the sleeps with scheduled
+             events, so 100000 persons and an hour finish in seconds, and --realtime paces the ticks on the real clock.
+             The persons still use the group lock, without blocking the workers, and the visits and waits per group
+             are printed at the end. A run of at least SIMCHECKED seconds fails if the mean wait of a group is over
+             SIMSTARVED of the simulated time (bathroomSim.h), since bounded waits do not grow with the run.
+             Every person keeps histograms (latencyHistogram.c) of its waits and of the occupancy it finds on entry,
+             merged per group and printed as mean, p50, p90, p99, p99.9 and max at shutdown, also when ^C ends the
+             endless mode. --log file replaces the printing of the arrivals and departures by binary events (wait,
+             enter, leave) appended to a ring of each thread and written by a thread of their own (eventLog.c), so
+             the log neither serializes nor slows the people; eventLog-decode.c prints the file or its histograms.
+             Compiled with -DTRACE and trace.c every person thread records its waits and visits as spans and the group
+             lock marks every phase it opens (trace.h), TRACEFILE=bathroom.json names the timeline.
+
    usage under Windows:
-     gcc -o unisex-bathroom unisex-bathroom.c -lpthread -lposix4
-     unisex-bathroom numberOfOneSex
+     gcc -o unisex-bathroom unisex-bathroom.c groupLock.c bathroomSim.c taskPool.c eventLog.c latencyHistogram.c -lpthread -lposix4 -lm
+     unisex-bathroom [--groups n] [--capacity n] [--batch n] [--semaphores] [--duration seconds [--compare]] [--log file] numberOfOneSex
+     unisex-bathroom [--groups n] [--capacity n] [--batch n] --simulate seconds [--workers n] [--tick seconds] [--realtime] [--seed n] numberOfOneSex
+
+   usage under Linux:
+     gcc -O2 -o unisex-bathroom unisex-bathroom.c groupLock.c bathroomSim.c taskPool.c eventLog.c latencyHistogram.c -lpthread -lm
+     ./unisex-bathroom --duration 2 --compare 8
+     ./unisex-bathroom --simulate 3600 --workers 4 50000
+     ./unisex-bathroom --log bathroom.log 4, then ^C and ./eventLog-decode --stats bathroom.log
 */
 
-#ifndef _REENTRANT 
-#define _REENTRANT 
-#endif 
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include "groupLock.h"
+#include "bathroomSim.h"
+#include "eventLog.h"
+#include "latencyHistogram.h"
+#include "benchCore.h"
+#include "trace.h"
 
 #define MAXPERSONS 20;
 
 sem_t accessMutex, /* Ensures only men or only women access bathroom */
-      womenCountMutex, /* Protects count variable */
-      menCountMutex, /* Protects count variable */
+      countMutex[2], /* Protects the count variables, one per sex */
       queueMutex; /* Ensures fairness between sexes */
 
-int womenCount = 0, menCount = 0; /* Keeps track of number of persons of each sex in the bathroom, good states: (womenCount >= 0 and menCount == 0) or (womenCount == 0 and menCount >= 0) */
+int count[2] = { 0, 0 }; /* Keeps track of number of persons of each sex in the bathroom, good states: (count[0] >= 0 and count[1] == 0) or (count[0] == 0 and count[1] >= 0) */
 
-void *Women(void *); /* The two thread functions */
-void *Men(void *);
+struct GroupLock bathroom;
+bool useSemaphores = false;
 
+/* One person, the argument of the thread */
+struct Person {
+  int group;
+  long visits;
+  struct EventRing *ring;             /* events of this person when --log is given */
+  struct LatencyHistogram waits;      /* nanoseconds from asking to enter to being inside */
+  struct LatencyHistogram occupancy;  /* persons of the group inside, this one included, when entering */
+};
 
-int main(int argc, char *argv[]) {
-  int persons = (argc > 1)? atoi(argv[1]) : MAXPERSONS;
+long visitsPerPerson = 0; /* 0 visits forever, otherwise every person leaves after that many */
+bool benchmark = false; /* No sleeps and no printing */
+atomic_bool stop; /* Ends the visits of a --duration benchmark, or any run on SIGINT */
+bool logging = false; /* --log replaces the printing with binary events */
+struct EventLog eventLog;
+atomic_int occupancy[MAXGROUPS]; /* Persons of each group inside, kept apart from the locks to check them */
+atomic_long visitsMade, violations; /* Violations are entries while another group or too many were inside */
 
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + 1e-9 * time.tv_nsec;
+}
+
+void semaphoreInit() {
   sem_init(&accessMutex, 0, 1); /* All semaphores start in an unlocked state and pshared is set to shared between threads (not processes) */
-  sem_init(&womenCountMutex, 0, 1); 
-  sem_init(&menCountMutex, 0, 1); 
-  sem_init(&queueMutex, 0, 1); 
-  
-  srand(time(NULL)); /* To allow for random seed generation */
+  sem_init(&countMutex[0], 0, 1);
+  sem_init(&countMutex[1], 0, 1);
+  sem_init(&queueMutex, 0, 1);
+  count[0] = count[1] = 0;
+}
 
-  pthread_t workerid[persons * 2];
+void semaphoreDestroy() {
+  sem_destroy(&accessMutex);
+  sem_destroy(&countMutex[0]);
+  sem_destroy(&countMutex[1]);
+  sem_destroy(&queueMutex);
+}
 
-  pthread_attr_t attr;
-  pthread_attr_init(&attr);
-  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM); /* Sets attributes of pthread to allow system to schedule execution */
+/* The original protocol, every entry passes queueMutex one at a time */
+void semaphoreEnter(int sex) {
+  sem_wait(&queueMutex); /* Attempts to enter bathroom, if the other sex is inside or there is a queue person will wait */
+  sem_wait(&countMutex[sex]); /* Attempt to access the counter variables */
 
-  for (int i = 0; i < persons; i++) {
-    pthread_create(&workerid[i], &attr, Women, NULL);
-    pthread_create(&workerid[(i + persons)], &attr, Men, NULL);
+  if (count[sex] == 0) { /* The first one of a sex takes the accessMutex and keeps the other sex out */
+    sem_wait(&accessMutex);
   }
+  count[sex]++; /* Enter bathroom */
 
-  for (int i = 0; i < (persons * 2); i++) {
-    pthread_join(workerid[i], NULL);
+  sem_post(&countMutex[sex]); /* Release lock on count */
+  sem_post(&queueMutex); /* Allow the same sex to enter bathroom or the other to queue up */
+}
+
+void semaphoreLeave(int sex) {
+  sem_wait(&countMutex[sex]); /* Attempt to access count variable */
+  count[sex]--; /* Leave bathroom */
+
+  if (count[sex] == 0) { /* The last one out unlocks access to bathroom for any sex */
+    sem_post(&accessMutex);
   }
 
-  sem_destroy(&accessMutex);
-  sem_destroy(&womenCountMutex);
-  sem_destroy(&menCountMutex);
-  sem_destroy(&queueMutex);
+  sem_post(&countMutex[sex]); /* Release lock on count */
+}
+
+/* Called right after entering, counts entries while another group is inside or the capacity is exceeded. Returns
+   how many of the group are inside */
+int enterCheck(int group) {
+  int inside = atomic_fetch_add(&occupancy[group], 1) + 1;
+  for (int g = 0; g < bathroom.groups; g++) {
+    if (g != group && atomic_load(&occupancy[g]) != 0) atomic_fetch_add(&violations, 1);
+  }
+  if (bathroom.capacity > 0 && inside > bathroom.capacity) atomic_fetch_add(&violations, 1);
+  atomic_fetch_add(&visitsMade, 1);
+  return inside;
 }
 
-void *Women(void *) {
+/* Called right before leaving, returns how many of the group are left inside */
+int leaveCheck(int group) {
+  return atomic_fetch_sub(&occupancy[group], 1) - 1;
+}
+
+/* The thread of one person, visits the bathroom and waits a while before the next visit */
+void *Person(void *arg) {
+  struct Person *person = arg;
+  int group = person->group;
   unsigned int seed = (unsigned int) pthread_self(); /* Thread specific seed to allow the sleeps to actually be random */
-  while(1) {
-    sem_wait(&queueMutex); /* Attempts to enter bathroom, if the other sex is inside or there is a queue person will wait */
-    sem_wait(&womenCountMutex); /* Attempt to access the counter variables */
+  const char *name = bathroom.groups > 2 ? "Person" : group == 0 ? "Woman" : "Man";
+  const char *members = bathroom.groups > 2 ? "persons of the group" : group == 0 ? "women" : "men";
 
-    if (womenCount == 0) { /* If this is the first woman she will take the accessMutex and prevent men from entering */
-        sem_wait(&accessMutex);
+  person->ring = logging ? eventLogRing(&eventLog) : NULL;
+  TRACE_THREAD(name, -1);
+  for (long visit = 0; visitsPerPerson == 0 || visit < visitsPerPerson; visit++) {
+    if (atomic_load_explicit(&stop, memory_order_relaxed)) break;
+    uint64_t asked = logNanos();
+    logEvent(person->ring, EVENT_WAIT, group, 0, asked);
+    if (useSemaphores) semaphoreEnter(group); else groupEnter(&bathroom, group);
+    uint64_t entered = logNanos();
+    TRACE_SPAN("wait", asked, group); /* logNanos reads the clock of the trace */
+    int inside = enterCheck(group);
+    logEvent(person->ring, EVENT_ENTER, group, inside, entered);
+    latencyAdd(&person->waits, entered - asked);
+    latencyAdd(&person->occupancy, inside);
+    person->visits++;
+
+    if (!benchmark) {
+      if (!logging) {
+        printf("%s %lu of group %d enters bathroom, number of %s in bathroom is %d\n", name, (unsigned long) pthread_self(),
+               group, members, inside);
+      }
+      srand(seed);
+      sleep(rand() % 4 + 1); /* Simulate using bathroom */
     }
-    womenCount++; /* Enter bathroom */
-    printf("Woman %d enters bathroom, number of women in bathroom is %d\n", pthread_self(), womenCount);
 
-    sem_post(&womenCountMutex); /* Release lock on count */
-    sem_post(&queueMutex); /* Allow women to enter bathroom or men to queue up */
+    inside = leaveCheck(group);
+    logEvent(person->ring, EVENT_LEAVE, group, inside, logNanos());
+    if (!benchmark && !logging) { /* still inside, so the line comes before any other group enters */
+      printf("%s %lu of group %d leaves bathroom, number of %s in bathroom is %d\n", name, (unsigned long) pthread_self(),
+             group, members, inside);
+    }
+    TRACE_SPAN("inside", entered, group);
+    if (useSemaphores) semaphoreLeave(group); else groupLeave(&bathroom, group);
 
-    srand(seed);
-    sleep(rand() % 4 + 1); /* Simulate using bathroom */
+    if (!benchmark) {
+      srand(seed);
+      sleep(rand() % 4 + 1); /* Wait some time before using bathroom again */
+    }
+  }
+  return NULL;
+}
+
+/* Starts persons people of each group, waits for them and returns the seconds they took. With a duration the
+   people are stopped after that many seconds, otherwise they make their visitsPerPerson visits. Returns -1 if the
+   threads could not be allocated or started, the ones already started are stopped first */
+double runPersons(struct Person people[], int persons, double duration) {
+  int total = persons * bathroom.groups, started;
+  pthread_t *workerid = malloc((total > 0 ? total : 1) * sizeof(pthread_t));
+  if (workerid == NULL) return -1;
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM); /* Sets attributes of pthread to allow system to schedule execution */
 
-    sem_wait(&womenCountMutex); /* Attempt to access count variable */
-    womenCount--; /* Leave bathroom */
-    printf("Woman %d leaves bathroom, number of women in bathroom is %d\n", pthread_self(), womenCount);
+  if (useSemaphores) semaphoreInit();
+  for (int g = 0; g < MAXGROUPS; g++) atomic_store(&occupancy[g], 0);
+  atomic_store(&visitsMade, 0);
+  atomic_store(&violations, 0);
+  atomic_store(&stop, false);
 
-    if (womenCount == 0) { /* If the last woman leaves unlock access to bathroom for any sex */
-      sem_post(&accessMutex);
+  double start = now();
+  for (started = 0; started < total; started++) {
+    people[started].group = started % bathroom.groups;
+    people[started].visits = 0;
+    latencyInit(&people[started].waits);
+    latencyInit(&people[started].occupancy);
+    if (pthread_create(&workerid[started], &attr, Person, &people[started]) != 0) {
+      atomic_store(&stop, true); /* every person leaves after the visit it is in */
+      break;
     }
+  }
+  if (duration > 0 && started == total) {
+    struct timespec length = { (time_t) duration, (long) ((duration - (time_t) duration) * 1e9) };
+    nanosleep(&length, NULL);
+    atomic_store(&stop, true);
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(workerid[i], NULL);
+  }
+  double seconds = now() - start;
 
-    sem_post(&womenCountMutex); /* Release lock on count */
+  if (useSemaphores) semaphoreDestroy();
+  free(workerid);
+  return started == total ? seconds : -1;
+}
 
-    srand(seed);
-    sleep(rand() % 4 + 1); /* Wait some time before using bathroom again */
+/* Prints the throughput and the fairness of a run, with the histograms of the waits and the occupancy per group */
+void printReport(const struct Person people[], int persons, double seconds) {
+  int total = persons * bathroom.groups;
+  double sum = 0, squares = 0;
+  for (int i = 0; i < total; i++) {
+    sum += people[i].visits;
+    squares += (double) people[i].visits * people[i].visits;
+  }
+  printf("%s: %g visits/sec, Jain's fairness index over the persons %.4f, %ld violations\n",
+         useSemaphores ? "semaphores" : "group lock", sum / seconds, squares > 0 ? sum * sum / (total * squares) : 1.0,
+         atomic_load(&violations));
+  for (int g = 0; g < bathroom.groups; g++) {
+    struct LatencyHistogram waits, inside;
+    long visits = 0;
+    latencyInit(&waits);
+    latencyInit(&inside);
+    for (int i = g; i < total; i += bathroom.groups) {
+      visits += people[i].visits;
+      latencyMerge(&waits, &people[i].waits);
+      latencyMerge(&inside, &people[i].occupancy);
+    }
+    printf("  group %d: %5.1f%% of the visits\n", g, sum > 0 ? 100 * visits / sum : 0);
+    latencyPrint(&waits, "    wait", 1e3, " us");
+    latencyPrint(&inside, "    occupancy", 1, "");
   }
 }
 
-void *Men(void *) {
-  unsigned int seed = (unsigned int) pthread_self();
-  while(1) {
-    sem_wait(&queueMutex);
-    sem_wait(&menCountMutex);
+/* Fills a BenchRun for bench.c with the lock picked by useSemaphores: run->threads people in two groups share
+   run->size visits and make them back to back. Correct if every visit was made and the groups never met */
+static bool bathroomRun(struct BenchRun *run) {
+  int persons = run->threads < 2 ? 1 : run->threads / 2;
+  struct Person *people = malloc(persons * 2 * sizeof(struct Person));
+  if (people == NULL || !groupLockInit(&bathroom, 2, 0, GROUPBATCH)) {
+    free(people);
+    return false;
+  }
+  run->threads = persons * 2;
+  visitsPerPerson = run->size / run->threads > 0 ? run->size / run->threads : 1;
+  benchmark = true;
+  run->seconds = runPersons(people, persons, 0);
+  if (run->seconds < 0) {
+    free(people);
+    return false;
+  }
+  run->checksum = atomic_load(&visitsMade);
+  run->correct = atomic_load(&violations) == 0 && run->checksum == visitsPerPerson * run->threads;
+  free(people);
+  return true;
+}
 
-    if (menCount == 0) {
-        sem_wait(&accessMutex);
-    }
-    menCount++;
-    printf("Man %d enters bathroom, number of men in bathroom is %d\n", pthread_self(), menCount);
+/* One benchmark run (benchCore.h) with the group lock */
+bool bathroomCore(struct BenchRun *run) {
+  useSemaphores = false;
+  return bathroomRun(run);
+}
+
+/* One benchmark run (benchCore.h) with the original semaphores */
+bool bathroomSemaphoreCore(struct BenchRun *run) {
+  useSemaphores = true;
+  return bathroomRun(run);
+}
+
+#ifndef NO_MAIN
+/* Runs the people and prints the report, false if they could not be started */
+static bool runAndReport(struct Person people[], int persons, double duration) {
+  double seconds = runPersons(people, persons, duration);
+  if (seconds < 0) {
+    printf("Could not start %d persons\n", persons * bathroom.groups);
+    return false;
+  }
+  printReport(people, persons, seconds);
+  return true;
+}
 
-    sem_post(&menCountMutex);
-    sem_post(&queueMutex);
+static void interrupted(int signal) {
+  (void) signal;
+  atomic_store(&stop, true);
+}
 
-    srand(seed);
-    sleep(rand() % 4 + 1);
+int main(int argc, char *argv[]) {
+  int option, groups = 2, capacity = 0, batch = GROUPBATCH;
+  double duration = 0, simulate = 0, tick = SIMTICK;
+  bool compare = false, realtime = false;
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned long long seed = time(NULL);
+  const char *logPath = NULL;
+  static struct option options[] = {
+    { "groups", required_argument, NULL, 'g' },
+    { "capacity", required_argument, NULL, 'c' },
+    { "batch", required_argument, NULL, 'b' },
+    { "semaphores", no_argument, NULL, 's' },
+    { "duration", required_argument, NULL, 'D' },
+    { "compare", no_argument, NULL, 'C' },
+    { "simulate", required_argument, NULL, 'm' },
+    { "workers", required_argument, NULL, 'w' },
+    { "tick", required_argument, NULL, 't' },
+    { "realtime", no_argument, NULL, 'r' },
+    { "seed", required_argument, NULL, 'S' },
+    { "log", required_argument, NULL, 'l' },
+    { NULL, 0, NULL, 0 }
+  };
 
-    sem_wait(&menCountMutex);
-    menCount--; 
-    printf("Man %d leaves bathroom, number of men in bathroom is %d\n", pthread_self(), menCount);
+  /* read command line options, the remaining args are positional */
+  while ((option = getopt_long(argc, argv, "g:c:b:sD:Cm:w:t:rS:l:", options, NULL)) != -1) {
+    switch (option) {
+    case 'g': groups = atoi(optarg); break;
+    case 'c': capacity = atoi(optarg); break;
+    case 'b': batch = atoi(optarg); break;
+    case 's': useSemaphores = true; break;
+    case 'D': duration = atof(optarg); break;
+    case 'C': compare = true; break;
+    case 'm': simulate = atof(optarg); break;
+    case 'w': workers = atoi(optarg); break;
+    case 't': tick = atof(optarg); break;
+    case 'r': realtime = true; break;
+    case 'S': seed = strtoull(optarg, NULL, 0); break;
+    case 'l': logPath = optarg; break;
+    default: return 1;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
 
-    if (menCount == 0) {
-      sem_post(&accessMutex);
+  int persons = (argc > 1)? atoi(argv[1]) : MAXPERSONS;
+  if (!groupLockInit(&bathroom, groups, capacity, batch)) {
+    printf("The number of groups must be between 1 and %d\n", MAXGROUPS);
+    return 1;
+  }
+  if ((useSemaphores || compare) && (groups != 2 || capacity > 0)) {
+    printf("The semaphores only handle two groups without a capacity\n");
+    return 1;
+  }
+
+  if (simulate > 0) { /* Persons are records on a pool, the sleeps are events on a virtual clock */
+    struct SimConfig config;
+    struct SimStats stats;
+    simDefaults(&config, (long) persons * groups, simulate);
+    config.workers = workers;
+    config.tick = tick > 0 ? tick : SIMTICK;
+    config.realtime = realtime;
+    config.seed = seed;
+    if (!bathroomSimulate(&bathroom, &config, &stats)) {
+      printf("Could not start the simulation of %ld persons\n", config.persons);
+      return 1;
+    }
+    printf("Simulated %g sec with %ld persons in %g sec (%d workers, %ld events, %ld ticks, %g events/sec, %ld violations)\n",
+           simulate, config.persons, stats.wallSeconds, workers, stats.events, stats.ticks, stats.events / stats.wallSeconds,
+           stats.violations);
+    bool bounded = true;
+    for (int g = 0; g < groups; g++) {
+      double meanWait = stats.visits[g] > 0 ? stats.waitSeconds[g] / stats.visits[g] : simulate;
+      printf("  group %d: %ld visits, mean wait %g sec, longest wait %g sec\n", g, stats.visits[g],
+             stats.visits[g] > 0 ? meanWait : 0, stats.longestWait[g]);
+      if (simulate >= SIMCHECKED && meanWait > SIMSTARVED * simulate) bounded = false;
     }
+    printf("The group lock changed groups %ld times\n", bathroom.phases);
+    if (!bounded) { /* a fair lock with room for everybody keeps the waits to a few visits whatever the length */
+      printf("The mean wait of a group grew with the simulated time, the lock starves it or the bathroom is too small\n");
+      return 1;
+    }
+    return 0;
+  }
 
-    sem_post(&menCountMutex);
+  srand(time(NULL)); /* To allow for random seed generation */
+  if (logPath != NULL) {
+    if (!eventLogOpen(&eventLog, logPath)) {
+      printf("Could not write the event log %s\n", logPath);
+      return 1;
+    }
+    logging = true;
+  }
 
-    srand(seed);
-    sleep(rand() % 4 + 1);
+  struct Person *people = malloc((persons * groups > 0 ? persons * groups : 1) * sizeof(struct Person));
+  bool ran = people != NULL;
+  if (!ran) {
+    printf("Could not allocate %d persons\n", persons * groups);
+  } else if (duration > 0) { /* Benchmark, the visits go on back to back until the time is up */
+    benchmark = true;
+    if (compare) {
+      useSemaphores = true;
+      ran = runAndReport(people, persons, duration);
+      useSemaphores = false;
+      groupLockInit(&bathroom, groups, capacity, batch);
+    }
+    ran = ran && runAndReport(people, persons, duration);
+    if (ran && !useSemaphores) printf("The group lock changed groups %ld times\n", bathroom.phases);
+  } else {
+    struct sigaction action = { 0 };
+    action.sa_handler = interrupted;
+    sigaction(SIGINT, &action, NULL); /* forever, until ^C lets everyone finish the visit they are in */
+    ran = runAndReport(people, persons, 0);
   }
-}
\ No newline at end of file
+  if (logging) {
+    long dropped = eventLogClose(&eventLog);
+    printf("The event log %s has %ld events (%ld dropped)\n", logPath, eventLog.written, dropped);
+  }
+  free(people);
+  return ran ? 0 : 1;
+}
+#endif